@@ -0,0 +1,469 @@
+#include "Benchmark.h"
+#include "CorpusLoader.h"
+#include "Metrics.h"
+#include "provided.h"
+#include "Indexer.h"
+#include "DocumentStore.h"
+#include "http.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+#ifdef _MSC_VER  // Windows
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else  //  Mac OS X and LINUX
+#include <sys/resource.h>
+#endif
+
+// Consonant-vowel syllables the made-up words are spelled with
+static const char BENCHMARK_CONSONANTS[] = "bcdfghjklmnprstvz";
+static const char BENCHMARK_VOWELS[] = "aeiou";
+
+//******************** SyntheticCorpus functions *******************************
+
+SyntheticCorpus::SyntheticCorpus(const BenchmarkOptions& options)
+	: m_options(options), m_random(options.seed)
+{
+	// Word r spells out r in base (consonants * vowels), one syllable per
+	// digit, so every rank gets a different word and common words are short
+	const int consonants = sizeof(BENCHMARK_CONSONANTS) - 1;
+	const int vowels = sizeof(BENCHMARK_VOWELS) - 1;
+	m_words.resize(options.vocabulary);
+	m_cumulative.resize(options.vocabulary);
+	double total = 0;
+	for (int r = 0; r < options.vocabulary; r++)
+	{
+		int n = r;
+		do
+		{
+			int syllable = n % (consonants * vowels);
+			m_words[r] += BENCHMARK_CONSONANTS[syllable / vowels];
+			m_words[r] += BENCHMARK_VOWELS[syllable % vowels];
+			n /= consonants * vowels;
+		} while (n > 0);
+
+		total += 1.0 / std::pow(r + 1.0, options.zipfExponent);
+		m_cumulative[r] = total;
+	}
+	for (int r = 0; r < options.vocabulary; r++)
+		m_cumulative[r] /= total;
+}
+
+std::string SyntheticCorpus::url(int page) const
+{
+	return "http://www.synth" + std::to_string(static_cast<long long>(page)) + ".com/index.html";
+}
+
+void SyntheticCorpus::generatePage(int page, std::string& html)
+{
+	std::seed_seq seed = { m_options.seed, static_cast<unsigned int>(page) };
+	std::mt19937 random(seed);
+	std::lognormal_distribution<double> pageWords(std::log(static_cast<double>(m_options.medianPageWords)),
+		BENCHMARK_PAGE_WORDS_SIGMA);
+	std::uniform_int_distribution<int> anyPage(0, m_options.pages - 1);
+	int words = std::max(1, std::min(static_cast<int>(pageWords(random)), BENCHMARK_MAX_PAGE_WORDS));
+	int linkEvery = std::max(1, words / BENCHMARK_LINKS_PER_PAGE);
+
+	html = "<html><head><title>";
+	for (int w = 0; w < 5; w++)
+		html += (w == 0 ? "" : " ") + drawWord(random);
+	html += "</title></head>\n<body>\n<p>";
+	for (int w = 0; w < words; w++)
+	{
+		if (w > 0 && w % BENCHMARK_WORDS_PER_PARAGRAPH == 0)
+			html += "</p>\n<p>";
+		if (w % linkEvery == linkEvery - 1)
+			html += "<a href=\"" + url(anyPage(random)) + "\">" + drawWord(random) + "</a> ";
+		else
+			html += drawWord(random) + " ";
+	}
+	html += "</p>\n</body></html>\n";
+}
+
+std::string SyntheticCorpus::generateQuery()
+{
+	std::uniform_int_distribution<int> queryWords(1, BENCHMARK_MAX_QUERY_WORDS);
+	int words = queryWords(m_random);
+	std::string query;
+	for (int w = 0; w < words; w++)
+		query += (w == 0 ? "" : " ") + drawWord(m_random);
+	return query;
+}
+
+const std::string& SyntheticCorpus::drawWord(std::mt19937& random)
+{
+	std::uniform_real_distribution<double> uniform(0.0, 1.0);
+	std::vector<double>::const_iterator rank = std::lower_bound(m_cumulative.begin(), m_cumulative.end(),
+		uniform(random));
+	if (rank == m_cumulative.end())
+		--rank;
+	return m_words[rank - m_cumulative.begin()];
+}
+
+//******************** Reporting *******************************
+
+long long peakResidentBytes()
+{
+#ifdef _MSC_VER
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return static_cast<long long>(counters.PeakWorkingSetSize);
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return static_cast<long long>(usage.ru_maxrss);  // already in bytes
+#else
+	return static_cast<long long>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// What one stage did and how long it took. Stages timed per item also keep
+// each item's latency.
+struct StageResult
+{
+	StageResult()
+	{
+		seconds = 0;
+		items = 0;
+		bytes = 0;
+	}
+
+	double seconds;
+	long long items;
+	long long bytes;
+	std::vector<double> latencies;  // milliseconds
+};
+
+typedef std::chrono::steady_clock BenchmarkClock;
+
+// Where the index split into shardCount shards is saved
+static std::string shardPrefix(const BenchmarkOptions& options, int shardCount)
+{
+	return options.indexPrefix + ".k" + std::to_string(static_cast<long long>(shardCount));
+}
+
+static double secondsSince(BenchmarkClock::time_point start)
+{
+	return std::chrono::duration<double>(BenchmarkClock::now() - start).count();
+}
+
+// Latency below which the given fraction of the items finished
+static double percentile(std::vector<double> latencies, double fraction)
+{
+	if (latencies.empty())
+		return 0;
+	size_t k = std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()));
+	std::nth_element(latencies.begin(), latencies.begin() + k, latencies.end());
+	return latencies[k];
+}
+
+static void writeStage(std::ostream& out, const std::string& name, const StageResult& stage, bool last)
+{
+	out << "    \"" << name << "\": {\"seconds\": " << stage.seconds << ", \"items\": " << stage.items;
+	if (stage.seconds > 0)
+	{
+		out << ", \"itemsPerSecond\": " << stage.items / stage.seconds;
+		if (stage.bytes > 0)
+			out << ", \"megabytesPerSecond\": " << stage.bytes / stage.seconds / (1024 * 1024);
+	}
+	if (!stage.latencies.empty())
+	{
+		out << ", \"p50Milliseconds\": " << percentile(stage.latencies, 0.50)
+			<< ", \"p99Milliseconds\": " << percentile(stage.latencies, 0.99);
+	}
+	out << "}" << (last ? "" : ",") << "\n";
+}
+
+// Memory of each shard server and the query throughput with shardCount of them
+static void writeShards(std::ostream& out, int shardCount, const StageResult& stage, const std::vector<size_t>& bytes,
+	bool last)
+{
+	size_t maxBytes = 0;
+	out << "    \"" << shardCount << "\": {\"shardBytes\": [";
+	for (unsigned int k = 0; k < bytes.size(); k++)
+	{
+		out << (k == 0 ? "" : ", ") << bytes[k];
+		maxBytes = std::max(maxBytes, bytes[k]);
+	}
+	out << "], \"maxShardBytes\": " << maxBytes << ", \"queriesPerSecond\": "
+		<< (stage.seconds > 0 ? stage.items / stage.seconds : 0) << "}" << (last ? "" : ",") << "\n";
+}
+
+static void writeStructure(std::ostream& out, const StructureMemoryStats& structure, bool last)
+{
+	out << "    \"" << structure.name << "\": {\"entries\": " << structure.entries
+		<< ", \"totalBytes\": " << structure.totalBytes;
+	if (structure.treeHeight > 0)
+	{
+		out << ", \"nodeBytes\": " << structure.nodeBytes << ", \"keyBytes\": " << structure.keyBytes
+			<< ", \"valueBytes\": " << structure.valueBytes << ", \"overheadBytes\": " << structure.overheadBytes
+			<< ", \"treeHeight\": " << structure.treeHeight << ", \"balancedHeight\": " << structure.balancedHeight
+			<< ", \"averageDepth\": " << structure.averageDepth;
+	}
+	out << "}" << (last ? "" : ",") << "\n";
+}
+
+//******************** runBenchmark *******************************
+
+bool runBenchmark(const BenchmarkOptions& options, std::ostream& out)
+{
+	resetMetrics();
+	SyntheticCorpus corpus(options);
+	StageResult generate;
+	StageResult crawl;
+	StageResult wordBag;
+	StageResult incorporate;
+	StageResult documents;
+	StageResult save;
+	StageResult load;
+	StageResult search;
+	StageResult searchHugePages;
+	StageResult searchUnfrozen;
+	StageResult searchFrequentTerms;
+	StageResult snippet;
+	int pagesIndexed = 0;
+	long long matches = 0;
+	IndexMemoryStats memory;
+
+	// Generate: straight into the pseudo-web, as a crawl would find it. A saved
+	// crawl is only mapped here; its pages are read by the crawl stage.
+	std::vector<std::string> urls;
+	bool loadCorpus = !options.corpusDirectory.empty() || !options.corpusArchive.empty();
+	std::string html;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	if (!loadCorpus)
+	{
+		for (int page = 0; page < options.pages; page++)
+		{
+			corpus.generatePage(page, html);
+			urls.push_back(corpus.url(page));
+			HTTP().set(urls.back(), html);
+			generate.bytes += html.size();
+		}
+	}
+	else if (!(options.corpusArchive.empty() ? loadCorpusDirectory(options.corpusDirectory, options.corpusUrlPrefix, urls) :
+		loadCorpusArchive(options.corpusArchive, urls)))
+		return false;
+	generate.seconds = secondsSince(start);
+	generate.items = urls.size();
+
+	// Words for the queries over a loaded corpus, drawn from its pages (so
+	// with their frequencies there)
+	std::vector<std::string> queryWords;
+	std::mt19937 queryRandom(options.seed);
+
+	// Crawl, tokenize and incorporate each page, timing each step separately.
+	// Whatever the index writes to std::cerr is thrown away here so it isn't
+	// what gets timed.
+	std::ostringstream discard;
+	std::streambuf* savedCerr = std::cerr.rdbuf(discard.rdbuf());
+	{
+		Indexer indexer;
+		DocumentStore store(HASH_TABLE_SIZE);
+		std::string page;
+		for (unsigned int p = 0; p < urls.size(); p++)
+		{
+			const std::string& url = urls[p];
+			BenchmarkClock::time_point pageStart = BenchmarkClock::now();
+			bool fetched = HTTP().get(url, page);
+			crawl.latencies.push_back(secondsSince(pageStart) * 1000);
+			if (!fetched)
+				continue;
+			crawl.bytes += page.size();
+
+			pageStart = BenchmarkClock::now();
+			WordBag wb(page);
+			wordBag.latencies.push_back(secondsSince(pageStart) * 1000);
+			wordBag.bytes += page.size();
+
+			pageStart = BenchmarkClock::now();
+			bool incorporated = indexer.incorporate(url, wb);
+			incorporate.latencies.push_back(secondsSince(pageStart) * 1000);
+			incorporate.bytes += page.size();
+			if (incorporated)
+			{
+				// What WebCrawler does with its document store enabled
+				pagesIndexed++;
+				pageStart = BenchmarkClock::now();
+				store.add(urlIdFor(url, HASH_TABLE_SIZE), visibleText(page));
+				documents.latencies.push_back(secondsSince(pageStart) * 1000);
+				documents.bytes += page.size();
+			}
+
+			if (loadCorpus)
+			{
+				Tokenizer t(page);
+				std::string word;
+				for (int k = 0; t.getNextToken(word); k++)
+				{
+					if (k % BENCHMARK_QUERY_WORD_SAMPLING == 0)
+						queryWords.push_back(word);
+				}
+			}
+		}
+		discard.str("");
+		memory = indexer.memoryStats();
+
+		start = BenchmarkClock::now();
+		bool saved = indexer.save(options.indexPrefix) && store.save(options.indexPrefix + ".docs");
+		save.seconds = secondsSince(start);
+		save.items = 1;
+
+		// The same index split into shards, for the sharded searches
+		for (int k = 0; k < BENCHMARK_SHARD_RUNS && saved; k++)
+			saved = indexer.saveShards(shardPrefix(options, BENCHMARK_SHARD_COUNTS[k]), BENCHMARK_SHARD_COUNTS[k]);
+		if (!saved)
+		{
+			std::cerr.rdbuf(savedCerr);
+			std::cerr << "Error: cannot save the benchmark index to " << options.indexPrefix << std::endl;
+			return false;
+		}
+	}
+
+	// The same queries are run against the index as Searcher::load leaves it
+	// (frozen into an arena), then on huge pages, then not frozen at all
+	std::vector<std::string> queries;
+	for (int q = 0; q < options.queries; q++)
+	{
+		std::string query;
+		if (!loadCorpus)
+			query = corpus.generateQuery();
+		else if (!queryWords.empty())
+		{
+			std::uniform_int_distribution<int> wordCount(1, BENCHMARK_MAX_QUERY_WORDS);
+			std::uniform_int_distribution<int> anyWord(0, queryWords.size() - 1);
+			for (int w = wordCount(queryRandom); w > 0; w--)
+				query += queryWords[anyWord(queryRandom)] + " ";
+		}
+		queries.push_back(query);
+	}
+
+	FreezeMode freezeModes[] = { FREEZE_ARENA, FREEZE_HUGE_PAGES, FREEZE_NONE, FREEZE_ARENA };
+	StageResult* searchStages[] = { &search, &searchHugePages, &searchUnfrozen, &searchFrequentTerms };
+	for (unsigned int f = 0; f < sizeof(freezeModes) / sizeof(freezeModes[0]); f++)
+	{
+		Searcher searcher;
+		searcher.setFreezeMode(freezeModes[f]);
+		if (searchStages[f] == &searchFrequentTerms)
+			searcher.setFrequentTerms(BENCHMARK_FREQUENT_TERM_FRACTION, std::vector<std::string>());
+		start = BenchmarkClock::now();
+		bool loaded = searcher.load(options.indexPrefix);
+		if (f == 0)
+		{
+			load.seconds = secondsSince(start);
+			load.items = 1;
+		}
+		if (!loaded)
+		{
+			std::cerr.rdbuf(savedCerr);
+			std::cerr << "Error: cannot load the benchmark index from " << options.indexPrefix << std::endl;
+			return false;
+		}
+
+		for (unsigned int q = 0; q < queries.size(); q++)
+		{
+			BenchmarkClock::time_point queryStart = BenchmarkClock::now();
+			std::vector<std::string> found = searcher.search(queries[q]);
+			searchStages[f]->latencies.push_back(secondsSince(queryStart) * 1000);
+			discard.str("");
+			if (f != 0)
+				continue;
+			matches += found.size();
+
+			// A result page's worth of snippets, each timed on its own
+			for (unsigned int r = 0; r < found.size() && r < BENCHMARK_SNIPPETS_PER_QUERY; r++)
+			{
+				BenchmarkClock::time_point snippetStart = BenchmarkClock::now();
+				std::string text = searcher.getSnippet(found[r]);
+				snippet.latencies.push_back(secondsSince(snippetStart) * 1000);
+				snippet.bytes += text.size();
+			}
+		}
+	}
+
+	// The same queries again over each number of shards
+	StageResult searchShards[BENCHMARK_SHARD_RUNS];
+	std::vector<size_t> shardBytes[BENCHMARK_SHARD_RUNS];
+	for (int k = 0; k < BENCHMARK_SHARD_RUNS; k++)
+	{
+		Searcher searcher;
+		if (!searcher.loadShards(shardPrefix(options, BENCHMARK_SHARD_COUNTS[k])))
+		{
+			std::cerr.rdbuf(savedCerr);
+			std::cerr << "Error: cannot load the benchmark shards of " << options.indexPrefix << std::endl;
+			return false;
+		}
+		shardBytes[k] = searcher.getShardBytes();
+
+		for (unsigned int q = 0; q < queries.size(); q++)
+		{
+			BenchmarkClock::time_point queryStart = BenchmarkClock::now();
+			searcher.search(queries[q]);
+			searchShards[k].latencies.push_back(secondsSince(queryStart) * 1000);
+			discard.str("");
+		}
+	}
+	std::cerr.rdbuf(savedCerr);
+
+	// The per-item stages take as long as their items did in total
+	std::vector<StageResult*> perItem;
+	StageResult* pageAndQueryStages[] = { &crawl, &wordBag, &incorporate, &documents, &search, &searchHugePages,
+		&searchUnfrozen, &searchFrequentTerms, &snippet };
+	perItem.assign(pageAndQueryStages, pageAndQueryStages + sizeof(pageAndQueryStages) / sizeof(pageAndQueryStages[0]));
+	for (int k = 0; k < BENCHMARK_SHARD_RUNS; k++)
+		perItem.push_back(&searchShards[k]);
+	for (unsigned int s = 0; s < perItem.size(); s++)
+	{
+		perItem[s]->items = perItem[s]->latencies.size();
+		for (unsigned int i = 0; i < perItem[s]->latencies.size(); i++)
+			perItem[s]->seconds += perItem[s]->latencies[i] / 1000;
+	}
+
+	out << "{\n";
+	out << "  \"corpus\": {\"pages\": " << urls.size() << ", \"pagesIndexed\": " << pagesIndexed;
+	if (!loadCorpus)
+		out << ", \"vocabulary\": " << options.vocabulary << ", \"zipfExponent\": " << options.zipfExponent;
+	out << ", \"bytes\": " << crawl.bytes << ", \"queries\": " << options.queries
+		<< ", \"matches\": " << matches << "},\n";
+	out << "  \"stages\": {\n";
+	writeStage(out, loadCorpus ? "loadCorpus" : "generate", generate, false);
+	writeStage(out, "crawl", crawl, false);
+	writeStage(out, "wordBag", wordBag, false);
+	writeStage(out, "incorporate", incorporate, false);
+	writeStage(out, "documents", documents, false);
+	writeStage(out, "save", save, false);
+	writeStage(out, "load", load, false);
+	writeStage(out, "search", search, false);
+	writeStage(out, "searchHugePages", searchHugePages, false);
+	writeStage(out, "searchUnfrozen", searchUnfrozen, false);
+	writeStage(out, "searchFrequentTerms", searchFrequentTerms, false);
+	for (int k = 0; k < BENCHMARK_SHARD_RUNS; k++)
+		writeStage(out, "searchShards" + std::to_string(static_cast<long long>(BENCHMARK_SHARD_COUNTS[k])), searchShards[k], false);
+	writeStage(out, "snippet", snippet, true);
+	out << "  },\n";
+	out << "  \"shards\": {\n";
+	for (int k = 0; k < BENCHMARK_SHARD_RUNS; k++)
+		writeShards(out, BENCHMARK_SHARD_COUNTS[k], searchShards[k], shardBytes[k], k + 1 == BENCHMARK_SHARD_RUNS);
+	out << "  },\n";
+	out << "  \"memory\": {\"totalBytes\": " << memory.totalBytes << ", \"structures\": {\n";
+	for (unsigned int s = 0; s < memory.structures.size(); s++)
+		writeStructure(out, memory.structures[s], s + 1 == memory.structures.size());
+	out << "  }},\n";
+	if (metricsEnabled())
+	{
+		std::string metrics = dumpMetrics(METRICS_JSON);
+		metrics.erase(metrics.find_last_not_of('\n') + 1);
+		out << "  \"metrics\": " << metrics << ",\n";
+	}
+	out << "  \"peakResidentBytes\": " << peakResidentBytes() << "\n";
+	out << "}\n";
+	return true;
+}
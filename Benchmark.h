@@ -0,0 +1,113 @@
+#ifndef BENCHMARK_INCLUDED
+#define BENCHMARK_INCLUDED
+
+#include <string>
+#include <vector>
+#include <random>
+#include <ostream>
+
+// End-to-end benchmark over a synthetic pseudo-web (see http.h). The corpus is
+// generated from a fixed seed, so two builds given the same options index and
+// search exactly the same pages and queries, and their reports can be compared
+// to catch regressions.
+//
+// Instead of the synthetic corpus, a crawl saved on disk can be loaded with
+// CorpusLoader.h; the queries are then words picked from its pages.
+//
+// Each stage is timed on its own: generating the pages into HTTP().set (or
+// loading them), fetching them back (crawl), tokenizing them (wordBag),
+// incorporating them, adding their text to a document store, saving the index
+// (and the store), loading it into a Searcher, searching it and getting the
+// snippets of the top BENCHMARK_SNIPPETS_PER_QUERY results of every search
+// (see Searcher::getSnippet). The searches are run again with the index frozen
+// on huge pages, not frozen at all (see Indexer::freeze) and with the words on
+// BENCHMARK_FREQUENT_TERM_FRACTION of the pages set apart as frequent (see
+// Searcher::setFrequentTerms), and then over the index split into each of
+// BENCHMARK_SHARD_COUNTS shards (see Shards.h), with the memory each shard
+// server holds. The shard servers are threads of this one process, so it is
+// the share of each shard that falls as the count grows, not the memory of the
+// process; and the queries are run one at a time, so the throughput is that of
+// one client whose queries are spread over the shards. The report is
+// a JSON object with, per stage, its total time and throughput and, for the
+// stages timed one page or query at a time, the median (p50) and 99th
+// percentile (p99) latency. The memory the index takes once every page is
+// incorporated is broken down by structure (see Indexer::memoryStats). The peak
+// resident set size of the process is given at the end, and with P4_METRICS
+// the metrics of Metrics.h as well.
+
+// Page sizes are log-normally distributed around the median, roughly the
+// spread of word counts seen on real pages
+static const int BENCHMARK_DEFAULT_PAGES = 2000;
+static const int BENCHMARK_DEFAULT_VOCABULARY = 50000;
+static const double BENCHMARK_DEFAULT_ZIPF_EXPONENT = 1.0;
+static const int BENCHMARK_DEFAULT_MEDIAN_PAGE_WORDS = 600;
+static const double BENCHMARK_PAGE_WORDS_SIGMA = 0.8;
+static const int BENCHMARK_MAX_PAGE_WORDS = 20000;
+static const int BENCHMARK_WORDS_PER_PARAGRAPH = 60;
+static const int BENCHMARK_LINKS_PER_PAGE = 10;
+static const int BENCHMARK_DEFAULT_QUERIES = 500;
+static const int BENCHMARK_MAX_QUERY_WORDS = 3;
+static const unsigned int BENCHMARK_SNIPPETS_PER_QUERY = 10;
+static const double BENCHMARK_FREQUENT_TERM_FRACTION = 0.1;
+static const int BENCHMARK_QUERY_WORD_SAMPLING = 97;  // loaded pages give every 97th token to the queries
+static const int BENCHMARK_SHARD_COUNTS[] = { 1, 2, 4 };
+static const int BENCHMARK_SHARD_RUNS = sizeof(BENCHMARK_SHARD_COUNTS) / sizeof(BENCHMARK_SHARD_COUNTS[0]);
+
+struct BenchmarkOptions
+{
+	BenchmarkOptions()
+	{
+		pages = BENCHMARK_DEFAULT_PAGES;
+		vocabulary = BENCHMARK_DEFAULT_VOCABULARY;
+		zipfExponent = BENCHMARK_DEFAULT_ZIPF_EXPONENT;
+		medianPageWords = BENCHMARK_DEFAULT_MEDIAN_PAGE_WORDS;
+		queries = BENCHMARK_DEFAULT_QUERIES;
+		seed = 12345;
+	}
+
+	int pages;
+	int vocabulary;			// distinct words the pages are drawn from
+	double zipfExponent;	// the word of rank r turns up in proportion to 1 / r^zipfExponent
+	int medianPageWords;
+	int queries;
+	unsigned int seed;
+	std::string indexPrefix;  // where the index is saved; required
+
+	// A saved crawl to use instead of generated pages (see CorpusLoader.h);
+	// the directory (with its url prefix) or the archive, whichever is set
+	std::string corpusDirectory;
+	std::string corpusUrlPrefix;
+	std::string corpusArchive;
+};
+
+// Pages and queries of the synthetic corpus. Words are made-up lowercase
+// syllable strings, one per rank, drawn with a Zipfian distribution. Each page
+// is drawn from a generator seeded with the seed and its number, so it is the
+// same whichever pages were generated before it; queries come from one
+// generator seeded with the seed, in order.
+class SyntheticCorpus
+{
+public:
+	SyntheticCorpus(const BenchmarkOptions& options);
+
+	std::string url(int page) const;
+	void generatePage(int page, std::string& html);
+	std::string generateQuery();
+
+private:
+	const std::string& drawWord(std::mt19937& random);
+
+	BenchmarkOptions m_options;
+	std::vector<std::string> m_words;		// by rank
+	std::vector<double> m_cumulative;		// m_cumulative[r] = P(rank <= r)
+	std::mt19937 m_random;					// for the queries
+};
+
+// Peak resident set size of this process so far, 0 if it can't be found out
+long long peakResidentBytes();
+
+// Runs every stage, writing the JSON report to out. False if the index
+// couldn't be saved or loaded.
+bool runBenchmark(const BenchmarkOptions& options, std::ostream& out);
+
+#endif // BENCHMARK_INCLUDED
@@ -0,0 +1,151 @@
+#ifndef BINARYIO_INCLUDED
+#define BINARYIO_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <cstdio>  // for rename and remove
+
+// Helpers for the compact binary save files. Everything is written into a
+// std::string buffer first and then handed to the file in one write, so a
+// crash can at worst leave a torn record at the very end of a file. Readers
+// walk the buffer with a (p, end) pair and return false on a short read
+// instead of running off the end, which is how torn tails are detected.
+
+// Unsigned LEB128: 7 bits per byte, high bit set on every byte but the last.
+// Small values (lengths, counts, id gaps) take a single byte.
+inline void putVarint(std::string& buf, unsigned long long v)
+{
+	while (v >= 0x80)
+	{
+		buf += static_cast<char>((v & 0x7F) | 0x80);
+		v >>= 7;
+	}
+	buf += static_cast<char>(v);
+}
+
+inline bool getVarint(const char*& p, const char* end, unsigned long long& v)
+{
+	v = 0;
+	for (int shift = 0; p != end && shift < 64; shift += 7)
+	{
+		unsigned char byte = static_cast<unsigned char>(*p++);
+		v |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+inline bool getVarint(const char*& p, const char* end, int& i)
+{
+	unsigned long long v;
+	if (!getVarint(p, end, v))
+		return false;
+	i = static_cast<int>(v);
+	return true;
+}
+
+// Length-prefixed string
+inline void putString(std::string& buf, const std::string& s)
+{
+	putVarint(buf, s.size());
+	buf += s;
+}
+
+inline bool getString(const char*& p, const char* end, std::string& s)
+{
+	unsigned long long len;
+	if (!getVarint(p, end, len) || len > static_cast<unsigned long long>(end - p))
+		return false;
+	s.assign(p, static_cast<size_t>(len));
+	p += len;
+	return true;
+}
+
+// Fixed width little-endian 64-bit value (used for hashes, where a varint
+// would almost always take 10 bytes anyway)
+inline void putFixed64(std::string& buf, unsigned long long v)
+{
+	for (int i = 0; i < 8; i++)
+		buf += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+inline bool getFixed64(const char*& p, const char* end, unsigned long long& v)
+{
+	if (end - p < 8)
+		return false;
+	v = 0;
+	for (int i = 0; i < 8; i++)
+		v |= static_cast<unsigned long long>(static_cast<unsigned char>(p[i])) << (8 * i);
+	p += 8;
+	return true;
+}
+
+// Fixed width little-endian 32-bit value, for tables that are read in place
+// by position (see IndexSegment::openMapped) rather than walked
+inline void putFixed32(std::string& buf, unsigned int v)
+{
+	for (int i = 0; i < 4; i++)
+		buf += static_cast<char>((v >> (8 * i)) & 0xFF);
+}
+
+inline unsigned int fixed32At(const char* p)
+{
+	unsigned int v = 0;
+	for (int i = 0; i < 4; i++)
+		v |= static_cast<unsigned int>(static_cast<unsigned char>(p[i])) << (8 * i);
+	return v;
+}
+
+// Whole-file helpers. A missing file reads as an error, not as empty.
+inline bool readWholeFile(const std::string& filename, std::string& contents)
+{
+	std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!stream)
+		return false;
+	stream.seekg(0, std::ios::end);
+	std::streamoff size = stream.tellg();
+	stream.seekg(0, std::ios::beg);
+	contents.resize(static_cast<size_t>(size));
+	if (size > 0)
+		stream.read(&contents[0], size);
+	return static_cast<bool>(stream);
+}
+
+inline bool writeWholeFile(const std::string& filename, const std::string& contents)
+{
+	std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!stream)
+	{
+		std::cerr << "Error: Cannot create " << filename << std::endl;
+		return false;
+	}
+	stream.write(contents.data(), contents.size());
+	return static_cast<bool>(stream);
+}
+
+// Writes under a temporary name and renames it into place, so a crash never
+// leaves a half written file under a name another file may refer to
+inline bool replaceWholeFile(const std::string& filename, const std::string& contents)
+{
+	std::string tempName = filename + ".tmp";
+	if (!writeWholeFile(tempName, contents))
+		return false;
+	std::remove(filename.c_str());
+	return std::rename(tempName.c_str(), filename.c_str()) == 0;
+}
+
+inline bool appendToFile(const std::string& filename, const std::string& bytes)
+{
+	std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+	if (!stream)
+	{
+		std::cerr << "Error: Cannot append to " << filename << std::endl;
+		return false;
+	}
+	stream.write(bytes.data(), bytes.size());
+	return static_cast<bool>(stream);
+}
+
+#endif // BINARYIO_INCLUDED
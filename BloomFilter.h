@@ -0,0 +1,139 @@
+#ifndef BLOOMFILTER_INCLUDED
+#define BLOOMFILTER_INCLUDED
+
+#include "provided.h"
+#include "BinaryIO.h"
+#include <string>
+#include <cmath>
+#include <algorithm>
+
+// Bloom filter over a term vocabulary, checked before a term is looked up so
+// that terms which aren't in the index at all (typos, rare words) are turned
+// away without touching the dictionary. Each term sets hashCount bits derived
+// from its contentFingerprint by double hashing; a term is possibly present
+// only if all of its bits are set. A filter with no bits is disabled and
+// answers "possibly present" for everything.
+//
+// Encoded as: varint byte count, varint hash count, then the bit array.
+
+static const double BLOOM_DEFAULT_FALSE_POSITIVE_RATE = 0.01;
+static const size_t BLOOM_DEFAULT_MAX_BYTES = 1024 * 1024;
+static const int BLOOM_MAX_HASHES = 16;
+
+// How filters are sized. A false positive rate outside (0, 1) disables them.
+struct BloomFilterOptions
+{
+	BloomFilterOptions()
+	{
+		falsePositiveRate = BLOOM_DEFAULT_FALSE_POSITIVE_RATE;
+		maxBytes = BLOOM_DEFAULT_MAX_BYTES;
+	}
+
+	double falsePositiveRate;
+	size_t maxBytes;	// per filter; past this the false positive rate goes up instead
+};
+
+class BloomFilter
+{
+public:
+	BloomFilter()
+	{
+		m_hashCount = 0;
+	}
+
+	// Empties the filter and sizes it for itemCount items
+	void reset(size_t itemCount, const BloomFilterOptions& options)
+	{
+		m_bits.clear();
+		m_hashCount = 0;
+		double rate = options.falsePositiveRate;
+		if (rate <= 0 || rate >= 1 || options.maxBytes == 0)
+			return;
+
+		// Optimal size is -n ln p / (ln 2)^2 bits with (bits / n) ln 2 hashes
+		const double LN2 = 0.69314718055994531;
+		itemCount = std::max<size_t>(itemCount, 1);
+		double bits = std::ceil(-static_cast<double>(itemCount) * std::log(rate) / (LN2 * LN2));
+		size_t bytes = static_cast<size_t>(bits / 8) + 1;
+		bytes = std::max<size_t>(8, std::min(bytes, options.maxBytes));
+		m_bits.assign(bytes, '\0');
+
+		int hashes = static_cast<int>(static_cast<double>(bytes * 8) / itemCount * LN2 + 0.5);
+		m_hashCount = std::max(1, std::min(hashes, BLOOM_MAX_HASHES));
+	}
+
+	bool enabled() const
+	{
+		return !m_bits.empty();
+	}
+
+	void add(const std::string& term)
+	{
+		addFingerprint(contentFingerprint(term));
+	}
+
+	// For writers that collect the terms' fingerprints before the filter can be sized
+	void addFingerprint(unsigned long long h)
+	{
+		if (!enabled())
+			return;
+
+		unsigned long long step = (h >> 32) | 1;
+		unsigned long long bitCount = m_bits.size() * 8ULL;
+		for (int i = 0; i < m_hashCount; i++, h += step)
+		{
+			unsigned long long bit = h % bitCount;
+			m_bits[static_cast<size_t>(bit / 8)] |= static_cast<char>(1 << (bit % 8));
+		}
+	}
+
+	bool mightContain(const std::string& term) const
+	{
+		if (!enabled())
+			return true;
+
+		unsigned long long h = contentFingerprint(term);
+		unsigned long long step = (h >> 32) | 1;
+		unsigned long long bitCount = m_bits.size() * 8ULL;
+		for (int i = 0; i < m_hashCount; i++, h += step)
+		{
+			unsigned long long bit = h % bitCount;
+			if ((m_bits[static_cast<size_t>(bit / 8)] & (1 << (bit % 8))) == 0)
+				return false;
+		}
+		return true;
+	}
+
+	size_t sizeInBytes() const
+	{
+		return sizeof(*this) + m_bits.capacity();
+	}
+
+	void encode(std::string& buf) const
+	{
+		putVarint(buf, m_bits.size());
+		putVarint(buf, m_hashCount);
+		buf += m_bits;
+	}
+
+	bool decode(const char*& p, const char* end)
+	{
+		unsigned long long bytes;
+		int hashes;
+		if (!getVarint(p, end, bytes) || !getVarint(p, end, hashes) ||
+			bytes > static_cast<unsigned long long>(end - p) || hashes < 0 || hashes > BLOOM_MAX_HASHES ||
+			(bytes != 0 && hashes == 0))
+			return false;
+
+		m_bits.assign(p, static_cast<size_t>(bytes));
+		m_hashCount = hashes;
+		p += bytes;
+		return true;
+	}
+
+private:
+	std::string m_bits;
+	int m_hashCount;
+};
+
+#endif // BLOOMFILTER_INCLUDED
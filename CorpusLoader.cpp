@@ -0,0 +1,227 @@
+#include "CorpusLoader.h"
+#include "MappedFile.h"
+#include "http.h"
+#include <iostream>
+#include <memory>
+#include <cctype>
+#include <cstdlib>  // for strtoull
+
+#ifdef _MSC_VER  // Windows
+#include <windows.h>
+#else  //  Mac OS X and LINUX
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+//******************** Directory trees *******************************
+
+// Appends the paths (relative to root) of every file under root/relative
+static bool listFiles(const std::string& root, const std::string& relative, std::vector<std::string>& files)
+{
+	std::string directory = relative.empty() ? root : root + "/" + relative;
+	std::vector<std::string> subdirectories;
+
+#ifdef _MSC_VER
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((directory + "/*").c_str(), &entry);
+	if (find == INVALID_HANDLE_VALUE)
+		return false;
+	do
+	{
+		std::string name = entry.cFileName;
+		if (name == "." || name == "..")
+			continue;
+		std::string path = relative.empty() ? name : relative + "/" + name;
+		if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			subdirectories.push_back(path);
+		else
+			files.push_back(path);
+	} while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (dir == nullptr)
+		return false;
+	for (struct dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name == "." || name == "..")
+			continue;
+
+		// Symbolic links aren't followed, so a link back up the tree can't loop
+		std::string path = relative.empty() ? name : relative + "/" + name;
+		struct stat status;
+		if (lstat((root + "/" + path).c_str(), &status) != 0)
+			continue;
+		if (S_ISDIR(status.st_mode))
+			subdirectories.push_back(path);
+		else if (S_ISREG(status.st_mode))
+			files.push_back(path);
+	}
+	closedir(dir);
+#endif
+
+	for (unsigned int i = 0; i < subdirectories.size(); i++)
+	{
+		if (!listFiles(root, subdirectories[i], files))
+			std::cerr << "Error: Cannot read directory " << root << "/" << subdirectories[i] << std::endl;
+	}
+	return true;
+}
+
+bool loadCorpusDirectory(const std::string& root, const std::string& urlPrefix, std::vector<std::string>& urls)
+{
+	std::vector<std::string> files;
+	if (!listFiles(root, "", files))
+	{
+		std::cerr << "Error: Cannot read directory " << root << std::endl;
+		return false;
+	}
+
+	for (unsigned int i = 0; i < files.size(); i++)
+	{
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+		if (!file->open(root + "/" + files[i]))
+		{
+			std::cerr << "Error: Cannot read from " << root << "/" << files[i] << std::endl;
+			continue;
+		}
+		std::string url = urlPrefix + files[i];
+		HTTP().setMapped(url, file, 0, file->size());
+		urls.push_back(url);
+	}
+	return true;
+}
+
+//******************** WARC archives *******************************
+
+// The line starting at p (without its line break) and where the next one starts
+static bool readLine(const char*& p, const char* end, std::string& line)
+{
+	if (p == end)
+		return false;
+	const char* lineEnd = p;
+	while (lineEnd != end && *lineEnd != '\n')
+		lineEnd++;
+	line.assign(p, lineEnd);
+	if (!line.empty() && line[line.size() - 1] == '\r')
+		line.erase(line.size() - 1);
+	p = (lineEnd == end ? end : lineEnd + 1);
+	return true;
+}
+
+static bool headerNameIs(const std::string& line, size_t colon, const char* name)
+{
+	size_t i = 0;
+	for (; i < colon && name[i] != '\0'; i++)
+	{
+		if (std::tolower(static_cast<unsigned char>(line[i])) != std::tolower(static_cast<unsigned char>(name[i])))
+			return false;
+	}
+	return i == colon && name[i] == '\0';
+}
+
+static std::string headerValue(const std::string& line, size_t colon)
+{
+	size_t start = line.find_first_not_of(" \t", colon + 1);
+	if (start == std::string::npos)
+		return "";
+	size_t end = line.find_last_not_of(" \t");
+	return line.substr(start, end - start + 1);
+}
+
+// Where the body of an HTTP response starts: after the blank line that ends its headers
+static const char* skipHttpHeaders(const char* p, const char* end)
+{
+	std::string line;
+	while (readLine(p, end, line))
+	{
+		if (line.empty())
+			return p;
+	}
+	return nullptr;
+}
+
+bool loadCorpusArchive(const std::string& filename, std::vector<std::string>& urls)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->open(filename))
+	{
+		std::cerr << "Error: Cannot read from " << filename << std::endl;
+		return false;
+	}
+	if (file->size() >= 2 && static_cast<unsigned char>(file->data()[0]) == 0x1f &&
+		static_cast<unsigned char>(file->data()[1]) == 0x8b)
+	{
+		std::cerr << "Error: " << filename << " is compressed; decompress it first" << std::endl;
+		return false;
+	}
+
+	const char* begin = file->data();
+	const char* end = begin + file->size();
+	const char* p = begin;
+	std::string line;
+	while (p != end)
+	{
+		// Records are separated by blank lines
+		const char* recordStart = p;
+		if (!readLine(p, end, line))
+			break;
+		if (line.empty())
+			continue;
+		if (line.compare(0, 5, "WARC/") != 0)
+		{
+			std::cerr << "Error: corrupt WARC record at byte " << recordStart - begin << " of " << filename << std::endl;
+			return false;
+		}
+
+		std::string type;
+		std::string url;
+		unsigned long long contentLength = 0;
+		bool haveLength = false;
+		while (readLine(p, end, line) && !line.empty())
+		{
+			size_t colon = line.find(':');
+			if (colon == std::string::npos)
+				continue;
+			if (headerNameIs(line, colon, "WARC-Type"))
+				type = headerValue(line, colon);
+			else if (headerNameIs(line, colon, "WARC-Target-URI"))
+				url = headerValue(line, colon);
+			else if (headerNameIs(line, colon, "Content-Length"))
+			{
+				contentLength = std::strtoull(headerValue(line, colon).c_str(), nullptr, 10);
+				haveLength = true;
+			}
+		}
+		if (!haveLength || contentLength > static_cast<unsigned long long>(end - p))
+		{
+			std::cerr << "Error: corrupt WARC record at byte " << recordStart - begin << " of " << filename << std::endl;
+			return false;
+		}
+
+		const char* block = p;
+		const char* blockEnd = p + contentLength;
+		p = blockEnd;
+
+		// Some writers put the uri in angle brackets
+		if (url.size() >= 2 && url[0] == '<' && url[url.size() - 1] == '>')
+			url = url.substr(1, url.size() - 2);
+		if (url.empty())
+			continue;
+
+		const char* body;
+		if (type == "response")
+			body = skipHttpHeaders(block, blockEnd);
+		else if (type == "resource" || type == "conversion")
+			body = block;
+		else
+			continue;
+		if (body == nullptr)
+			continue;
+
+		HTTP().setMapped(url, file, body - begin, blockEnd - body);
+		urls.push_back(url);
+	}
+	return true;
+}
@@ -0,0 +1,26 @@
+#ifndef CORPUSLOADER_INCLUDED
+#define CORPUSLOADER_INCLUDED
+
+#include <string>
+#include <vector>
+
+// Bulk loading of the pseudo-web (see http.h) from a crawl saved on disk, for
+// crawling and indexing without a network. The files are memory-mapped and
+// each page is handed to HTTP().setMapped as a range of its file, so loading
+// copies nothing; a page's contents are only read once the crawl fetches it.
+// The urls of the loaded pages are appended to urls, in the order they were
+// found, ready to be given to WebCrawler::addUrl.
+
+// Every file under root, recursively. A file's url is urlPrefix followed by
+// its path relative to root with '/' separators, so with urlPrefix "http://"
+// the file root/www.a.com/news/index.html is http://www.a.com/news/index.html.
+bool loadCorpusDirectory(const std::string& root, const std::string& urlPrefix, std::vector<std::string>& urls);
+
+// The pages of an uncompressed WARC or WET archive: the bodies of response
+// records (without their HTTP headers) and the contents of resource and
+// conversion records (WET text), under their WARC-Target-URI. Other records
+// are skipped. False if the archive can't be read or is corrupt; the pages
+// before the corruption are still loaded.
+bool loadCorpusArchive(const std::string& filename, std::vector<std::string>& urls);
+
+#endif // CORPUSLOADER_INCLUDED
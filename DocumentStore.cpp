@@ -0,0 +1,503 @@
+#include "DocumentStore.h"
+#include "BinaryIO.h"
+#include "provided.h"
+#include <cstring>
+#include <cstdlib>  // for strtol
+#include <cctype>
+#include <algorithm>
+
+
+//******************** DocumentStore functions *******************************
+
+DocumentStore::DocumentStore(int idLimit)
+{
+	Doc none;
+	none.block = -1;
+	none.offset = 0;
+	none.length = 0;
+	m_docs.assign(idLimit, none);
+	clear();
+}
+
+void DocumentStore::clear()
+{
+	for (unsigned int id = 0; id < m_docs.size(); id++)
+		m_docs[id].block = -1;
+	m_docCount = 0;
+	m_blocks.clear();
+	m_blockRawBytes.clear();
+	m_openBlock.clear();
+	m_liveBytes = 0;
+	m_staleBytes = 0;
+}
+
+void DocumentStore::add(int id, const std::string& text)
+{
+	if (id < 0 || id >= static_cast<int>(m_docs.size()))
+		return;
+
+	Doc& doc = m_docs[id];
+	if (doc.block >= 0)
+	{
+		m_liveBytes -= doc.length;
+		m_staleBytes += doc.length;
+	}
+	else
+		m_docCount++;
+
+	// A text never straddles two blocks, so it is decoded with its block alone
+	if (!m_openBlock.empty() && m_openBlock.size() + text.size() > DOC_BLOCK_BYTES)
+		sealBlock();
+	doc.block = m_blocks.size();
+	doc.offset = m_openBlock.size();
+	doc.length = text.size();
+	m_openBlock += text;
+	m_liveBytes += text.size();
+	if (m_openBlock.size() >= DOC_BLOCK_BYTES)
+		sealBlock();
+}
+
+bool DocumentStore::get(int id, std::string& text) const
+{
+	text.clear();
+	if (id < 0 || id >= static_cast<int>(m_docs.size()) || m_docs[id].block < 0)
+		return false;
+
+	const Doc& doc = m_docs[id];
+	if (doc.block == static_cast<int>(m_blocks.size()))
+	{
+		text.assign(m_openBlock, doc.offset, doc.length);
+		return true;
+	}
+
+	const std::string& block = m_blocks[doc.block];
+	std::string data;
+	if (!decompressBlock(block.data(), block.data() + block.size(), m_blockRawBytes[doc.block], data) ||
+		doc.offset + doc.length > data.size())
+		return false;
+	text.assign(data, doc.offset, doc.length);
+	return true;
+}
+
+int DocumentStore::docCount() const
+{
+	return m_docCount;
+}
+
+size_t DocumentStore::sizeInBytes() const
+{
+	size_t bytes = sizeof(*this) + m_docs.capacity() * sizeof(Doc) + m_blocks.capacity() * sizeof(std::string) +
+		m_blockRawBytes.capacity() * sizeof(unsigned int) + m_openBlock.capacity();
+	for (unsigned int b = 0; b < m_blocks.size(); b++)
+		bytes += m_blocks[b].capacity();
+	return bytes;
+}
+
+void DocumentStore::sealBlock()
+{
+	if (m_openBlock.empty())
+		return;
+
+	m_blocks.push_back(std::string());
+	compressBlock(m_openBlock.data(), m_openBlock.size(), m_blocks.back());
+	m_blockRawBytes.push_back(m_openBlock.size());
+	m_openBlock.clear();
+}
+
+void DocumentStore::compact()
+{
+	DocumentStore fresh(m_docs.size());
+	std::string text;
+	for (unsigned int id = 0; id < m_docs.size(); id++)
+	{
+		if (get(id, text))
+			fresh.add(id, text);
+	}
+	*this = fresh;
+}
+
+bool DocumentStore::save(const std::string& filename)
+{
+	if (m_staleBytes > DOC_STALE_FRACTION * (m_liveBytes + m_staleBytes))
+		compact();
+
+	std::string buf(DOC_STORE_MAGIC, DOC_STORE_MAGIC_LENGTH);
+	putVarint(buf, m_docCount);
+	for (unsigned int id = 0; id < m_docs.size(); id++)
+	{
+		if (m_docs[id].block < 0)
+			continue;
+		putVarint(buf, id);
+		putVarint(buf, m_docs[id].block);
+		putVarint(buf, m_docs[id].offset);
+		putVarint(buf, m_docs[id].length);
+	}
+
+	// The block still being filled is written compressed like the others, but
+	// stays open here so saving often doesn't leave a trail of small blocks
+	std::string openBlock;
+	if (!m_openBlock.empty())
+		compressBlock(m_openBlock.data(), m_openBlock.size(), openBlock);
+	putVarint(buf, m_blocks.size() + (m_openBlock.empty() ? 0 : 1));
+	for (unsigned int b = 0; b < m_blocks.size(); b++)
+	{
+		putVarint(buf, m_blockRawBytes[b]);
+		putString(buf, m_blocks[b]);
+	}
+	if (!m_openBlock.empty())
+	{
+		putVarint(buf, m_openBlock.size());
+		putString(buf, openBlock);
+	}
+	return replaceWholeFile(filename, buf);
+}
+
+bool DocumentStore::load(const std::string& filename)
+{
+	clear();
+	std::string buf;
+	if (!readWholeFile(filename, buf))
+		return false;
+
+	const char* p = buf.data();
+	const char* end = p + buf.size();
+	bool valid = buf.compare(0, DOC_STORE_MAGIC_LENGTH, DOC_STORE_MAGIC) == 0;
+	if (valid)
+		p += DOC_STORE_MAGIC_LENGTH;
+
+	int docCount = 0;
+	valid = valid && getVarint(p, end, docCount) && docCount >= 0;
+	std::vector<int> ids;
+	for (int i = 0; i < docCount && valid; i++)
+	{
+		int id;
+		int block;
+		unsigned long long offset;
+		unsigned long long length;
+		valid = getVarint(p, end, id) && getVarint(p, end, block) && getVarint(p, end, offset) &&
+			getVarint(p, end, length) && id >= 0 && id < static_cast<int>(m_docs.size()) && block >= 0 &&
+			m_docs[id].block < 0;
+		if (!valid)
+			break;
+		m_docs[id].block = block;
+		m_docs[id].offset = static_cast<unsigned int>(offset);
+		m_docs[id].length = static_cast<unsigned int>(length);
+		ids.push_back(id);
+	}
+
+	int blockCount = 0;
+	valid = valid && getVarint(p, end, blockCount) && blockCount >= 0;
+	size_t rawTotal = 0;
+	for (int b = 0; b < blockCount && valid; b++)
+	{
+		int rawBytes = 0;
+		m_blocks.push_back(std::string());
+		valid = getVarint(p, end, rawBytes) && rawBytes >= 0 && getString(p, end, m_blocks.back());
+		m_blockRawBytes.push_back(rawBytes);
+		rawTotal += rawBytes;
+	}
+	valid = valid && p == end;
+
+	// Every text must lie inside its block
+	for (unsigned int i = 0; i < ids.size() && valid; i++)
+	{
+		const Doc& doc = m_docs[ids[i]];
+		valid = doc.block < blockCount &&
+			static_cast<unsigned long long>(doc.offset) + doc.length <= m_blockRawBytes[doc.block];
+		m_liveBytes += doc.length;
+	}
+
+	if (!valid)
+	{
+		std::cerr << "Error: corrupt document store " << filename << std::endl;
+		clear();
+		return false;
+	}
+	m_docCount = docCount;
+	m_staleBytes = rawTotal - m_liveBytes;
+	return true;
+}
+
+//******************** Block codec *******************************
+
+static unsigned int hashFour(const char* p)
+{
+	unsigned int v;
+	std::memcpy(&v, p, 4);
+	return (v * 2654435761U) >> (32 - BLOCK_HASH_BITS);
+}
+
+void compressBlock(const char* data, size_t size, std::string& compressed)
+{
+	compressed.clear();
+	std::vector<int> recent(1 << BLOCK_HASH_BITS, -1);  // last position of each hashed 4-byte string
+
+	size_t literalStart = 0;
+	size_t i = 0;
+	while (i + BLOCK_MIN_MATCH <= size)
+	{
+		unsigned int h = hashFour(data + i);
+		int candidate = recent[h];
+		recent[h] = static_cast<int>(i);
+		if (candidate < 0 || i - candidate > BLOCK_MAX_DISTANCE ||
+			std::memcmp(data + candidate, data + i, BLOCK_MIN_MATCH) != 0)
+		{
+			i++;
+			continue;
+		}
+
+		size_t length = BLOCK_MIN_MATCH;
+		while (i + length < size && data[candidate + length] == data[i + length])
+			length++;
+
+		putVarint(compressed, i - literalStart);
+		compressed.append(data + literalStart, i - literalStart);
+		putVarint(compressed, i - candidate);
+		putVarint(compressed, length - BLOCK_MIN_MATCH);
+		i += length;
+		literalStart = i;
+	}
+
+	putVarint(compressed, size - literalStart);
+	compressed.append(data + literalStart, size - literalStart);
+}
+
+bool decompressBlock(const char* p, const char* end, size_t rawBytes, std::string& data)
+{
+	data.clear();
+	for (;;)
+	{
+		unsigned long long literals;
+		if (!getVarint(p, end, literals) || literals > static_cast<unsigned long long>(end - p) ||
+			literals > rawBytes - data.size())
+			return false;
+		data.append(p, static_cast<size_t>(literals));
+		p += literals;
+		if (data.size() == rawBytes)
+			return p == end;
+
+		// The match may overlap the bytes it produces, so it is copied a byte at a time
+		unsigned long long distance;
+		unsigned long long length;
+		if (!getVarint(p, end, distance) || !getVarint(p, end, length) || distance == 0 || distance > data.size() ||
+			length + BLOCK_MIN_MATCH > rawBytes - data.size())
+			return false;
+		size_t from = data.size() - static_cast<size_t>(distance);
+		for (size_t k = 0; k < length + BLOCK_MIN_MATCH; k++)
+			data += data[from + k];
+	}
+}
+
+//******************** Visible text *******************************
+
+// Entities decoded by visibleText, and what they stand for
+static const char* const ENTITY_NAMES[] = { "amp", "lt", "gt", "quot", "apos", "nbsp" };
+static const char ENTITY_CHARACTERS[] = { '&', '<', '>', '"', '\'', ' ' };
+static const size_t ENTITY_MAX_LENGTH = 8;
+
+static bool decodeEntity(const std::string& html, size_t& i, char& c)
+{
+	size_t semicolon = html.find(';', i + 1);
+	if (semicolon == std::string::npos || semicolon - i > ENTITY_MAX_LENGTH)
+		return false;
+
+	std::string name = html.substr(i + 1, semicolon - i - 1);
+	if (name.size() > 1 && name[0] == '#')
+	{
+		bool hex = name[1] == 'x' || name[1] == 'X';
+		long code = std::strtol(name.c_str() + (hex ? 2 : 1), nullptr, hex ? 16 : 10);
+
+		// Only plain ASCII is worth keeping for snippets
+		c = code > 0 && code < 0x80 ? static_cast<char>(code) : ' ';
+		i = semicolon + 1;
+		return true;
+	}
+	for (unsigned int e = 0; e < sizeof(ENTITY_CHARACTERS); e++)
+	{
+		if (name == ENTITY_NAMES[e])
+		{
+			c = ENTITY_CHARACTERS[e];
+			i = semicolon + 1;
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string visibleText(const std::string& html)
+{
+	std::string lower = html;
+	strToLower(lower);
+
+	std::string text;
+	bool spacePending = false;
+	size_t i = 0;
+	while (i < html.size())
+	{
+		char c = html[i];
+
+		// Tags (and comments) separate words like a space does. Anything else
+		// starting with < is just text.
+		if (c == '<' && lower.compare(i, 4, "<!--") == 0)
+		{
+			size_t close = lower.find("-->", i + 4);
+			i = close == std::string::npos ? html.size() : close + 3;
+			spacePending = true;
+			continue;
+		}
+		if (c == '<' && i + 1 < html.size() && (std::isalpha(static_cast<unsigned char>(html[i + 1])) ||
+			html[i + 1] == '/' || html[i + 1] == '!'))
+		{
+			size_t close = html.find('>', i + 1);
+			if (close == std::string::npos)
+				break;
+			bool closing = html[i + 1] == '/';
+			size_t nameStart = i + (closing ? 2 : 1);
+			size_t nameEnd = nameStart;
+			while (nameEnd < close && isAlnum(html[nameEnd]))
+				nameEnd++;
+			std::string name = lower.substr(nameStart, nameEnd - nameStart);
+			i = close + 1;
+			spacePending = true;
+
+			// Scripts and styles aren't shown at all
+			if (!closing && (name == "script" || name == "style"))
+			{
+				size_t endTag = lower.find("</" + name, i);
+				i = endTag == std::string::npos ? html.size() : endTag;
+			}
+			continue;
+		}
+
+		if (std::isspace(static_cast<unsigned char>(c)))
+		{
+			spacePending = true;
+			i++;
+			continue;
+		}
+		if (c != '&' || !decodeEntity(html, i, c))
+			i++;
+		if (c == ' ')
+		{
+			spacePending = true;
+			continue;
+		}
+
+		if (spacePending && !text.empty())
+			text += ' ';
+		spacePending = false;
+		text += c;
+	}
+	return text;
+}
+
+//******************** Snippets *******************************
+
+struct SnippetToken
+{
+	size_t begin;
+	size_t end;
+	int word;  // which of the words it is, -1 for none
+};
+
+static int matchSnippetWord(const std::string& token, const std::vector<std::string>& words)
+{
+	for (unsigned int w = 0; w < words.size(); w++)
+	{
+		const std::string& word = words[w];
+		if (!word.empty() && word[word.size() - 1] == '*')
+		{
+			if (token.size() >= word.size() - 1 && token.compare(0, word.size() - 1, word, 0, word.size() - 1) == 0)
+				return w;
+		}
+		else if (token == word)
+			return w;
+	}
+	return -1;
+}
+
+std::string makeSnippet(const std::string& text, const std::vector<std::string>& words)
+{
+	std::vector<SnippetToken> tokens;
+	std::string token;
+	for (size_t i = 0; i < text.size();)
+	{
+		if (!isAlnum(text[i]))
+		{
+			i++;
+			continue;
+		}
+		SnippetToken t;
+		t.begin = i;
+		while (i < text.size() && isAlnum(text[i]))
+			i++;
+		t.end = i;
+		token.assign(text, t.begin, t.end - t.begin);
+		strToLower(token);
+		t.word = matchSnippetWord(token, words);
+		tokens.push_back(t);
+	}
+	if (tokens.empty())
+		return std::string();
+
+	// Slide a window of SNIPPET_WORDS tokens over the text and keep the one with
+	// the most different words in it, then the most occurrences, then the earliest
+	int window = std::min(SNIPPET_WORDS, static_cast<int>(tokens.size()));
+	std::vector<int> inWindow(words.size(), 0);
+	int distinct = 0;
+	int occurrences = 0;
+	int bestFirst = 0;
+	int bestDistinct = -1;
+	int bestOccurrences = -1;
+	for (int last = 0; last < static_cast<int>(tokens.size()); last++)
+	{
+		if (tokens[last].word >= 0)
+		{
+			distinct += inWindow[tokens[last].word]++ == 0;
+			occurrences++;
+		}
+		if (last >= window && tokens[last - window].word >= 0)
+		{
+			distinct -= --inWindow[tokens[last - window].word] == 0;
+			occurrences--;
+		}
+		if (last >= window - 1 && (distinct > bestDistinct || (distinct == bestDistinct && occurrences > bestOccurrences)))
+		{
+			bestFirst = last - window + 1;
+			bestDistinct = distinct;
+			bestOccurrences = occurrences;
+		}
+	}
+
+	// The first such window ends at its last match, so it is moved to have its
+	// matches in the middle instead
+	int firstMatch = bestFirst;
+	int lastMatch = bestFirst + window - 1;
+	while (firstMatch < lastMatch && tokens[firstMatch].word < 0)
+		firstMatch++;
+	while (lastMatch > firstMatch && tokens[lastMatch].word < 0)
+		lastMatch--;
+	bestFirst = (firstMatch + lastMatch + 1 - window) / 2;
+	bestFirst = std::max(0, std::min(bestFirst, static_cast<int>(tokens.size()) - window));
+
+	// The window's text as it is, between its first and last token
+	std::string snippet;
+	if (bestFirst > 0)
+		snippet += std::string(SNIPPET_ELLIPSIS) + " ";
+	int bestLast = bestFirst + window - 1;
+	for (int k = bestFirst; k <= bestLast; k++)
+	{
+		if (k > bestFirst)
+			snippet.append(text, tokens[k - 1].end, tokens[k].begin - tokens[k - 1].end);
+		if (tokens[k].word >= 0)
+			snippet += SNIPPET_HIGHLIGHT_BEGIN;
+		snippet.append(text, tokens[k].begin, tokens[k].end - tokens[k].begin);
+		if (tokens[k].word >= 0)
+			snippet += SNIPPET_HIGHLIGHT_END;
+	}
+	if (bestLast + 1 < static_cast<int>(tokens.size()))
+		snippet += std::string(" ") + SNIPPET_ELLIPSIS;
+	else
+		snippet.append(text, tokens[bestLast].end, std::string::npos);  // closing punctuation
+	return snippet;
+}
@@ -0,0 +1,98 @@
+#ifndef DOCUMENTSTORE_INCLUDED
+#define DOCUMENTSTORE_INCLUDED
+
+#include <string>
+#include <vector>
+
+// The visible text of every crawled page (see WebCrawler::enableDocumentStore),
+// kept so that search results can be shown with a snippet of the page around
+// the query words (see Searcher::getSnippet) without fetching it again.
+//
+// Texts are appended to a block, and a block that reaches DOC_BLOCK_BYTES is
+// compressed on its own (see compressBlock). Getting a page's text decodes
+// only the block it is in, which takes a few tens of microseconds. A page that
+// is crawled again gets its new text appended like any other; the old one is
+// left in its block, and the blocks are rewritten without such stale texts
+// when saved once they take up more than DOC_STALE_FRACTION of the bytes.
+//
+// File layout (all integers are varints, see BinaryIO.h):
+//
+//   "P4DOC1"
+//   docCount
+//   docCount * (id, block, offset, length)		where the text is in its block once decoded
+//   blockCount
+//   blockCount * (rawBytes, compressed)		compressed is length-prefixed
+
+static const char DOC_STORE_MAGIC[] = "P4DOC1";
+static const int DOC_STORE_MAGIC_LENGTH = 6;
+static const size_t DOC_BLOCK_BYTES = 16 * 1024;
+static const double DOC_STALE_FRACTION = 0.5;
+
+// Snippets are about this many words long; words of the query are put between
+// the two markers
+static const int SNIPPET_WORDS = 30;
+static const char SNIPPET_HIGHLIGHT_BEGIN[] = "[";
+static const char SNIPPET_HIGHLIGHT_END[] = "]";
+static const char SNIPPET_ELLIPSIS[] = "...";
+
+class DocumentStore
+{
+public:
+	DocumentStore(int idLimit);
+
+	void clear();
+	void add(int id, const std::string& text);  // replaces any text id had
+	bool get(int id, std::string& text) const;  // false if id has none
+	int docCount() const;
+	size_t sizeInBytes() const;
+
+	bool save(const std::string& filename);
+	bool load(const std::string& filename);  // false (and empty) if the file is missing or corrupt
+
+private:
+	struct Doc
+	{
+		int block;  // -1 for none; m_blocks.size() for the block still being filled
+		unsigned int offset;
+		unsigned int length;
+	};
+
+	void sealBlock();
+	void compact();
+
+	std::vector<Doc> m_docs;  // by id
+	int m_docCount;
+	std::vector<std::string> m_blocks;  // compressed
+	std::vector<unsigned int> m_blockRawBytes;
+	std::string m_openBlock;
+	size_t m_liveBytes;
+	size_t m_staleBytes;
+};
+
+// Block codec, an LZ77 variant in the spirit of LZ4 (there are no outside
+// libraries to lean on). A block is a series of sequences, each
+//
+//   literalCount, literals, [matchDistance, matchLength - BLOCK_MIN_MATCH]
+//
+// where the match, which copies matchLength bytes starting matchDistance bytes
+// back in the output, is left out of the last sequence only. Repeated strings
+// of at least BLOCK_MIN_MATCH bytes are found through a hash table of the
+// positions of earlier 4-byte strings, so compressing takes one pass.
+static const int BLOCK_MIN_MATCH = 4;
+static const int BLOCK_HASH_BITS = 12;
+static const size_t BLOCK_MAX_DISTANCE = 65535;
+
+void compressBlock(const char* data, size_t size, std::string& compressed);
+bool decompressBlock(const char* p, const char* end, size_t rawBytes, std::string& data);
+
+// The text a browser would show for an HTML page: tags, comments, scripts and
+// styles dropped, the common entities decoded and runs of white space made
+// into single spaces. Text that isn't HTML comes back as it is, bar the spaces.
+std::string visibleText(const std::string& html);
+
+// About SNIPPET_WORDS words of text around where most of the given words occur
+// close together, with every occurrence highlighted. words are lower case; a
+// word ending in * stands for every word that starts with the rest of it.
+std::string makeSnippet(const std::string& text, const std::vector<std::string>& words);
+
+#endif // DOCUMENTSTORE_INCLUDED
@@ -0,0 +1,191 @@
+#include "FrequentTerms.h"
+#include "BinaryIO.h"
+#include <algorithm>
+
+static const int BITMAP_CHUNK_IDS = 1 << BITMAP_CHUNK_BITS;
+static const int BITMAP_WORD_BITS = 64;
+
+//******************** DocBitmap functions *******************************
+
+DocBitmap::DocBitmap()
+{
+	m_cardinality = 0;
+}
+
+void DocBitmap::add(int id)
+{
+	int key = id >> BITMAP_CHUNK_BITS;
+	unsigned short low = static_cast<unsigned short>(id & (BITMAP_CHUNK_IDS - 1));
+	if (m_chunks.empty() || m_chunks.back().key != key)
+	{
+		Chunk chunk;
+		chunk.key = key;
+		chunk.cardinality = 0;
+		m_chunks.push_back(chunk);
+	}
+
+	Chunk& chunk = m_chunks.back();
+	if (chunk.bits.empty())
+	{
+		if (!chunk.array.empty() && chunk.array.back() == low)
+			return;
+		if (chunk.cardinality < BITMAP_ARRAY_MAX_IDS)
+		{
+			chunk.array.push_back(low);
+			chunk.cardinality++;
+			m_cardinality++;
+			return;
+		}
+
+		// Past this many ids the bitset is the smaller of the two
+		chunk.bits.assign(BITMAP_CHUNK_IDS / BITMAP_WORD_BITS, 0);
+		for (unsigned int i = 0; i < chunk.array.size(); i++)
+			chunk.bits[chunk.array[i] / BITMAP_WORD_BITS] |= 1ULL << (chunk.array[i] % BITMAP_WORD_BITS);
+		std::vector<unsigned short>().swap(chunk.array);
+	}
+
+	unsigned long long bit = 1ULL << (low % BITMAP_WORD_BITS);
+	if ((chunk.bits[low / BITMAP_WORD_BITS] & bit) == 0)
+	{
+		chunk.bits[low / BITMAP_WORD_BITS] |= bit;
+		chunk.cardinality++;
+		m_cardinality++;
+	}
+}
+
+bool DocBitmap::contains(int id) const
+{
+	int key = id >> BITMAP_CHUNK_BITS;
+	unsigned short low = static_cast<unsigned short>(id & (BITMAP_CHUNK_IDS - 1));
+
+	// Ids of an index fit in one chunk or a few, so a scan beats a search
+	for (unsigned int c = 0; c < m_chunks.size(); c++)
+	{
+		const Chunk& chunk = m_chunks[c];
+		if (chunk.key != key)
+			continue;
+		if (!chunk.bits.empty())
+			return (chunk.bits[low / BITMAP_WORD_BITS] >> (low % BITMAP_WORD_BITS)) & 1;
+		return std::binary_search(chunk.array.begin(), chunk.array.end(), low);
+	}
+	return false;
+}
+
+int DocBitmap::cardinality() const
+{
+	return m_cardinality;
+}
+
+void DocBitmap::getIds(std::vector<int>& ids) const
+{
+	ids.clear();
+	ids.reserve(m_cardinality);
+	for (unsigned int c = 0; c < m_chunks.size(); c++)
+	{
+		const Chunk& chunk = m_chunks[c];
+		int high = chunk.key << BITMAP_CHUNK_BITS;
+		if (chunk.bits.empty())
+		{
+			for (unsigned int i = 0; i < chunk.array.size(); i++)
+				ids.push_back(high | chunk.array[i]);
+			continue;
+		}
+		for (unsigned int w = 0; w < chunk.bits.size(); w++)
+		{
+			for (unsigned long long word = chunk.bits[w]; word != 0; word &= word - 1)
+			{
+				int bit = 0;
+				while (((word >> bit) & 1) == 0)
+					bit++;
+				ids.push_back(high | (w * BITMAP_WORD_BITS + bit));
+			}
+		}
+	}
+}
+
+size_t DocBitmap::sizeInBytes() const
+{
+	size_t bytes = m_chunks.capacity() * sizeof(Chunk);
+	for (unsigned int c = 0; c < m_chunks.size(); c++)
+		bytes += m_chunks[c].array.capacity() * sizeof(unsigned short) + m_chunks[c].bits.capacity() * sizeof(unsigned long long);
+	return bytes;
+}
+
+//******************** FrequentTermTier functions *******************************
+
+void FrequentTermTier::clear()
+{
+	m_terms.clear();
+	m_bitmaps.clear();
+	m_counts.clear();
+}
+
+bool FrequentTermTier::empty() const
+{
+	return m_terms.empty();
+}
+
+int FrequentTermTier::termCount() const
+{
+	return m_terms.size();
+}
+
+void FrequentTermTier::add(const std::string& term, const std::vector<int>& ids, const std::vector<int>& counts)
+{
+	m_terms.push_back(term);
+	m_bitmaps.push_back(DocBitmap());
+	m_counts.push_back(std::string());
+	for (unsigned int i = 0; i < ids.size(); i++)
+	{
+		m_bitmaps.back().add(ids[i]);
+		putVarint(m_counts.back(), counts[i]);
+	}
+}
+
+const DocBitmap* FrequentTermTier::find(const std::string& term) const
+{
+	std::vector<std::string>::const_iterator it = std::lower_bound(m_terms.begin(), m_terms.end(), term);
+	if (it == m_terms.end() || *it != term)
+		return nullptr;
+	return &m_bitmaps[it - m_terms.begin()];
+}
+
+bool FrequentTermTier::getPostings(const std::string& term, std::vector<int>& ids, std::vector<int>& counts) const
+{
+	std::vector<std::string>::const_iterator it = std::lower_bound(m_terms.begin(), m_terms.end(), term);
+	if (it == m_terms.end() || *it != term)
+		return false;
+
+	int t = it - m_terms.begin();
+	m_bitmaps[t].getIds(ids);
+	counts.resize(ids.size());
+	const char* p = m_counts[t].data();
+	const char* end = p + m_counts[t].size();
+	for (unsigned int i = 0; i < ids.size(); i++)
+	{
+		if (!getVarint(p, end, counts[i]))
+			counts[i] = 1;
+	}
+	return true;
+}
+
+void FrequentTermTier::getTermsWithPrefix(const std::string& prefix, std::vector<std::string>& terms) const
+{
+	for (std::vector<std::string>::const_iterator it = std::lower_bound(m_terms.begin(), m_terms.end(), prefix);
+		it != m_terms.end() && it->compare(0, prefix.size(), prefix) == 0; ++it)
+		terms.push_back(*it);
+}
+
+void FrequentTermTier::getTerms(std::vector<std::string>& terms) const
+{
+	terms.insert(terms.end(), m_terms.begin(), m_terms.end());
+}
+
+size_t FrequentTermTier::sizeInBytes() const
+{
+	size_t bytes = (m_terms.capacity() + m_counts.capacity()) * sizeof(std::string) +
+		m_bitmaps.capacity() * sizeof(DocBitmap);
+	for (unsigned int i = 0; i < m_terms.size(); i++)
+		bytes += m_terms[i].capacity() + m_bitmaps[i].sizeInBytes() + m_counts[i].capacity();
+	return bytes;
+}
@@ -0,0 +1,72 @@
+#ifndef FREQUENTTERMS_INCLUDED
+#define FREQUENTTERMS_INCLUDED
+
+#include <string>
+#include <vector>
+
+// Words like "the" or "div" are on nearly every page, so their posting lists
+// are about as long as the index and reading one costs as much as the rest of
+// a query put together. Once an index is frozen for searching (see
+// Indexer::freeze), the words set apart by Indexer::setFrequentTerms are kept
+// here instead, as a bitmap of the pages they are on with the count on each
+// page alongside, as varints in the bitmap's order. Searcher then uses them to
+// check the pages its other words found rather than to find pages (see
+// Searcher::setFrequentTerms).
+
+// Unless it is a stopword, a word is only set apart once it is on at least
+// this many pages; shorter lists are cheap enough to read
+static const int FREQUENT_TERM_MIN_PAGES = 32;
+
+// A set of page ids, compressed the way Roaring bitmaps are: ids are grouped
+// by their high 16 bits, and each group is kept as a sorted array of its low
+// 16 bits while it has at most BITMAP_ARRAY_MAX_IDS of them and as a 65536 bit
+// bitset once it has more, whichever is smaller.
+static const int BITMAP_CHUNK_BITS = 16;
+static const int BITMAP_ARRAY_MAX_IDS = 4096;
+
+class DocBitmap
+{
+public:
+	DocBitmap();
+
+	void add(int id);  // ids must be added in increasing order
+	bool contains(int id) const;
+	int cardinality() const;
+	void getIds(std::vector<int>& ids) const;  // in increasing order
+	size_t sizeInBytes() const;
+
+private:
+	struct Chunk
+	{
+		int key;  // the high bits its ids share
+		int cardinality;
+		std::vector<unsigned short> array;  // while cardinality <= BITMAP_ARRAY_MAX_IDS
+		std::vector<unsigned long long> bits;  // after that
+	};
+
+	std::vector<Chunk> m_chunks;  // by key
+	int m_cardinality;
+};
+
+// The bitmaps and counts of the words set apart, sorted by word
+class FrequentTermTier
+{
+public:
+	void clear();
+	bool empty() const;
+	int termCount() const;
+	// Terms in increasing order, and each term's ids too, counts[i] being its count on page ids[i]
+	void add(const std::string& term, const std::vector<int>& ids, const std::vector<int>& counts);
+	const DocBitmap* find(const std::string& term) const;  // null if term isn't here
+	bool getPostings(const std::string& term, std::vector<int>& ids, std::vector<int>& counts) const;  // false if it isn't
+	void getTermsWithPrefix(const std::string& prefix, std::vector<std::string>& terms) const;  // appended
+	void getTerms(std::vector<std::string>& terms) const;  // appended
+	size_t sizeInBytes() const;
+
+private:
+	std::vector<std::string> m_terms;
+	std::vector<DocBitmap> m_bitmaps;
+	std::vector<std::string> m_counts;  // varints, in the order of each bitmap's ids
+};
+
+#endif // FREQUENTTERMS_INCLUDED
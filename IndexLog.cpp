@@ -0,0 +1,190 @@
+#include "IndexLog.h"
+#include "BinaryIO.h"
+#include "provided.h"
+#include <vector>
+
+//******************** IndexLog functions *******************************
+
+IndexLog::IndexLog()
+{
+	m_bytes = 0;
+}
+
+bool IndexLog::open(const std::string& filename)
+{
+	close();
+
+	std::ifstream existing(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	m_bytes = existing ? static_cast<unsigned long long>(existing.tellg()) : 0;
+	existing.close();
+
+	m_stream.open(filename.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+	if (!m_stream)
+	{
+		std::cerr << "Error: Cannot append to " << filename << std::endl;
+		return false;
+	}
+	if (m_bytes == 0)
+	{
+		m_stream.write(LOG_MAGIC, LOG_MAGIC_LENGTH);
+		m_stream.flush();
+		m_bytes = LOG_MAGIC_LENGTH;
+	}
+	return static_cast<bool>(m_stream);
+}
+
+void IndexLog::close()
+{
+	if (m_stream.is_open())
+		m_stream.close();
+	m_stream.clear();
+	m_bytes = 0;
+}
+
+bool IndexLog::isOpen() const
+{
+	return m_stream.is_open();
+}
+
+bool IndexLog::append(char tag, const std::string& body)
+{
+	m_record.clear();
+	m_record += tag;
+	putVarint(m_record, body.size());
+	m_record += body;
+	putFixed64(m_record, contentFingerprint(body));
+
+	// Flushed right away, so the record survives the process even if it
+	// never gets to save again
+	m_stream.write(m_record.data(), m_record.size());
+	m_stream.flush();
+	m_bytes += m_record.size();
+	return static_cast<bool>(m_stream);
+}
+
+unsigned long long IndexLog::bytes() const
+{
+	return m_bytes;
+}
+
+//******************** IndexLogReader functions *******************************
+
+IndexLogReader::IndexLogReader(const std::string& contents)
+	: m_contents(contents)
+{
+	m_p = contents.data();
+	m_end = m_p + contents.size();
+	m_valid = contents.compare(0, LOG_MAGIC_LENGTH, LOG_MAGIC) == 0;
+	m_torn = false;
+	if (m_valid)
+		m_p += LOG_MAGIC_LENGTH;
+}
+
+bool IndexLogReader::valid() const
+{
+	return m_valid;
+}
+
+bool IndexLogReader::next(char& tag, const char*& body, const char*& bodyEnd)
+{
+	if (!m_valid || m_torn || m_p == m_end)
+		return false;
+
+	const char* p = m_p;
+	tag = *p++;
+	unsigned long long length;
+	unsigned long long checksum;
+	if (!getVarint(p, m_end, length) || length > static_cast<unsigned long long>(m_end - p))
+	{
+		m_torn = true;
+		return false;
+	}
+	body = p;
+	bodyEnd = p + length;
+	p = bodyEnd;
+	if (!getFixed64(p, m_end, checksum) || checksum != contentFingerprint(std::string(body, bodyEnd)))
+	{
+		m_torn = true;
+		return false;
+	}
+
+	m_p = p;
+	return true;
+}
+
+size_t IndexLogReader::goodBytes() const
+{
+	return m_p - m_contents.data();
+}
+
+bool IndexLogReader::torn() const
+{
+	return m_torn;
+}
+
+//******************** Word bags *******************************
+
+void encodeWordBag(WordBag& wb, std::string& buf)
+{
+	std::string words;
+	int wordCount = 0;
+	int tokenCount = 0;
+	std::string word;
+	std::vector<int> positions;
+	for (bool more = wb.getFirstWord(word, positions); more; more = wb.getNextWord(word, positions))
+	{
+		putString(words, word);
+		putVarint(words, positions.size());
+		int last = 0;
+		for (unsigned int i = 0; i < positions.size(); i++)
+		{
+			putVarint(words, positions[i] - last);
+			last = positions[i];
+		}
+		tokenCount += positions.size();
+		wordCount++;
+	}
+
+	putVarint(buf, tokenCount);
+	putVarint(buf, wordCount);
+	buf += words;
+}
+
+bool decodeWordBag(const char*& p, const char* end, std::string& text)
+{
+	int tokenCount;
+	int wordCount;
+	if (!getVarint(p, end, tokenCount) || !getVarint(p, end, wordCount) || tokenCount < 0 ||
+		tokenCount > end - p)
+		return false;
+
+	// Every position of a bag holds exactly one word
+	std::vector<std::string> tokens(tokenCount);
+	std::string word;
+	for (int w = 0; w < wordCount; w++)
+	{
+		int positionCount;
+		if (!getString(p, end, word) || !getVarint(p, end, positionCount))
+			return false;
+		int position = 0;
+		for (int i = 0; i < positionCount; i++)
+		{
+			int gap;
+			if (!getVarint(p, end, gap))
+				return false;
+			position += gap;
+			if (position < 0 || position >= tokenCount)
+				return false;
+			tokens[position] = word;
+		}
+	}
+
+	text.clear();
+	for (int t = 0; t < tokenCount; t++)
+	{
+		if (t > 0)
+			text += ' ';
+		text += tokens[t];
+	}
+	return true;
+}
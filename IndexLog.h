@@ -0,0 +1,100 @@
+#ifndef INDEXLOG_INCLUDED
+#define INDEXLOG_INCLUDED
+
+#include <string>
+#include <fstream>
+
+class WordBag;
+
+// Write-ahead log of the changes made to a plain index since it was last saved
+// in full (see IndexerImpl::save). Each incorporate, replace or remove appends
+// one record and hands it to the operating system before returning, so a crash
+// of the process loses nothing that was incorporated; saving again under the
+// same name has nothing left to write. Loading replays the log on top of the
+// saved index without writing anything, and a checkpoint folds it back into
+// the saved files in the background (see IndexerImpl::startCheckpoint).
+//
+// Whether a page gets in depends on the near-duplicate policy it was
+// incorporated under, so that is logged too: each file records the policy
+// before its first page and again whenever it changes, and replay incorporates
+// the pages under it rather than under whatever the loading Indexer has set.
+//
+// File layout:
+//
+//   "P4LOG1"
+//   records, each: tag byte, varint bodyLength, body, fixed64 checksum of the body
+//
+//   LOG_INCORPORATE		url, bag
+//   LOG_FINGERPRINT		url, fixed64 fingerprint, bag		(incorporate with a fingerprint)
+//   LOG_REPLACE			url, bag
+//   LOG_REMOVE				url
+//   LOG_BATCH				pageCount, pageCount * (url, contents)	(pages incorporateAll took)
+//   LOG_POLICY				policy						(NearDuplicatePolicy of the records after it)
+//
+//   bag: tokenCount, wordCount, wordCount * (word, positionCount, positionCount * positionGap)
+//
+// A record that is cut short or fails its checksum ends the log: it can only
+// be the last one, torn by a crash while it was being written.
+
+static const char LOG_MAGIC[] = "P4LOG1";
+static const int LOG_MAGIC_LENGTH = 6;
+
+static const char LOG_INCORPORATE = 'I';
+static const char LOG_FINGERPRINT = 'F';
+static const char LOG_REPLACE = 'R';
+static const char LOG_REMOVE = 'D';
+static const char LOG_BATCH = 'B';
+static const char LOG_POLICY = 'P';
+
+// Once the log holds at least this many bytes, and more than the in-memory
+// index it rebuilds, a checkpoint is started
+static const unsigned long long LOG_CHECKPOINT_MIN_BYTES = 16 * 1024 * 1024;
+
+class IndexLog
+{
+public:
+	IndexLog();
+
+	// Appends to filename, creating it if need be
+	bool open(const std::string& filename);
+	void close();
+	bool isOpen() const;
+
+	bool append(char tag, const std::string& body);
+	unsigned long long bytes() const;  // of the whole file
+
+private:
+	std::ofstream m_stream;
+	std::string m_record;
+	unsigned long long m_bytes;
+
+	IndexLog(const IndexLog&);
+	IndexLog& operator=(const IndexLog&);
+};
+
+// Walks the records of a log file read into memory
+class IndexLogReader
+{
+public:
+	IndexLogReader(const std::string& contents);
+
+	bool valid() const;  // false if it isn't a log file at all
+	bool next(char& tag, const char*& body, const char*& bodyEnd);
+	size_t goodBytes() const;  // up to the end of the last whole record read
+	bool torn() const;  // whether next stopped at a damaged record rather than the end
+
+private:
+	const std::string& m_contents;
+	const char* m_p;
+	const char* m_end;
+	bool m_valid;
+	bool m_torn;
+};
+
+// A bag is logged as its words' positions. decodeWordBag gives back text that
+// tokenizes to exactly the same bag: the words, in position order, separated
+// by spaces.
+void encodeWordBag(WordBag& wb, std::string& buf);
+bool decodeWordBag(const char*& p, const char* end, std::string& text);
+
+#endif // INDEXLOG_INCLUDED
@@ -2,155 +2,3197 @@
 
 
 IndexerImpl::IndexerImpl()
+	: m_urls(HASH_TABLE_SIZE), m_docLengths(HASH_TABLE_SIZE), m_positions(HASH_TABLE_SIZE)
 {
 	m_hashedMapCount = 0;
+	m_docPostingsBuilt = false;
+	m_nearDuplicatePolicy = INDEX_NEAR_DUPLICATES;
+	m_dedupStats.pagesChecked = 0;
+	m_dedupStats.nearDuplicatesFound = 0;
+	m_dedupStats.pagesSkipped = 0;
+	m_dedupStats.pagesClustered = 0;
+	m_deleted.assign(HASH_TABLE_SIZE, false);
+	m_deletedCount = 0;
+	m_segmentFlushDocs = SEGMENT_FLUSH_DOCS;
+	m_memoryDocs = 0;
+	m_memoryBytes = 0;
+	m_memoryTermCount = 0;
+	m_memoryTermFilterCapacity = MEMORY_TERM_FILTER_MIN_TERMS;
+	m_memoryTermFilter.reset(m_memoryTermFilterCapacity, m_bloomOptions);
+	m_positionsEnabled = false;
+	m_positionsChanged = false;
+	m_nextGeneration = 1;
+	m_docOwner.assign(HASH_TABLE_SIZE, NO_SEGMENT);
+	m_frequentTermFraction = 0;
+	m_frequentTermsOwner = NO_SEGMENT;
+	m_stopMerging = false;
+	m_snapshotsEnabled = false;
+	m_changesSincePublish = 0;
+	m_republishNeeded = false;
+	m_publishedGeneration.assign(HASH_TABLE_SIZE, NO_SEGMENT);
+	m_nextPublishedGeneration = NO_SEGMENT - 1;
+	m_unpublishedAddition.assign(HASH_TABLE_SIZE, -1);
+	m_unpublishedAdditions = 0;
+	m_publishAll = true;
+	m_checkpointRunning = false;
+	m_loggedPolicy = -1;
+	m_logRecovered = true;
 }
 
+IndexerImpl::~IndexerImpl()
+{
+	waitForCheckpoint();
+	stopMerging();
+}
+
+// The public changes are applied by the ...Page methods below, which call each
+// other rather than these, so each change is logged once, as it was asked for.
+// A near-duplicate that was clustered instead of indexed still changed the
+// index; a page that was turned away for any other reason didn't, and isn't logged.
 bool IndexerImpl::incorporate(std::string url, WordBag& wb)
 {
-	// First check if url has been previously incorporated and return false if it has
-	int convertedId = urlToId(url);
-	bool existingBucketCheck = m_hashTable.search(convertedId, url);
+	int clustered = m_dedupStats.pagesClustered;
+	bool incorporated = incorporatePage(url, wb);
+	if (incorporated || m_dedupStats.pagesClustered != clustered)
+		logPage(LOG_INCORPORATE, url, wb, 0);
+	return incorporated;
+}
+
+bool IndexerImpl::incorporate(std::string url, WordBag& wb, unsigned long long fingerprint)
+{
+	int clustered = m_dedupStats.pagesClustered;
+	bool incorporated = incorporatePage(url, wb, fingerprint);
+	if (incorporated || m_dedupStats.pagesClustered != clustered)
+		logPage(LOG_FINGERPRINT, url, wb, fingerprint);
+	return incorporated;
+}
+
+bool IndexerImpl::remove(std::string url)
+{
+	if (!removePage(url))
+		return false;
+
+	if (!m_logBase.empty())
+	{
+		std::string body;
+		putString(body, url);
+		logRecord(LOG_REMOVE, body);
+	}
+	return true;
+}
+
+bool IndexerImpl::replace(std::string url, WordBag& wb)
+{
+	int clustered = m_dedupStats.pagesClustered;
+	bool replaced = replacePage(url, wb);
+	if (replaced || m_dedupStats.pagesClustered != clustered)
+		logPage(LOG_REPLACE, url, wb, 0);
+	return replaced;
+}
+
+bool IndexerImpl::incorporatePage(std::string url, WordBag& wb)
+{
+	METRIC_TIMER(HISTOGRAM_INCORPORATE);
+
+	// First check if url has been previously incorporated and return false if it has
+	int convertedId = urlToId(url);
+	std::string storedUrl;
+	bool existingBucketCheck = m_urls.findUrl(convertedId, storedUrl);
+
+	// A removed url whose postings haven't been compacted away yet simply comes back
+	if (existingBucketCheck && storedUrl == url && m_deleted[convertedId])
+		return replacePage(url, wb);
+
+	if (existingBucketCheck == true)
+		return false;
+
+	// Near-duplicates of an indexed page may be turned away before the index is touched
+	unsigned long long signature;
+	if (!admitNearDuplicate(url, wb, signature))
+		return false;
+
+	// m_urls is used for quick access to hashed url values in O(1) time
+	addUrl(url, convertedId);
+
+	// Update the index. If we reach this point, then the url has not previously been incorporated
+	addPostings(convertedId, wb);
+	m_simHashes.insert(convertedId, signature);
+	maintainCompaction();
+	maintainSegments();
+	maintainSnapshots();
+	METRIC_ADD(COUNTER_PAGES_INCORPORATED, 1);
+
+	return true;
+}
+
+bool IndexerImpl::incorporatePage(std::string url, WordBag& wb, unsigned long long fingerprint)
+{
+	int convertedId = urlToId(url);
+	std::string storedUrl;
+
+	if (!m_urls.findUrl(convertedId, storedUrl))
+	{
+		if (!incorporatePage(url, wb))
+			return false;
+		m_fingerprints.associate(convertedId, fingerprint);
+		return true;
+	}
+
+	// A different url that hashes to the same id is still rejected, as above
+	if (storedUrl != url)
+		return false;
+
+	// Same page content as last time: nothing to do (a removed page has no fingerprint)
+	unsigned long long* oldFingerprint = m_fingerprints.find(convertedId);
+	if (oldFingerprint != nullptr && *oldFingerprint == fingerprint)
+		return false;
+
+	// The page changed, so its old postings are replaced by the new ones
+	replacePage(url, wb);
+	m_fingerprints.associate(convertedId, fingerprint);
+
+	return true;
+}
+
+bool IndexerImpl::isUnchanged(std::string url, unsigned long long fingerprint)
+{
+	int convertedId = urlToId(url);
+	std::string storedUrl;
+	if (!m_urls.findUrl(convertedId, storedUrl) || storedUrl != url)
+		return false;
+
+	unsigned long long* oldFingerprint = m_fingerprints.find(convertedId);
+	return oldFingerprint != nullptr && *oldFingerprint == fingerprint;
+}
+
+void IndexerImpl::setNearDuplicatePolicy(NearDuplicatePolicy policy)
+{
+	m_nearDuplicatePolicy = policy;
+}
+
+DedupStats IndexerImpl::getDedupStats() const
+{
+	return m_dedupStats;
+}
+
+std::vector<std::string> IndexerImpl::getNearDuplicates(std::string url)
+{
+	int convertedId = urlToId(url);
+	std::string storedUrl;
+	if (!m_urls.findUrl(convertedId, storedUrl) || storedUrl != url)
+		return std::vector<std::string>();
+
+	std::vector<std::string>* members = m_clusters.find(convertedId);
+	if (members == nullptr)
+		return std::vector<std::string>();
+	return *members;
+}
+
+bool IndexerImpl::removePage(std::string url)
+{
+	int id;
+	if (!findIncorporated(url, id) || m_deleted[id])
+		return false;
+
+	// The url's postings are only marked; see maintainCompaction
+	m_deleted[id] = true;
+	m_deletedCount++;
+
+	m_fingerprints.remove(id);
+	m_simHashes.erase(id);
+	m_clusters.remove(id);
+	m_docLengths.set(id, 0);
+	if (m_positionsEnabled)
+	{
+		m_positions.removeDoc(id);
+		m_positionsChanged = true;
+	}
+
+	maintainCompaction();
+	maintainSnapshots();
+	return true;
+}
+
+bool IndexerImpl::replacePage(std::string url, WordBag& wb)
+{
+	int id;
+	if (!findIncorporated(url, id))
+		return incorporatePage(url, wb);
+
+	// The new version keeps the url's id, so its old postings can't just be marked
+	// deleted like in remove; they are taken out of their posting lists right away.
+	removePostings(id);
+	if (m_deleted[id])
+	{
+		m_deleted[id] = false;
+		m_deletedCount--;
+
+		// It must not be forgotten by the compaction pass in progress
+		std::vector<int>::iterator it = std::find(m_compactingIds.begin(), m_compactingIds.end(), id);
+		if (it != m_compactingIds.end())
+			m_compactingIds.erase(it);
+	}
+
+	addPostings(id, wb);
+	m_simHashes.insert(id, simHash(wb));
+
+	// The WordBag doesn't tell us what the page bytes were
+	m_fingerprints.remove(id);
+
+	maintainCompaction();
+	maintainSegments();
+	maintainSnapshots();
+	return true;
+}
+
+void IndexerImpl::compact()
+{
+	// Finish the pass in progress, then run a full pass over whatever is still deleted
+	while (!m_compactingIds.empty())
+		compactStep(COMPACTION_STEP_LISTS);
+
+	if (m_deletedCount > 0)
+	{
+		startCompaction();
+		while (!m_compactingIds.empty())
+			compactStep(COMPACTION_STEP_LISTS);
+	}
+}
+
+std::vector<UrlCount> IndexerImpl::getUrlCounts(std::string word)
+{
+	// Passed in word is NOT case sensitive, and since all previously associated words have been converted to
+	// lower case, the passed in word here must also be converted to lower case.
+	strToLower(word);
+	std::vector<HashedUrlCount> postings;
+	getLivePostings(word, postings);
+
+	// Convert HashedUrlCount to UrlCount
+	std::vector<UrlCount> tempVector;
+	UrlCount copiedVector;
+	for (unsigned int i = 0; i < postings.size(); i++)
+	{
+		copiedVector.count = postings[i].count;
+		copiedVector.url = idToUrl(postings[i].hashedUrl);
+		tempVector.push_back(copiedVector);
+	}
+
+	return tempVector;
+}
+
+std::vector<UrlScore> IndexerImpl::getUrlScores(std::string word, RankingMode ranking)
+{
+	strToLower(word);
+	std::vector<HashedUrlCount> postings;
+	getLivePostings(word, postings);
+	std::vector<float> scores;
+	scoreHashedPostings(postings, m_docLengths, ranking, scores);
+
+	std::vector<UrlScore> urlScores(postings.size());
+	for (unsigned int i = 0; i < postings.size(); i++)
+	{
+		urlScores[i].url = idToUrl(postings[i].hashedUrl);
+		urlScores[i].score = scores[i];
+	}
+	return urlScores;
+}
+
+std::vector<UrlScore> IndexerImpl::scoreUrlCounts(const std::vector<UrlCount>& urlCounts, RankingMode ranking)
+{
+	// The counts are treated like the postings of one term (a phrase, say)
+	std::vector<HashedUrlCount> postings(urlCounts.size());
+	for (unsigned int i = 0; i < urlCounts.size(); i++)
+	{
+		postings[i].hashedUrl = urlToId(urlCounts[i].url);
+		postings[i].count = urlCounts[i].count;
+	}
+	std::vector<float> scores;
+	scoreHashedPostings(postings, m_docLengths, ranking, scores);
+
+	std::vector<UrlScore> urlScores(urlCounts.size());
+	for (unsigned int i = 0; i < urlCounts.size(); i++)
+	{
+		urlScores[i].url = urlCounts[i].url;
+		urlScores[i].score = scores[i];
+	}
+	return urlScores;
+}
+
+std::vector<UrlPositions> IndexerImpl::getUrlPositions(std::string word)
+{
+	strToLower(word);
+	std::vector<DocPositions> docs;
+	m_positions.getPositions(word, docs);
+
+	// Removed pages have already been dropped from m_positions
+	std::vector<UrlPositions> urlPositions(docs.size());
+	for (unsigned int i = 0; i < docs.size(); i++)
+	{
+		urlPositions[i].url = idToUrl(docs[i].id);
+		urlPositions[i].positions.swap(docs[i].positions);
+	}
+	return urlPositions;
+}
+
+std::vector<std::string> IndexerImpl::getTermsWithPrefix(std::string prefix)
+{
+	strToLower(prefix);
+
+	// The in-memory index has no order to exploit, but once frozen it is small
+	std::vector<std::string> terms;
+	std::string word;
+	for (std::vector<HashedUrlCount>* postings = m_indexHashed.getFirst(word); postings != nullptr;
+		postings = m_indexHashed.getNext(word))
+	{
+		if (word.compare(0, prefix.size(), prefix) == 0)
+			terms.push_back(word);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		for (unsigned int s = 0; s < m_segments.size(); s++)
+			m_segments[s]->getTermsWithPrefix(prefix, terms);
+	}
+	m_frequentTerms.getTermsWithPrefix(prefix, terms);
+
+	std::sort(terms.begin(), terms.end());
+	terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+	return terms;
+}
+
+// Upper bound on the number of postings a lookup of word returns, from the
+// posting list lengths alone: postings of removed or replaced pages that are
+// still in the lists are counted too
+int IndexerImpl::estimatePostings(std::string word)
+{
+	strToLower(word);
+
+	int postingCount = 0;
+	std::vector<HashedUrlCount>* temp = nullptr;
+	if (m_memoryTermFilter.mightContain(word))
+		temp = m_indexHashed.find(word);
+	if (temp != nullptr)
+		postingCount += temp->size();
+
+	const DocBitmap* pages = m_frequentTerms.find(word);
+	if (pages != nullptr)
+		postingCount += pages->cardinality();
+
+	std::lock_guard<std::mutex> lock(m_segmentMutex);
+	for (unsigned int s = 0; s < m_segments.size(); s++)
+		postingCount += m_segments[s]->getPostingCount(word);
+	return postingCount;
+}
+
+static void addTreeStats(IndexMemoryStats& stats, const std::string& name, const MapMemoryStats& map)
+{
+	StructureMemoryStats s;
+	s.name = name;
+	s.entries = map.nodes;
+	s.nodeBytes = map.nodeBytes;
+	s.keyBytes = map.keyBytes;
+	s.valueBytes = map.valueBytes;
+	s.overheadBytes = map.overheadBytes;
+	s.totalBytes = map.totalBytes();
+	s.treeHeight = map.height;
+	s.balancedHeight = map.balancedHeight();
+	s.averageDepth = map.averageDepth();
+	stats.structures.push_back(s);
+	stats.totalBytes += s.totalBytes;
+}
+
+// For structures that aren't trees; blocks is the number of heap blocks they're in
+static void addFlatStats(IndexMemoryStats& stats, const std::string& name, long long entries, size_t bytes,
+	size_t blocks)
+{
+	StructureMemoryStats s;
+	s.name = name;
+	s.entries = entries;
+	s.nodeBytes = 0;
+	s.keyBytes = 0;
+	s.valueBytes = bytes;
+	s.overheadBytes = blocks * HEAP_BLOCK_OVERHEAD_BYTES;
+	s.totalBytes = s.valueBytes + s.overheadBytes;
+	s.treeHeight = 0;
+	s.balancedHeight = 0;
+	s.averageDepth = 0;
+	stats.structures.push_back(s);
+	stats.totalBytes += s.totalBytes;
+}
+
+// Walks every tree, so it takes time proportional to the size of the index.
+// Structures held by the published snapshot are only counted where they
+// aren't shared with the indexer itself.
+IndexMemoryStats IndexerImpl::memoryStats()
+{
+	IndexMemoryStats stats;
+	stats.totalBytes = 0;
+
+	MapMemoryStats postings = m_indexHashed.memoryStats();
+	postings.add(m_index.memoryStats());
+	addTreeStats(stats, "postings", postings);
+	addFlatStats(stats, "termFilter", m_memoryTermCount, m_memoryTermFilter.sizeInBytes(), 1);
+	addFlatStats(stats, "urls", m_urls.size(), m_urls.sizeInBytes(), 4);
+	addFlatStats(stats, "docLengths", m_docLengths.docCount(), m_docLengths.sizeInBytes(), 1);
+	addTreeStats(stats, "fingerprints", m_fingerprints.memoryStats());
+	addTreeStats(stats, "docPostings", m_docPostings.memoryStats());
+	addTreeStats(stats, "simHashes", m_simHashes.memoryStats());
+	addTreeStats(stats, "clusters", m_clusters.memoryStats());
+	addTreeStats(stats, "counts", m_countHolder.memoryStats());
+	if (m_positionsEnabled)
+		addTreeStats(stats, "positions", m_positions.memoryStats());
+
+	// std::vector<bool> packs its flags into bits
+	addFlatStats(stats, "deleted", m_deletedCount, m_deleted.capacity() / 8 +
+		(m_compactionQueue.capacity() + m_compactingIds.capacity()) * sizeof(void*), 3);
+
+	std::vector<std::shared_ptr<IndexSegment> > segments;
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		segments = m_segments;
+		addFlatStats(stats, "docOwner", m_docOwner.size(), m_docOwner.capacity() * sizeof(int), 1);
+	}
+	size_t segmentBytes = 0;
+	for (unsigned int s = 0; s < segments.size(); s++)
+		segmentBytes += segments[s]->memoryBytes();
+	addFlatStats(stats, "segments", segments.size(), segmentBytes, segments.size() * 8);
+	addFlatStats(stats, "frequentTerms", m_frequentTerms.termCount(), m_frequentTerms.sizeInBytes(),
+		2 + m_frequentTerms.termCount() * 2);
+
+	std::shared_ptr<const IndexSnapshotImpl> published = std::atomic_load(&m_published);
+	if (published)
+	{
+		size_t snapshotBytes = sizeof(IndexSnapshotImpl) + published->owner.capacity() * sizeof(int) +
+			published->deleted.capacity() / 8 + published->lengths->sizeInBytes();
+		for (unsigned int s = 0; s < published->segments.size(); s++)
+		{
+			if (std::find(segments.begin(), segments.end(), published->segments[s]) == segments.end())
+				snapshotBytes += published->segments[s]->memoryBytes();
+		}
+		if (published->positions)
+			snapshotBytes += published->positions->sizeInBytes();
+		addFlatStats(stats, "snapshot", 1, snapshotBytes, 4);
+	}
+	return stats;
+}
+
+void IndexerImpl::getLivePostings(const std::string& word, std::vector<HashedUrlCount>& live)
+{
+	live.clear();
+
+	// First the postings in memory, if there are any (the filter saves walking
+	// the tree for words that were never incorporated)
+	std::vector<HashedUrlCount>* temp = nullptr;
+	if (m_memoryTermFilter.mightContain(word))
+		temp = m_indexHashed.find(word);
+	if (temp != nullptr)
+	{
+		for (unsigned int i = 0; i < temp->size(); i++)
+		{
+			// Skip removed urls that are still waiting for compaction
+			if (!m_deleted[(*temp)[i].hashedUrl])
+				live.push_back((*temp)[i]);
+		}
+	}
+
+	// Then the postings in each segment (on disk or frozen) that still owns their url
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		std::vector<HashedUrlCount> postings;
+		for (unsigned int s = 0; s < m_segments.size(); s++)
+		{
+			if (!m_segments[s]->getPostings(word, postings))
+				continue;
+
+			int generation = m_segments[s]->generation();
+			for (unsigned int i = 0; i < postings.size(); i++)
+			{
+				int id = postings[i].hashedUrl;
+				if (m_docOwner[id] == generation && !m_deleted[id])
+					live.push_back(postings[i]);
+			}
+		}
+
+		// Then the pages of the word's bitmap, if it was set apart as frequent
+		std::vector<int> ids;
+		std::vector<int> counts;
+		if (m_frequentTerms.getPostings(word, ids, counts))
+		{
+			HashedUrlCount posting;
+			for (unsigned int i = 0; i < ids.size(); i++)
+			{
+				posting.hashedUrl = ids[i];
+				posting.count = counts[i];
+				if (m_docOwner[ids[i]] == m_frequentTermsOwner && !m_deleted[ids[i]])
+					live.push_back(posting);
+			}
+		}
+	}
+}
+
+bool IndexerImpl::save(std::string filenameBase)
+{
+	METRIC_TIMER(HISTOGRAM_SAVE);
+
+	if (!m_segmentBase.empty())
+		return saveSegmented(filenameBase);
+
+	// Every change since the last full save under this name is already in its log
+	if (filenameBase == m_logBase)
+		return true;
+
+	// Otherwise save in full, and log the changes from here on. A checkpoint
+	// still running may be writing the files of the last full save.
+	waitForCheckpoint();
+	if (!saveFull(filenameBase))
+		return false;
+	attachLog(filenameBase, true);
+	return true;
+}
+
+bool IndexerImpl::saveFull(std::string filenameBase)
+{
+	// The plain save files only know about the in-memory index
+	thaw();
+
+	// The following association is simply used to be able to pass the size of the url table
+	// to the public saveMyMap method which otherwise wouldn't have access to this private data.
+	// This is done in order to meet spec requirements. Otherwise we could easily add a public method
+	// to IndexderImpl to retrieve this value.
+	m_countHolder.associate("", m_hashedMapCount);
+
+	// The url table used to be written twice, as .uti ("url to id") and .itu
+	// ("id to url"); the .urls file replaces both, so old copies are removed
+	std::remove((filenameBase + ".uti").c_str());
+	std::remove((filenameBase + ".itu").c_str());
+
+	return saveMyMap(filenameBase + ".ac", m_countHolder) &&	// .ac		= "association count"
+		m_urls.save(filenameBase + ".urls") &&					// .urls	= "url dictionary"
+		saveWtic(filenameBase + ".wtic", m_indexHashed) &&		// .wtic	= "word to id counts"
+		saveMemoryTermFilter(filenameBase + ".blm") &&			// .blm		= "bloom filter"
+		m_docLengths.save(filenameBase + ".len") &&				// .len		= "document lengths"
+		savePositions(filenameBase + ".pos") &&					// .pos		= "positions"
+		saveFingerprints(filenameBase + ".fpr") &&				// .fpr		= "fingerprints"
+		saveSimHashes(filenameBase + ".sim") &&					// .sim		= "simhash signatures"
+		saveDeleted(filenameBase + ".del");						// .del		= "deleted ids"
+}
+
+bool IndexerImpl::saveShards(std::string filenameBase, int shardCount)
+{
+	if (shardCount <= 0)
+	{
+		std::cerr << "Error: an index needs at least one shard" << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> terms;
+	getAllTerms(terms);
+
+	// Each shard gets its terms' live postings and the urls they refer to
+	std::vector<std::shared_ptr<SegmentWriter> > writers;
+	std::vector<std::vector<bool> > shardHasDoc(shardCount, std::vector<bool>(HASH_TABLE_SIZE, false));
+	for (int k = 0; k < shardCount; k++)
+		writers.push_back(std::make_shared<SegmentWriter>(shardFileName(filenameBase, k) + ".terms", m_bloomOptions));
+
+	std::vector<HashedUrlCount> postings;
+	for (unsigned int t = 0; t < terms.size(); t++)
+	{
+		getLivePostings(terms[t], postings);
+		if (postings.empty())
+			continue;
+		std::sort(postings.begin(), postings.end(), hashedUrlCountIdLess);
+
+		int shard = shardOfTerm(terms[t], shardCount);
+		writers[shard]->addTerm(terms[t], postings);
+		for (unsigned int i = 0; i < postings.size(); i++)
+			shardHasDoc[shard][postings[i].hashedUrl] = true;
+	}
+
+	for (int k = 0; k < shardCount; k++)
+	{
+		for (int id = 0; id < HASH_TABLE_SIZE; id++)
+		{
+			if (shardHasDoc[k][id])
+				writers[k]->addDoc(id, idToUrl(id));
+		}
+		if (!writers[k]->write(shardFileName(filenameBase, k)))
+			return false;
+	}
+
+	// Manifest: the shard count
+	std::string manifest;
+	putVarint(manifest, shardCount);
+	return m_docLengths.save(filenameBase + ".len") &&
+		replaceWholeFile(filenameBase + ".shards", manifest);
+}
+
+bool IndexerImpl::saveShared(std::string filenameBase)
+{
+	// One file with every term's live postings and the urls they refer to, and
+	// the page lengths beside it for ranking, as saveShards writes them
+	std::vector<std::string> terms;
+	getAllTerms(terms);
+
+	SharedSegmentWriter writer;
+	std::vector<bool> hasDoc(HASH_TABLE_SIZE, false);
+	std::vector<HashedUrlCount> postings;
+	for (unsigned int t = 0; t < terms.size(); t++)
+	{
+		getLivePostings(terms[t], postings);
+		if (postings.empty())
+			continue;
+		std::sort(postings.begin(), postings.end(), hashedUrlCountIdLess);
+
+		writer.addTerm(terms[t], postings);
+		for (unsigned int i = 0; i < postings.size(); i++)
+			hasDoc[postings[i].hashedUrl] = true;
+	}
+
+	for (int id = 0; id < HASH_TABLE_SIZE; id++)
+	{
+		if (hasDoc[id])
+			writer.addDoc(id, idToUrl(id));
+	}
+	return writer.write(filenameBase + ".shared") && m_docLengths.save(filenameBase + ".len");
+}
+
+// Every term in the index, in sorted order
+void IndexerImpl::getAllTerms(std::vector<std::string>& terms)
+{
+	terms.clear();
+	std::string word;
+	for (std::vector<HashedUrlCount>* postings = m_indexHashed.getFirst(word); postings != nullptr;
+		postings = m_indexHashed.getNext(word))
+		terms.push_back(word);
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		for (unsigned int s = 0; s < m_segments.size(); s++)
+		{
+			for (int i = 0; i < m_segments[s]->termCount(); i++)
+			{
+				m_segments[s]->getTerm(i, word);
+				terms.push_back(word);
+			}
+		}
+	}
+	m_frequentTerms.getTerms(terms);
+	std::sort(terms.begin(), terms.end());
+	terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+}
+
+// Files of a plain save, which a checkpoint writes under filenameBase + ".ckpt"
+// and then moves into place
+static const char* const SAVE_EXTENSIONS[] = { ".ac", ".urls", ".wtic", ".blm", ".len", ".pos", ".fpr", ".sim", ".del" };
+static const int SAVE_EXTENSION_COUNT = sizeof(SAVE_EXTENSIONS) / sizeof(SAVE_EXTENSIONS[0]);
+
+// The file of a plain save under filenameBase with the given extension. Once a
+// checkpoint is complete (see startCheckpoint), its files that haven't been
+// moved into place yet are read where it wrote them.
+static std::string savedFile(const std::string& filenameBase, const char* extension, bool checkpointed)
+{
+	std::string checkpointFile = filenameBase + ".ckpt" + extension;
+	std::ifstream probe(checkpointFile.c_str());
+	return checkpointed && probe ? checkpointFile : filenameBase + extension;
+}
+
+bool IndexerImpl::load(std::string filenameBase)
+{
+	METRIC_TIMER(HISTOGRAM_LOAD);
+
+	// Whatever was being logged, under whatever name, is complete on disk
+	waitForCheckpoint();
+	detachLog();
+	m_tornLogs.clear();
+
+	// Loading only reads files, so indexes loaded just to be searched never
+	// change them; what a crash left to put in order waits for the first change
+	// to be logged (see recoverLog). A checkpoint that got as far as saving the
+	// index in full, but not as far as putting its files in place, is read from
+	// wherever its files are.
+	std::string done;
+	bool checkpointed = readWholeFile(filenameBase + ".ckpt.done", done);
+	if (!loadIndexFiles(filenameBase, checkpointed))
+		return false;
+
+	// Then the changes made since, from the log a checkpoint was folding in (if
+	// it didn't get that far) and the current one
+	if (m_segmentBase.empty())
+	{
+		if ((!checkpointed && !replayLog(filenameBase + ".wal.old")) || !replayLog(filenameBase + ".wal"))
+			return false;
+		attachLog(filenameBase, false);
+	}
+
+	if (m_snapshotsEnabled)
+		publish();
+	return true;
+}
+
+bool IndexerImpl::loadIndexFiles(std::string filenameBase, bool checkpointed)
+{
+	// Whatever this indexer was doing with its segments is over
+	stopMerging();
+	m_segmentBase.clear();
+	m_segments.clear();
+	m_obsoleteSegmentFiles.clear();
+	m_frequentTerms.clear();
+
+	std::string manifest;
+	if (readWholeFile(filenameBase + ".segs", manifest))
+		return loadSegmented(filenameBase);
+
+	// The postings (by far the biggest file) and the positions are read on
+	// threads of their own while this one reads the url dictionary and the other
+	// per-page files; none of them touch the same members. Should this return
+	// early, the futures wait for their threads before terms goes away.
+	std::vector<std::pair<std::string, std::vector<HashedUrlCount> > > terms;
+	std::future<bool> postingsRead = std::async(std::launch::async, readWtic,
+		savedFile(filenameBase, ".wtic", checkpointed), std::ref(terms));
+	std::future<bool> positionsRead = std::async(std::launch::async, &IndexerImpl::loadPositions, this,
+		savedFile(filenameBase, ".pos", checkpointed));
+
+	// Must also transfer over m_hashedMapCount
+	m_hashedMapCount = loadAC(savedFile(filenameBase, ".ac", checkpointed));
+	if (m_hashedMapCount == -1) // Error loading value from file
+		return false;
+
+	// Must refill the url dictionary, from an index saved before .urls files
+	// existed if need be
+	std::string urlFile;
+	bool loadCheck;
+	if (readWholeFile(savedFile(filenameBase, ".urls", checkpointed), urlFile))
+		loadCheck = m_urls.load(savedFile(filenameBase, ".urls", checkpointed));
+	else
+		loadCheck = loadLegacyUrls(filenameBase + ".uti");
+
+	loadCheck = loadCheck && loadFingerprints(savedFile(filenameBase, ".fpr", checkpointed)) &&
+		loadSimHashes(savedFile(filenameBase, ".sim", checkpointed));
+	if (!postingsRead.get() || !loadCheck)
+		return false;
+
+	// Files written before the terms were saved in order are in the tree's level
+	// order instead, and are sorted here
+	bool sorted = true;
+	for (unsigned int t = 1; t < terms.size() && sorted; t++)
+		sorted = terms[t - 1].first < terms[t].first;
+	if (!sorted)
+		std::sort(terms.begin(), terms.end(), wticTermLess);
+
+	m_memoryBytes = 0;
+	m_memoryTermCount = terms.size();
+	for (unsigned int t = 0; t < terms.size(); t++)
+	{
+		m_memoryBytes += terms[t].first.size() + MEMORY_TERM_OVERHEAD_BYTES +
+			terms[t].second.size() * sizeof(HashedUrlCount);
+	}
+	m_indexHashed.assignSorted(terms);
+
+	// The forward index refers to the posting vectors that were just replaced
+	m_docPostings.clear();
+	m_docPostingsBuilt = false;
+
+	// Everything in a plain index lives in memory
+	m_docOwner.assign(HASH_TABLE_SIZE, NO_SEGMENT);
+	m_memoryDocs = 0;
+	std::vector<int> ids;
+	m_urls.getIds(ids);
+	for (unsigned int i = 0; i < ids.size(); i++)
+		setOwner(ids[i], MEMORY_SEGMENT);
+
+	// Document lengths are rebuilt from the postings of live pages if need be
+	return loadMemoryTermFilter(savedFile(filenameBase, ".blm", checkpointed)) &&
+		loadDeleted(savedFile(filenameBase, ".del", checkpointed)) &&
+		loadDocLengths(savedFile(filenameBase, ".len", checkpointed)) &&
+		positionsRead.get();
+}
+
+// .wtic files are text: for each term, a line with the term, a line with twice
+// its posting count, then the id and the count of each posting on lines of
+// their own. The terms are written in increasing order, so loading can build
+// the tree straight from them.
+static void appendLine(std::string& buf, int value)
+{
+	char digits[16];
+	int n = 0;
+	unsigned int v = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+	do
+	{
+		digits[n++] = static_cast<char>('0' + v % 10);
+		v /= 10;
+	} while (v != 0);
+	if (value < 0)
+		buf += '-';
+	while (n > 0)
+		buf += digits[--n];
+	buf += '\n';
+}
+
+bool saveWtic(const std::string& filename, MyMap<std::string, std::vector<HashedUrlCount> >& index)
+{
+	// Like the other text files, an empty index isn't saved
+	std::vector<std::pair<const std::string*, std::vector<HashedUrlCount>*> > terms;
+	index.getSortedItems(terms);
+	if (terms.empty())
+		return false;
+
+	std::ofstream stream(filename.c_str());
+	if (!stream)
+	{
+		std::cerr << "Error: Cannot create " << filename << std::endl;
+		return false;
+	}
+
+	std::string buf;
+	for (unsigned int t = 0; t < terms.size(); t++)
+	{
+		const std::vector<HashedUrlCount>& postings = *terms[t].second;
+		buf += *terms[t].first;
+		buf += '\n';
+		appendLine(buf, postings.size() * 2);
+		for (unsigned int i = 0; i < postings.size(); i++)
+		{
+			appendLine(buf, postings[i].hashedUrl);
+			appendLine(buf, postings[i].count);
+		}
+		if (buf.size() >= WTIC_WRITE_BUFFER_BYTES)
+		{
+			stream.write(buf.data(), buf.size());
+			buf.clear();
+		}
+	}
+	stream.write(buf.data(), buf.size());
+	return static_cast<bool>(stream);
+}
+
+// The line starting at p, without its line break (of either kind)
+static bool nextLine(const char*& p, const char* end, const char*& line, const char*& lineEnd)
+{
+	if (p == end)
+		return false;
+	line = p;
+	while (p != end && *p != '\n')
+		p++;
+	lineEnd = p;
+	if (p != end)
+		p++;
+	if (lineEnd != line && lineEnd[-1] == '\r')
+		lineEnd--;
+	return true;
+}
+
+// A line holding nothing but a decimal integer, parsed in place
+static bool nextIntLine(const char*& p, const char* end, int& value)
+{
+	const char* line;
+	const char* lineEnd;
+	if (!nextLine(p, end, line, lineEnd) || line == lineEnd)
+		return false;
+
+	bool negative = (*line == '-');
+	if (negative && ++line == lineEnd)
+		return false;
+	unsigned int v = 0;
+	for (; line != lineEnd; line++)
+	{
+		unsigned int digit = static_cast<unsigned char>(*line) - '0';
+		if (digit > 9)
+			return false;
+		v = v * 10 + digit;
+	}
+	value = negative ? -static_cast<int>(v) : static_cast<int>(v);
+	return true;
+}
+
+// Reads the terms of a .wtic file in the order they are in, straight from a
+// mapping of the file
+bool readWtic(const std::string& filename, std::vector<std::pair<std::string, std::vector<HashedUrlCount> > >& terms)
+{
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		std::cerr << "Error: Cannot read from " << filename << std::endl;
+		return false;
+	}
+
+	const char* p = file.data();
+	const char* end = p + file.size();
+	const char* line;
+	const char* lineEnd;
+	while (nextLine(p, end, line, lineEnd))
+	{
+		int itemCount;
+		if (line == lineEnd || !nextIntLine(p, end, itemCount) || itemCount < 0 || itemCount > end - p)
+		{
+			std::cerr << "Error: corrupt index file " << filename << std::endl;
+			return false;
+		}
+
+		terms.push_back(std::make_pair(std::string(line, lineEnd), std::vector<HashedUrlCount>(itemCount / 2)));
+		std::vector<HashedUrlCount>& postings = terms.back().second;
+		for (int i = 0; i < itemCount / 2; i++)
+		{
+			if (!nextIntLine(p, end, postings[i].hashedUrl) || !nextIntLine(p, end, postings[i].count) ||
+				postings[i].hashedUrl < 0 || postings[i].hashedUrl >= HASH_TABLE_SIZE)
+			{
+				std::cerr << "Error: corrupt index file " << filename << std::endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool wticTermLess(const std::pair<std::string, std::vector<HashedUrlCount> >& a,
+	const std::pair<std::string, std::vector<HashedUrlCount> >& b)
+{
+	return a.first < b.first;
+}
+
+bool IndexerImpl::loadLegacyUrls(std::string filename)
+{
+	MyMap<std::string, int> urlToId;
+	if (!loadMyMap(filename, urlToId))
+		return false;
+
+	m_urls.clear();
+	std::string url;
+	int* id = urlToId.getFirst(url);
+	if (id == nullptr)
+		return false;
+	for (; id != nullptr; id = urlToId.getNext(url))
+		m_urls.insert(*id, url);
+	return true;
+}
+
+int IndexerImpl::urlToId(std::string url)
+{
+	int hashedUrl = m_urls.idFor(url);
+	return hashedUrl;
+}
+
+std::string IndexerImpl::idToUrl(int id)
+{
+	// The dictionary's search function returns a string by reference.
+	std::string originalUrl;
+	m_urls.findUrl(id, originalUrl);
+	return originalUrl;
+}
+
+void IndexerImpl::addUrl(std::string url, int id)
+{
+	m_urls.insert(id, url);
+
+	// Update the size count for use in the save and load functions.
+	m_hashedMapCount++;
+}
+
+void IndexerImpl::addPostings(int id, WordBag& wb)
+{
+	std::string tempWord;
+	int count;
+
+	// Indexer m_indexHashed object is updated with the contents of the WordBag (wb) object
+	bool gotAWord = wb.getFirstWord(tempWord, count);
+
+	HashedUrlCount tempHashedUrlCount;
+	std::vector<std::vector<HashedUrlCount>*> docPostings;
+	int length = 0;
+
+	// Kept aside for the next publish too, which freezes only what changed
+	UnpublishedPosting unpublished;
+	if (m_snapshotsEnabled)
+	{
+		unpublished.addition = m_unpublishedAdditions++;
+		m_unpublishedAddition[id] = unpublished.addition;
+		m_unpublishedIds.push_back(id);
+	}
+
+	while (gotAWord)
+	{
+		length += count;
+		tempHashedUrlCount.count = count;
+		tempHashedUrlCount.hashedUrl = id;
+
+		// A vector of type pointer to determine if a vector (UrlCount) of url to int association already exists
+		std::vector<HashedUrlCount>* tempVector = m_indexHashed.find(tempWord);
+
+		// If no association between url and int exists, create the association with
+		// an empty vector first and then fill in the stored copy
+		if (tempVector == nullptr)
+		{
+			m_indexHashed.associate(tempWord, std::vector<HashedUrlCount>());
+			tempVector = m_indexHashed.find(tempWord);
+			m_memoryBytes += tempWord.size() + MEMORY_TERM_OVERHEAD_BYTES;
+			addMemoryTerm(tempWord);
+		}
+
+		// The vector lives inside its MyMap node, so updating it through the pointer
+		// updates the association itself
+		tempVector->push_back(tempHashedUrlCount);
+		m_memoryBytes += sizeof(HashedUrlCount);
+
+		if (m_snapshotsEnabled)
+		{
+			unpublished.term = tempWord;
+			unpublished.posting = tempHashedUrlCount;
+			m_unpublished.push_back(unpublished);
+		}
+
+		if (m_docPostingsBuilt)
+			docPostings.push_back(tempVector);
+
+		gotAWord = wb.getNextWord(tempWord, count);
+	}
+
+	if (m_docPostingsBuilt)
+		m_docPostings.associate(id, docPostings);
+
+	m_docLengths.set(id, length);
+	if (m_positionsEnabled)
+	{
+		// A bag that didn't keep positions can't be matched by phrases, so
+		// it only drops the positions of whatever page had the id before
+		if (wb.hasPositions())
+			m_positions.addDoc(id, wb);
+		else
+			m_positions.removeDoc(id);
+		m_positionsChanged = true;
+	}
+
+	setOwner(id, MEMORY_SEGMENT);
+}
+
+void IndexerImpl::removePostings(int id)
+{
+	if (!m_docPostingsBuilt)
+		buildDocPostings();
+
+	std::vector<std::vector<HashedUrlCount>*>* docPostings = m_docPostings.find(id);
+	if (docPostings == nullptr)
+		return;
+
+	for (unsigned int i = 0; i < docPostings->size(); i++)
+	{
+		std::vector<HashedUrlCount>& postings = *(*docPostings)[i];
+		for (unsigned int k = 0; k < postings.size(); k++)
+		{
+			if (postings[k].hashedUrl == id)
+			{
+				postings.erase(postings.begin() + k);
+				break;
+			}
+		}
+	}
+
+	docPostings->clear();
+}
+
+void IndexerImpl::buildDocPostings()
+{
+	m_docPostings.clear();
+
+	std::string word;
+	std::vector<HashedUrlCount>* postings = m_indexHashed.getFirst(word);
+	for (; postings != nullptr; postings = m_indexHashed.getNext(word))
+	{
+		for (unsigned int i = 0; i < postings->size(); i++)
+		{
+			int id = (*postings)[i].hashedUrl;
+			std::vector<std::vector<HashedUrlCount>*>* docPostings = m_docPostings.find(id);
+			if (docPostings == nullptr)
+			{
+				m_docPostings.associate(id, std::vector<std::vector<HashedUrlCount>*>());
+				docPostings = m_docPostings.find(id);
+			}
+			docPostings->push_back(postings);
+		}
+	}
+
+	m_docPostingsBuilt = true;
+}
+
+bool IndexerImpl::saveFingerprints(std::string filename)
+{
+	// Binary: (varint id, fixed64 fingerprint) pairs
+	std::string buf;
+	int id;
+	for (unsigned long long* fp = m_fingerprints.getFirst(id); fp != nullptr; fp = m_fingerprints.getNext(id))
+	{
+		putVarint(buf, id);
+		putFixed64(buf, *fp);
+	}
+	return writeWholeFile(filename, buf);
+}
+
+bool IndexerImpl::loadFingerprints(std::string filename)
+{
+	m_fingerprints.clear();
+
+	// Indexes saved before fingerprints existed have no .fpr file. Their pages
+	// simply count as changed the first time they are crawled again.
+	std::string buf;
+	if (!readWholeFile(filename, buf))
+		return true;
+
+	const char* p = buf.data();
+	const char* end = p + buf.size();
+	int id;
+	unsigned long long fp;
+	while (p != end)
+	{
+		if (!getVarint(p, end, id) || !getFixed64(p, end, fp))
+		{
+			std::cerr << "Error: corrupt fingerprint file " << filename << std::endl;
+			return false;
+		}
+		m_fingerprints.associate(id, fp);
+	}
+
+	return true;
+}
+
+bool IndexerImpl::admitNearDuplicate(std::string url, WordBag& wb, unsigned long long& signature)
+{
+	signature = simHash(wb);
+
+	// Pages without any words would all share the same signature
+	std::string word;
+	int count;
+	if (!wb.getFirstWord(word, count))
+		return true;
+
+	m_dedupStats.pagesChecked++;
+	int original = m_simHashes.findNearDuplicate(signature, -1);
+	if (original == -1)
+		return true;
+
+	// A clustered url never gets an id, so a re-crawl brings it back here; it
+	// was counted and clustered the first time
+	std::vector<std::string>* members = m_clusters.find(original);
+	if (m_nearDuplicatePolicy == CLUSTER_NEAR_DUPLICATES && members != nullptr &&
+		std::find(members->begin(), members->end(), url) != members->end())
+		return false;
+
+	m_dedupStats.nearDuplicatesFound++;
+	switch (m_nearDuplicatePolicy)
+	{
+	case SKIP_NEAR_DUPLICATES:
+		m_dedupStats.pagesSkipped++;
+		return false;
+	case CLUSTER_NEAR_DUPLICATES:
+		if (members == nullptr)
+			m_clusters.associate(original, std::vector<std::string>(1, url));
+		else
+			members->push_back(url);
+		m_dedupStats.pagesClustered++;
+		return false;
+	default:
+		return true;
+	}
+}
+
+bool IndexerImpl::saveSimHashes(std::string filename)
+{
+	// Binary: signature count, (varint id, fixed64 signature) pairs, then
+	// (varint id of indexed page, clustered url) pairs up to the end of the file
+	std::string buf;
+	MyMap<int, unsigned long long>& signatures = m_simHashes.signatures();
+	putVarint(buf, signatures.size());
+
+	int id;
+	for (unsigned long long* sig = signatures.getFirst(id); sig != nullptr; sig = signatures.getNext(id))
+	{
+		putVarint(buf, id);
+		putFixed64(buf, *sig);
+	}
+
+	for (std::vector<std::string>* members = m_clusters.getFirst(id); members != nullptr;
+		members = m_clusters.getNext(id))
+	{
+		for (unsigned int i = 0; i < members->size(); i++)
+		{
+			putVarint(buf, id);
+			putString(buf, (*members)[i]);
+		}
+	}
+
+	return writeWholeFile(filename, buf);
+}
+
+bool IndexerImpl::loadSimHashes(std::string filename)
+{
+	m_simHashes.clear();
+	m_clusters.clear();
+
+	// Missing for indexes saved before near-duplicate detection existed
+	std::string buf;
+	if (!readWholeFile(filename, buf))
+		return true;
+
+	const char* p = buf.data();
+	const char* end = p + buf.size();
+	int signatureCount;
+	if (!getVarint(p, end, signatureCount))
+		return false;
+
+	int id;
+	unsigned long long sig;
+	for (int i = 0; i < signatureCount; i++)
+	{
+		if (!getVarint(p, end, id) || !getFixed64(p, end, sig))
+		{
+			std::cerr << "Error: corrupt simhash file " << filename << std::endl;
+			return false;
+		}
+		m_simHashes.insert(id, sig);
+	}
+
+	std::string url;
+	while (p != end)
+	{
+		if (!getVarint(p, end, id) || !getString(p, end, url))
+		{
+			std::cerr << "Error: corrupt simhash file " << filename << std::endl;
+			return false;
+		}
+		std::vector<std::string>* members = m_clusters.find(id);
+		if (members == nullptr)
+			m_clusters.associate(id, std::vector<std::string>(1, url));
+		else
+			members->push_back(url);
+	}
+
+	return true;
+}
+
+bool IndexerImpl::findIncorporated(const std::string& url, int& id)
+{
+	std::string storedUrl;
+	id = urlToId(url);
+	return m_urls.findUrl(id, storedUrl) && storedUrl == url;
+}
+
+void IndexerImpl::maintainCompaction()
+{
+	if (!m_compactingIds.empty())
+		compactStep(COMPACTION_STEP_LISTS);
+	else if (m_deletedCount > COMPACTION_THRESHOLD * m_hashedMapCount)
+	{
+		startCompaction();
+		compactStep(COMPACTION_STEP_LISTS);
+	}
+}
+
+void IndexerImpl::startCompaction()
+{
+	if (!m_docPostingsBuilt)
+		buildDocPostings();
+
+	m_compactionQueue.clear();
+	m_compactingIds.clear();
+
+	for (int id = 0; id < HASH_TABLE_SIZE; id++)
+	{
+		if (!m_deleted[id])
+			continue;
+
+		m_compactingIds.push_back(id);
+		std::vector<std::vector<HashedUrlCount>*>* docPostings = m_docPostings.find(id);
+		if (docPostings != nullptr)
+			m_compactionQueue.insert(m_compactionQueue.end(), docPostings->begin(), docPostings->end());
+	}
+
+	// Several removed urls usually share posting lists; rewrite each list once
+	std::sort(m_compactionQueue.begin(), m_compactionQueue.end());
+	m_compactionQueue.erase(std::unique(m_compactionQueue.begin(), m_compactionQueue.end()), m_compactionQueue.end());
+}
+
+bool IndexerImpl::compactStep(int maxLists)
+{
+	for (int n = 0; n < maxLists && !m_compactionQueue.empty(); n++)
+	{
+		std::vector<HashedUrlCount>& postings = *m_compactionQueue.back();
+		m_compactionQueue.pop_back();
+
+		// Keeps the relative order of the remaining postings
+		unsigned int kept = 0;
+		for (unsigned int i = 0; i < postings.size(); i++)
+		{
+			if (!m_deleted[postings[i].hashedUrl])
+				postings[kept++] = postings[i];
+		}
+		postings.resize(kept);
+	}
+
+	if (!m_compactionQueue.empty())
+		return false;
+
+	finishCompaction();
+	return true;
+}
+
+void IndexerImpl::finishCompaction()
+{
+	// All postings of these ids are gone now, so the urls themselves can go
+	for (unsigned int i = 0; i < m_compactingIds.size(); i++)
+	{
+		int id = m_compactingIds[i];
+		if (!m_deleted[id])
+			continue;
+
+		m_urls.erase(id);
+		m_docPostings.remove(id);
+		setOwner(id, NO_SEGMENT);
+
+		m_deleted[id] = false;
+		m_deletedCount--;
+		m_hashedMapCount--;
+	}
+
+	m_compactingIds.clear();
+}
+
+bool IndexerImpl::saveDeleted(std::string filename)
+{
+	// Binary: varint ids of removed urls that haven't been compacted away yet
+	std::string buf;
+	for (int id = 0; id < HASH_TABLE_SIZE; id++)
+	{
+		if (m_deleted[id])
+			putVarint(buf, id);
+	}
+	return writeWholeFile(filename, buf);
+}
+
+bool IndexerImpl::loadDeleted(std::string filename)
+{
+	m_deleted.assign(HASH_TABLE_SIZE, false);
+	m_deletedCount = 0;
+	m_compactionQueue.clear();
+	m_compactingIds.clear();
+
+	// Missing for indexes saved before urls could be removed
+	std::string buf;
+	if (!readWholeFile(filename, buf))
+		return true;
+
+	const char* p = buf.data();
+	const char* end = p + buf.size();
+	int id;
+	while (p != end)
+	{
+		if (!getVarint(p, end, id) || id < 0 || id >= HASH_TABLE_SIZE)
+		{
+			std::cerr << "Error: corrupt deleted id file " << filename << std::endl;
+			return false;
+		}
+		if (!m_deleted[id])
+		{
+			m_deleted[id] = true;
+			m_deletedCount++;
+		}
+	}
+
+	return true;
+}
+
+bool IndexerImpl::useSegments(std::string filenameBase, int flushThreshold)
+{
+	// Continue with the segments saved under this name, if there are any
+	std::string manifest;
+	if (readWholeFile(filenameBase + ".segs", manifest) && !load(filenameBase))
+		return false;
+
+	// Segmented saves only write the new pages anyway, so they aren't logged
+	waitForCheckpoint();
+	detachLog();
+
+	// Otherwise the pages incorporated so far become the first in-memory segment
+	m_segmentBase = filenameBase;
+	m_segmentFlushDocs = flushThreshold;
+	maintainSegments();
+	return true;
+}
+
+void IndexerImpl::setOwner(int id, int owner)
+{
+	std::lock_guard<std::mutex> lock(m_segmentMutex);
+
+	if (m_docOwner[id] == MEMORY_SEGMENT && owner != MEMORY_SEGMENT)
+		m_memoryDocs--;
+	else if (m_docOwner[id] != MEMORY_SEGMENT && owner == MEMORY_SEGMENT)
+		m_memoryDocs++;
+	m_docOwner[id] = owner;
+}
+
+std::string IndexerImpl::segmentFileName(int generation)
+{
+	return m_segmentBase + ".seg" + std::to_string(static_cast<long long>(generation));
+}
+
+void IndexerImpl::maintainSegments()
+{
+	if (!m_segmentBase.empty() && m_memoryDocs >= m_segmentFlushDocs)
+		flushMemorySegment();
+
+#ifdef P4_METRICS
+	METRIC_SET(GAUGE_MEMORY_INDEX_BYTES, m_memoryBytes);
+	METRIC_SET(GAUGE_DELETED_URLS, m_deletedCount);
+	std::lock_guard<std::mutex> lock(m_segmentMutex);
+	METRIC_SET(GAUGE_SEGMENTS, m_segments.size());
+#endif
+}
+
+// Writer is a SegmentWriter or a SharedSegmentWriter
+template <typename Writer>
+void IndexerImpl::writeMemorySegment(Writer& writer, std::vector<int>& memoryIds)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		for (int id = 0; id < HASH_TABLE_SIZE; id++)
+		{
+			if (m_docOwner[id] == MEMORY_SEGMENT)
+				memoryIds.push_back(id);
+		}
+	}
+
+	for (unsigned int i = 0; i < memoryIds.size(); i++)
+		writer.addDoc(memoryIds[i], idToUrl(memoryIds[i]));
+
+	// Segments want their terms in sorted order, which a level-order walk isn't
+	std::vector<std::pair<std::string, std::vector<HashedUrlCount>*> > terms;
+	std::string word;
+	for (std::vector<HashedUrlCount>* postings = m_indexHashed.getFirst(word); postings != nullptr;
+		postings = m_indexHashed.getNext(word))
+	{
+		if (!postings->empty())
+			terms.push_back(std::make_pair(word, postings));
+	}
+	std::sort(terms.begin(), terms.end());
+
+	std::vector<HashedUrlCount> sorted;
+	for (unsigned int i = 0; i < terms.size(); i++)
+	{
+		sorted = *terms[i].second;
+		std::sort(sorted.begin(), sorted.end(), hashedUrlCountIdLess);
+		writer.addTerm(terms[i].first, sorted);
+	}
+}
+
+bool IndexerImpl::writeRun(int& generation, std::vector<int>& memoryIds)
+{
+	// Removed pages must not make it into an immutable segment
+	compact();
+
+	generation = MEMORY_SEGMENT;
+	if (m_memoryDocs == 0)
+		return true;
+
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		generation = m_nextGeneration++;
+	}
+
+	std::string filename = segmentFileName(generation);
+	SegmentWriter writer(filename + ".terms", m_bloomOptions);
+	writeMemorySegment(writer, memoryIds);
+	return writer.write(filename);
+}
+
+void IndexerImpl::clearMemorySegment()
+{
+	m_indexHashed.clear();
+	m_docPostings.clear();
+	m_docPostingsBuilt = false;
+	m_memoryBytes = 0;
+	m_memoryTermCount = 0;
+	m_memoryTermFilter.reset(MEMORY_TERM_FILTER_MIN_TERMS, m_bloomOptions);
+	m_memoryTermFilterCapacity = MEMORY_TERM_FILTER_MIN_TERMS;
+	m_publishAll = true;
+}
+
+void IndexerImpl::addMemoryTerm(const std::string& term)
+{
+	// The filter is sized for a number of terms; once there are more it is
+	// rebuilt for twice as many so the false positive rate holds
+	if (++m_memoryTermCount > m_memoryTermFilterCapacity)
+		rebuildMemoryTermFilter();
+	else
+		m_memoryTermFilter.add(term);
+}
+
+void IndexerImpl::rebuildMemoryTermFilter()
+{
+	m_memoryTermFilterCapacity = std::max(MEMORY_TERM_FILTER_MIN_TERMS, 2 * m_memoryTermCount);
+	m_memoryTermFilter.reset(m_memoryTermFilterCapacity, m_bloomOptions);
+
+	std::string word;
+	for (std::vector<HashedUrlCount>* postings = m_indexHashed.getFirst(word); postings != nullptr;
+		postings = m_indexHashed.getNext(word))
+		m_memoryTermFilter.add(word);
+}
+
+void IndexerImpl::setBloomFilter(double falsePositiveRate, size_t maxBytes)
+{
+	// Segments written from now on use the new settings; existing ones keep theirs
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		m_bloomOptions.falsePositiveRate = falsePositiveRate;
+		m_bloomOptions.maxBytes = maxBytes;
+	}
+	rebuildMemoryTermFilter();
+}
+
+bool IndexerImpl::saveMemoryTermFilter(std::string filename)
+{
+	// Binary: varint capacity (in terms), then the filter (see BloomFilter.h)
+	std::string buf;
+	putVarint(buf, m_memoryTermFilterCapacity);
+	m_memoryTermFilter.encode(buf);
+	return replaceWholeFile(filename, buf);
+}
+
+bool IndexerImpl::loadMemoryTermFilter(std::string filename)
+{
+	std::string buf;
+	if (readWholeFile(filename, buf))
+	{
+		const char* p = buf.data();
+		const char* end = p + buf.size();
+		if (getVarint(p, end, m_memoryTermFilterCapacity) && m_memoryTermFilter.decode(p, end) && p == end &&
+			m_memoryTermFilterCapacity >= m_memoryTermCount)
+			return true;
+	}
+
+	// Indexes saved before filters existed (or with a damaged one) get one built from their terms
+	rebuildMemoryTermFilter();
+	return true;
+}
+
+void IndexerImpl::enablePositions()
+{
+	// Pages incorporated before this have no positions, so phrases never match them
+	m_positionsEnabled = true;
+}
+
+bool IndexerImpl::positionsEnabled() const
+{
+	return m_positionsEnabled;
+}
+
+bool IndexerImpl::savePositions(std::string filename)
+{
+	if (m_positionsEnabled)
+		return m_positions.save(filename);
+
+	// Don't leave the positions of an earlier save next to a newer index
+	std::remove(filename.c_str());
+	return true;
+}
+
+bool IndexerImpl::loadDocLengths(std::string filename)
+{
+	// Indexes saved before lengths were kept (or with a damaged file) get them
+	// recounted from their postings
+	if (!m_docLengths.load(filename))
+		rebuildDocLengths();
+	return true;
+}
+
+void IndexerImpl::rebuildDocLengths()
+{
+	std::vector<int> lengths(HASH_TABLE_SIZE, 0);
+
+	std::string word;
+	for (std::vector<HashedUrlCount>* postings = m_indexHashed.getFirst(word); postings != nullptr;
+		postings = m_indexHashed.getNext(word))
+	{
+		for (unsigned int i = 0; i < postings->size(); i++)
+			lengths[(*postings)[i].hashedUrl] += (*postings)[i].count;
+	}
+
+	std::vector<HashedUrlCount> postings;
+	for (unsigned int s = 0; s < m_segments.size(); s++)
+	{
+		int generation = m_segments[s]->generation();
+		for (int t = 0; t < m_segments[s]->termCount(); t++)
+		{
+			m_segments[s]->getPostingsAt(t, postings);
+			for (unsigned int i = 0; i < postings.size(); i++)
+			{
+				if (m_docOwner[postings[i].hashedUrl] == generation)
+					lengths[postings[i].hashedUrl] += postings[i].count;
+			}
+		}
+	}
+
+	// Removed pages don't count towards the average
+	m_docLengths.clear();
+	for (int id = 0; id < HASH_TABLE_SIZE; id++)
+	{
+		if (!m_deleted[id] && m_docOwner[id] != NO_SEGMENT)
+			m_docLengths.set(id, lengths[id]);
+	}
+}
+
+bool IndexerImpl::loadPositions(std::string filename)
+{
+	m_positions.clear();
+	m_positionsChanged = true;
+
+	// An index saved with positions keeps them from then on
+	std::string buf;
+	if (!readWholeFile(filename, buf))
+		return true;
+	m_positionsEnabled = true;
+	return m_positions.load(filename);
+}
+
+bool IndexerImpl::flushMemorySegment()
+{
+	int generation;
+	std::vector<int> memoryIds;
+	if (!writeRun(generation, memoryIds))
+		return false;
+	if (generation == MEMORY_SEGMENT)
+		return true;
+
+	std::shared_ptr<IndexSegment> segment = std::make_shared<IndexSegment>(generation);
+	if (!segment->open(segmentFileName(generation)))
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		m_segments.push_back(segment);
+		for (unsigned int i = 0; i < memoryIds.size(); i++)
+			m_docOwner[memoryIds[i]] = generation;
+		m_memoryDocs = 0;
+	}
+	clearMemorySegment();
+
+	startMerging();
+	m_mergeWake.notify_one();
+
+	if (m_snapshotsEnabled)
+		publish();
+	return true;
+}
+
+bool IndexerImpl::saveSegmented(std::string filenameBase)
+{
+	if (filenameBase != m_segmentBase)
+	{
+		std::cerr << "Error: a segmented index can only be saved as " << m_segmentBase << std::endl;
+		return false;
+	}
+
+	// Saving only writes out the in-memory segment and a small manifest; the
+	// existing segment files are immutable and already on disk.
+	if (!flushMemorySegment())
+		return false;
+
+	// Manifest: next generation, segment count, generations, then (id, owner) pairs
+	std::string manifest;
+	std::vector<std::string> obsolete;
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		putVarint(manifest, m_nextGeneration);
+		putVarint(manifest, m_segments.size());
+		for (unsigned int s = 0; s < m_segments.size(); s++)
+			putVarint(manifest, m_segments[s]->generation());
+		for (int id = 0; id < HASH_TABLE_SIZE; id++)
+		{
+			if (m_docOwner[id] > MEMORY_SEGMENT)
+			{
+				putVarint(manifest, id);
+				putVarint(manifest, m_docOwner[id]);
+			}
+		}
+		obsolete.swap(m_obsoleteSegmentFiles);
+	}
+
+	if (!replaceWholeFile(filenameBase + ".segs", manifest) ||
+		!m_docLengths.save(filenameBase + ".len") ||
+		!savePositions(filenameBase + ".pos") ||
+		!saveFingerprints(filenameBase + ".fpr") ||
+		!saveSimHashes(filenameBase + ".sim") ||
+		!saveDeleted(filenameBase + ".del"))
+		return false;
+
+	// The new manifest no longer refers to segments that were merged away
+	for (unsigned int i = 0; i < obsolete.size(); i++)
+		std::remove(obsolete[i].c_str());
+
+	return true;
+}
+
+bool IndexerImpl::loadSegmented(std::string filenameBase)
+{
+	std::string manifest;
+	if (!readWholeFile(filenameBase + ".segs", manifest))
+		return false;
+
+	clearIndex();
+	m_segmentBase = filenameBase;
+
+	const char* p = manifest.data();
+	const char* end = p + manifest.size();
+	int segmentCount;
+	if (!getVarint(p, end, m_nextGeneration) || !getVarint(p, end, segmentCount))
+		return false;
+
+	for (int s = 0; s < segmentCount; s++)
+	{
+		int generation;
+		if (!getVarint(p, end, generation))
+			return false;
+		std::shared_ptr<IndexSegment> segment = std::make_shared<IndexSegment>(generation);
+		if (!segment->open(segmentFileName(generation)))
+			return false;
+		m_segments.push_back(segment);
+	}
+
+	int id;
+	int owner;
+	while (p != end)
+	{
+		if (!getVarint(p, end, id) || !getVarint(p, end, owner) || id < 0 || id >= HASH_TABLE_SIZE)
+		{
+			std::cerr << "Error: corrupt segment manifest " << filenameBase << ".segs" << std::endl;
+			return false;
+		}
+		m_docOwner[id] = owner;
+	}
+
+	// The url tables are rebuilt from the pages each segment owns
+	std::string url;
+	for (unsigned int s = 0; s < m_segments.size(); s++)
+	{
+		for (int i = 0; i < m_segments[s]->docCount(); i++)
+		{
+			m_segments[s]->getDoc(i, id, url);
+			if (m_docOwner[id] != m_segments[s]->generation())
+				continue;
+			addUrl(url, id);
+		}
+	}
+
+	return loadDeleted(filenameBase + ".del") &&
+		loadDocLengths(filenameBase + ".len") &&
+		loadPositions(filenameBase + ".pos") &&
+		loadFingerprints(filenameBase + ".fpr") &&
+		loadSimHashes(filenameBase + ".sim");
+}
+
+void IndexerImpl::clearIndex()
+{
+	m_urls.clear();
+	m_hashedMapCount = 0;
+	clearMemorySegment();
+	m_docLengths.clear();
+	m_positions.clear();
+	m_positionsChanged = true;
+	m_docOwner.assign(HASH_TABLE_SIZE, NO_SEGMENT);
+	m_memoryDocs = 0;
+	m_frequentTerms.clear();
+}
+
+void IndexerImpl::startMerging()
+{
+	if (!m_mergeThread.joinable())
+		m_mergeThread = std::thread(&IndexerImpl::mergeLoop, this);
+}
+
+void IndexerImpl::stopMerging()
+{
+	if (!m_mergeThread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		m_stopMerging = true;
+	}
+	m_mergeWake.notify_one();
+	m_mergeThread.join();
+	m_stopMerging = false;
+}
+
+void IndexerImpl::mergeLoop()
+{
+	std::unique_lock<std::mutex> lock(m_segmentMutex);
+	while (!m_stopMerging)
+	{
+		std::vector<std::shared_ptr<IndexSegment> > inputs;
+		if (!pickMerge(inputs))
+		{
+			m_mergeWake.wait(lock);
+			continue;
+		}
+
+		// Merge from a copy of the ownership table; pages that change owner while
+		// the merge runs keep their new owner and are ignored in the merged segment
+		std::vector<int> owner = m_docOwner;
+		BloomFilterOptions bloomOptions = m_bloomOptions;
+		int generation = m_nextGeneration++;
+		std::string filename = segmentFileName(generation);
+		lock.unlock();
+
+		std::vector<const IndexSegment*> rawInputs;
+		for (unsigned int i = 0; i < inputs.size(); i++)
+			rawInputs.push_back(inputs[i].get());
+
+		std::shared_ptr<IndexSegment> merged = std::make_shared<IndexSegment>(generation);
+		bool mergedOk = mergeSegments(rawInputs, owner, filename, bloomOptions) && merged->open(filename);
+
+		lock.lock();
+		if (!mergedOk)
+		{
+			std::cerr << "Error: merging segments into " << filename << " failed" << std::endl;
+			break;
+		}
+
+		for (unsigned int i = 0; i < inputs.size(); i++)
+		{
+			m_segments.erase(std::find(m_segments.begin(), m_segments.end(), inputs[i]));
+			m_obsoleteSegmentFiles.push_back(segmentFileName(inputs[i]->generation()));
+		}
+		m_segments.push_back(merged);
+		m_republishNeeded = true;
+
+		for (int id = 0; id < HASH_TABLE_SIZE; id++)
+		{
+			if (m_docOwner[id] == owner[id] && owner[id] > MEMORY_SEGMENT)
+			{
+				for (unsigned int i = 0; i < inputs.size(); i++)
+				{
+					if (owner[id] == inputs[i]->generation())
+						m_docOwner[id] = generation;
+				}
+			}
+		}
+	}
+}
+
+bool IndexerImpl::pickMerge(std::vector<std::shared_ptr<IndexSegment> >& inputs)
+{
+	// Tiered policy: merge the first SEGMENT_MERGE_FACTOR segments of the lowest
+	// size tier that has that many, so every page is rewritten about once per tier
+	std::vector<std::vector<std::shared_ptr<IndexSegment> > > tiers;
+	for (unsigned int s = 0; s < m_segments.size(); s++)
+	{
+		unsigned int tier = 0;
+		for (size_t limit = SEGMENT_TIER_BASE_BYTES; m_segments[s]->sizeInBytes() >= limit; limit *= SEGMENT_MERGE_FACTOR)
+			tier++;
+		if (tier >= tiers.size())
+			tiers.resize(tier + 1);
+		tiers[tier].push_back(m_segments[s]);
+	}
+
+	for (unsigned int tier = 0; tier < tiers.size(); tier++)
+	{
+		if (tiers[tier].size() >= static_cast<unsigned int>(SEGMENT_MERGE_FACTOR))
+		{
+			inputs.assign(tiers[tier].begin(), tiers[tier].begin() + SEGMENT_MERGE_FACTOR);
+			return true;
+		}
+	}
+	return false;
+}
+
+int IndexerImpl::incorporateAll(const std::vector<FetchedPage>& pages, int threadCount)
+{
+	if (threadCount <= 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	// Split the id space into threadCount disjoint ranges and give each worker the
+	// pages in its range. Pages whose urls hash to the same id (including ones
+	// already in the index) always end up with the same worker.
+	std::vector<int> pageIds(pages.size());
+	std::vector<std::vector<int> > pageNumbers(threadCount);
+	for (unsigned int i = 0; i < pages.size(); i++)
+	{
+		std::string url = pages[i].url;
+		pageIds[i] = urlToId(url);
+		pageNumbers[static_cast<long long>(pageIds[i]) * threadCount / HASH_TABLE_SIZE].push_back(i);
+	}
+
+	// Workers only read the shared index (to skip urls already in it), and the
+	// calling thread doesn't touch it until they're all done
+	std::vector<IndexShard> shards(threadCount);
+	std::vector<std::thread> workers;
+	for (int w = 0; w < threadCount; w++)
+	{
+		workers.push_back(std::thread(&IndexerImpl::buildShard, this, std::cref(pages), std::cref(pageIds),
+			std::cref(pageNumbers[w]), std::ref(shards[w])));
+	}
+	for (int w = 0; w < threadCount; w++)
+		workers[w].join();
+
+	int incorporated = 0;
+	for (int w = 0; w < threadCount; w++)
+		incorporated += shards[w].docs.size();
+
+	// The pages that made it in are logged as they were given, in the same
+	// order, so replaying them through incorporateAll gives the same index
+	if (!m_logBase.empty() && incorporated > 0)
+	{
+		std::vector<bool> taken(HASH_TABLE_SIZE, false);
+		for (int w = 0; w < threadCount; w++)
+		{
+			for (unsigned int d = 0; d < shards[w].docs.size(); d++)
+				taken[shards[w].docs[d].id] = true;
+		}
+		std::string body;
+		putVarint(body, incorporated);
+		for (unsigned int i = 0; i < pages.size(); i++)
+		{
+			if (!taken[pageIds[i]])
+				continue;
+			taken[pageIds[i]] = false;  // only the first page with an id got it
+			putString(body, pages[i].url);
+			putString(body, pages[i].contents);
+		}
+		logRecord(LOG_BATCH, body);
+	}
+
+	mergeShards(shards);
+	if (m_snapshotsEnabled)
+		publish();
+	return incorporated;
+}
+
+static bool shardTermLess(const std::pair<std::string, std::vector<HashedUrlCount> >& a,
+	const std::pair<std::string, std::vector<HashedUrlCount> >& b)
+{
+	return a.first < b.first;
+}
+
+void IndexerImpl::buildShard(const std::vector<FetchedPage>& pages, const std::vector<int>& pageIds,
+	const std::vector<int>& pageNumbers, IndexShard& shard)
+{
+	// The worker's private partial index and the ids it has handed out so far
+	MyMap<std::string, std::vector<HashedUrlCount> > partial;
+	MyMap<int, bool> usedIds;
+
+	std::string storedUrl;
+	for (unsigned int i = 0; i < pageNumbers.size(); i++)
+	{
+		const FetchedPage& page = pages[pageNumbers[i]];
+		int id = pageIds[pageNumbers[i]];
+
+		// Same rule as incorporate: the first url to claim an id keeps it
+		if (usedIds.find(id) != nullptr || m_urls.findUrl(id, storedUrl))
+			continue;
+		usedIds.associate(id, true);
+
+		WordBag wb(page.contents, m_positionsEnabled);
+		IndexShard::Doc doc;
+		doc.id = id;
+		doc.url = page.url;
+		doc.fingerprint = contentFingerprint(page.contents);
+		doc.signature = simHash(wb);
+		doc.length = 0;
+
+		if (m_positionsEnabled)
+		{
+			if (!shard.positions)
+				shard.positions = std::make_shared<PositionIndex>(HASH_TABLE_SIZE);
+			shard.positions->addDoc(id, wb);
+		}
+
+		std::string word;
+		int count;
+		for (bool gotAWord = wb.getFirstWord(word, count); gotAWord; gotAWord = wb.getNextWord(word, count))
+		{
+			HashedUrlCount posting;
+			posting.hashedUrl = id;
+			posting.count = count;
+			doc.length += count;
+
+			std::vector<HashedUrlCount>* postings = partial.find(word);
+			if (postings == nullptr)
+				partial.associate(word, std::vector<HashedUrlCount>(1, posting));
+			else
+				postings->push_back(posting);
+		}
+		shard.docs.push_back(doc);
+	}
+
+	std::string word;
+	for (std::vector<HashedUrlCount>* postings = partial.getFirst(word); postings != nullptr;
+		postings = partial.getNext(word))
+	{
+		std::sort(postings->begin(), postings->end(), hashedUrlCountIdLess);
+		shard.terms.push_back(std::make_pair(word, std::vector<HashedUrlCount>()));
+		shard.terms.back().second.swap(*postings);
+	}
+	std::sort(shard.terms.begin(), shard.terms.end(), shardTermLess);
+}
+
+void IndexerImpl::mergeShards(std::vector<IndexShard>& shards)
+{
+	// A segmented index gets the shards streamed into a new segment file; a plain
+	// index gets them appended to m_indexHashed
+	int generation = MEMORY_SEGMENT;
+	SegmentWriter writer(m_bloomOptions);
+	if (!m_segmentBase.empty())
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		generation = m_nextGeneration++;
+	}
+
+	for (unsigned int w = 0; w < shards.size(); w++)
+	{
+		for (unsigned int i = 0; i < shards[w].docs.size(); i++)
+		{
+			const IndexShard::Doc& doc = shards[w].docs[i];
+			addUrl(doc.url, doc.id);
+			m_fingerprints.associate(doc.id, doc.fingerprint);
+			m_simHashes.insert(doc.id, doc.signature);
+			m_docLengths.set(doc.id, doc.length);
+			if (generation == MEMORY_SEGMENT)
+				setOwner(doc.id, MEMORY_SEGMENT);
+			else
+				writer.addDoc(doc.id, doc.url);
+		}
+
+		if (shards[w].positions)
+		{
+			m_positions.absorb(*shards[w].positions);
+			shards[w].positions.reset();
+			m_positionsChanged = true;
+		}
+	}
+
+	// k-way merge of the shards' sorted term lists
+	std::priority_queue<MergeCursor, std::vector<MergeCursor>, MergeCursorGreater> cursors;
+	for (unsigned int w = 0; w < shards.size(); w++)
+	{
+		if (shards[w].terms.empty())
+			continue;
+		MergeCursor cursor;
+		cursor.input = w;
+		cursor.position = 0;
+		cursor.term = shards[w].terms[0].first;
+		cursors.push(cursor);
+	}
+
+	std::vector<HashedUrlCount> merged;
+	while (!cursors.empty())
+	{
+		std::string term = cursors.top().term;
+		merged.clear();
+
+		// Cursors with equal terms come out in shard order, which is id order
+		while (!cursors.empty() && cursors.top().term == term)
+		{
+			MergeCursor cursor = cursors.top();
+			cursors.pop();
+
+			std::vector<HashedUrlCount>& postings = shards[cursor.input].terms[cursor.position].second;
+			merged.insert(merged.end(), postings.begin(), postings.end());
+			std::vector<HashedUrlCount>().swap(postings);
+
+			if (++cursor.position < static_cast<int>(shards[cursor.input].terms.size()))
+			{
+				cursor.term = shards[cursor.input].terms[cursor.position].first;
+				cursors.push(cursor);
+			}
+		}
+
+		if (generation != MEMORY_SEGMENT)
+		{
+			writer.addTerm(term, merged);
+			continue;
+		}
+
+		std::vector<HashedUrlCount>* postings = m_indexHashed.find(term);
+		if (postings == nullptr)
+		{
+			m_indexHashed.associate(term, merged);
+			m_memoryBytes += term.size() + MEMORY_TERM_OVERHEAD_BYTES;
+			addMemoryTerm(term);
+		}
+		else
+			postings->insert(postings->end(), merged.begin(), merged.end());
+		m_memoryBytes += merged.size() * sizeof(HashedUrlCount);
+	}
+
+	// The forward index doesn't know about the new postings; rebuild it when needed
+	m_docPostings.clear();
+	m_docPostingsBuilt = false;
+
+	if (generation == MEMORY_SEGMENT)
+	{
+		maintainSegments();
+		return;
+	}
+
+	std::string filename = segmentFileName(generation);
+	std::shared_ptr<IndexSegment> segment = std::make_shared<IndexSegment>(generation);
+	if (!writer.write(filename) || !segment->open(filename))
+		return;
+
+	std::lock_guard<std::mutex> lock(m_segmentMutex);
+	m_segments.push_back(segment);
+	for (unsigned int w = 0; w < shards.size(); w++)
+	{
+		for (unsigned int i = 0; i < shards[w].docs.size(); i++)
+			m_docOwner[shards[w].docs[i].id] = generation;
+	}
+	startMerging();
+	m_mergeWake.notify_one();
+}
+
+bool IndexerImpl::buildExternal(bool(*nextPage)(std::string& url, std::string& contents),
+	std::string filenameBase, size_t memoryBudget, ExternalBuildStats& stats)
+{
+	stats.pagesIndexed = 0;
+	stats.runsSpilled = 0;
+	stats.mergePasses = 0;
+	stats.spillSeconds = 0;
+	stats.mergeSeconds = 0;
+	if (memoryBudget == 0)
+		memoryBudget = EXTERNAL_BUILD_BUDGET_BYTES;
+
+	// Start over as an empty segmented index under filenameBase. Spills are
+	// driven by the memory budget, not by the page count, and go to runs that
+	// are never opened as segments (which would read them into memory).
+	// Positions, if the index keeps them, stay in memory outside the budget.
+	waitForCheckpoint();
+	detachLog();
+	stopMerging();
+	clearIndex();
+	m_segments.clear();
+	m_obsoleteSegmentFiles.clear();
+	m_frequentTerms.clear();
+	m_fingerprints.clear();
+	m_simHashes.clear();
+	m_clusters.clear();
+	m_deleted.assign(HASH_TABLE_SIZE, false);
+	m_deletedCount = 0;
+	m_nextGeneration = 1;
+	m_segmentBase = filenameBase;
+	m_segmentFlushDocs = HASH_TABLE_SIZE + 1;
+
+	std::vector<int> runs;
+	std::string url;
+	std::string contents;
+	bool more = true;
+	while (more)
+	{
+		more = nextPage(url, contents);
+		if (more)
+		{
+			WordBag wb(contents, m_positionsEnabled);
+			if (incorporate(url, wb, contentFingerprint(contents)))
+				stats.pagesIndexed++;
+			if (m_memoryBytes < memoryBudget)
+				continue;
+		}
+
+		// Spill the in-memory segment as a sorted run (the last one once the pages run out)
+		std::chrono::steady_clock::time_point spillStart = std::chrono::steady_clock::now();
+		int generation;
+		std::vector<int> memoryIds;
+		if (!writeRun(generation, memoryIds))
+			return false;
+		if (generation != MEMORY_SEGMENT)
+		{
+			for (unsigned int i = 0; i < memoryIds.size(); i++)
+				setOwner(memoryIds[i], generation);
+			clearMemorySegment();
+			runs.push_back(generation);
+		}
+		stats.spillSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - spillStart).count();
+	}
+	stats.runsSpilled = runs.size();
+
+	// Merge EXTERNAL_MERGE_FANIN runs at a time, pass after pass, until one is left
+	std::chrono::steady_clock::time_point mergeStart = std::chrono::steady_clock::now();
+	while (runs.size() > 1)
+	{
+		std::vector<int> merged;
+		for (unsigned int first = 0; first < runs.size(); first += EXTERNAL_MERGE_FANIN)
+		{
+			unsigned int last = std::min<unsigned int>(first + EXTERNAL_MERGE_FANIN, runs.size());
+			std::vector<int> group(runs.begin() + first, runs.begin() + last);
+			int generation = group[0];
+			if (group.size() > 1 && !mergeRuns(group, generation))
+				return false;
+			merged.push_back(generation);
+		}
+		runs.swap(merged);
+		stats.mergePasses++;
+	}
+	stats.mergeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mergeStart).count();
+
+	// The finished index is an ordinary one-segment index
+	if (!runs.empty())
+	{
+		std::shared_ptr<IndexSegment> segment = std::make_shared<IndexSegment>(runs[0]);
+		if (!segment->open(segmentFileName(runs[0])))
+			return false;
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		m_segments.push_back(segment);
+	}
+	m_segmentFlushDocs = SEGMENT_FLUSH_DOCS;
+
+	if (!saveSegmented(filenameBase))
+		return false;
+	if (m_snapshotsEnabled)
+		publish();
+	return true;
+}
+
+bool IndexerImpl::mergeRuns(const std::vector<int>& runs, int& generation)
+{
+	std::vector<int> owner;
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		generation = m_nextGeneration++;
+		owner = m_docOwner;
+	}
+
+	std::vector<std::shared_ptr<SegmentReader> > readers;
+	std::vector<SegmentReader*> inputs;
+	for (unsigned int i = 0; i < runs.size(); i++)
+	{
+		readers.push_back(std::make_shared<SegmentReader>(runs[i]));
+		if (!readers.back()->open(segmentFileName(runs[i])))
+			return false;
+		inputs.push_back(readers.back().get());
+	}
+
+	if (!mergeSegments(inputs, owner, segmentFileName(generation), m_bloomOptions))
+		return false;
+	readers.clear();
+
+	for (int id = 0; id < HASH_TABLE_SIZE; id++)
+	{
+		if (std::find(runs.begin(), runs.end(), owner[id]) != runs.end())
+			setOwner(id, generation);
+	}
+	for (unsigned int i = 0; i < runs.size(); i++)
+		std::remove(segmentFileName(runs[i]).c_str());
+	return true;
+}
+
+void IndexerImpl::freeze(FreezeMode mode)
+{
+	if (mode == FREEZE_NONE)
+		return;
+
+	// A segmented index freezes its in-memory part by writing it out
+	if (!m_segmentBase.empty())
+	{
+		flushMemorySegment();
+		return;
+	}
+
+	compact();
+
+	// The first time a plain index is frozen, its frequent words go into their
+	// bitmaps instead of the segment. Snapshots are made from segments alone,
+	// so an indexer that publishes them keeps every word in its segments.
+	bool tiering = m_segments.empty() && !m_snapshotsEnabled && (m_frequentTermFraction > 0 || !m_stopwords.empty());
+	if (tiering)
+		tierFrequentTerms();
+
+	SharedSegmentWriter writer;
+	std::vector<int> memoryIds;
+	writeMemorySegment(writer, memoryIds);
+	if (memoryIds.empty())
+		return;
+
+	// Packed into one arena in the order queries read it (see Segment.h), in
+	// place of the tree nodes, vectors and strings it was spread over
+	writer.finish();
+	MemoryArena arena;
+	if (!arena.allocate(writer.size(), mode == FREEZE_HUGE_PAGES))
+	{
+		std::cerr << "Error: cannot allocate " << writer.size() << " bytes to freeze the index into" << std::endl;
+		return;
+	}
+	writer.copyTo(arena.data());
+
+	std::lock_guard<std::mutex> lock(m_segmentMutex);
+	std::shared_ptr<IndexSegment> segment = std::make_shared<IndexSegment>(m_nextGeneration++);
+	segment->openArena(arena, writer.size());
+	m_segments.push_back(segment);
+	for (unsigned int i = 0; i < memoryIds.size(); i++)
+		m_docOwner[memoryIds[i]] = segment->generation();
+	if (tiering)
+		m_frequentTermsOwner = segment->generation();
+	m_memoryDocs = 0;
+	clearMemorySegment();
+}
+
+void IndexerImpl::tierFrequentTerms()
+{
+	// After compact() every posting in memory is live, so a list's length is
+	// the number of pages the word is on
+	m_frequentTerms.clear();
+	int minPages = std::max(FREQUENT_TERM_MIN_PAGES,
+		static_cast<int>(std::ceil(m_frequentTermFraction * m_docLengths.docCount())));
+	std::vector<std::pair<std::string, std::vector<HashedUrlCount>*> > terms;
+	std::string word;
+	for (std::vector<HashedUrlCount>* postings = m_indexHashed.getFirst(word); postings != nullptr;
+		postings = m_indexHashed.getNext(word))
+	{
+		if (postings->empty())
+			continue;
+		bool frequent = m_frequentTermFraction > 0 && static_cast<int>(postings->size()) >= minPages;
+		if (frequent || std::binary_search(m_stopwords.begin(), m_stopwords.end(), word))
+			terms.push_back(std::make_pair(word, postings));
+	}
+	std::sort(terms.begin(), terms.end());
+
+	// The lists are emptied rather than erased, since m_docPostings may point
+	// at them; writeMemorySegment leaves empty lists out
+	std::vector<int> ids;
+	std::vector<int> counts;
+	for (unsigned int i = 0; i < terms.size(); i++)
+	{
+		std::vector<HashedUrlCount>& postings = *terms[i].second;
+		std::sort(postings.begin(), postings.end(), hashedUrlCountIdLess);
+		ids.resize(postings.size());
+		counts.resize(postings.size());
+		for (unsigned int k = 0; k < postings.size(); k++)
+		{
+			ids[k] = postings[k].hashedUrl;
+			counts[k] = postings[k].count;
+		}
+		m_frequentTerms.add(terms[i].first, ids, counts);
+		m_memoryBytes -= std::min(m_memoryBytes, postings.size() * sizeof(HashedUrlCount));
+		std::vector<HashedUrlCount>().swap(postings);
+	}
+}
+
+void IndexerImpl::setFrequentTerms(double minPageFraction, std::vector<std::string> stopwords)
+{
+	m_frequentTermFraction = std::max(minPageFraction, 0.0);
+	for (unsigned int i = 0; i < stopwords.size(); i++)
+		strToLower(stopwords[i]);
+	std::sort(stopwords.begin(), stopwords.end());
+	m_stopwords.swap(stopwords);
+}
+
+bool IndexerImpl::isFrequentTerm(std::string word)
+{
+	strToLower(word);
+	return m_frequentTerms.find(word) != nullptr;
+}
+
+std::vector<UrlScore> IndexerImpl::getUrlScoresAmong(std::string word, const std::vector<std::string>& urls,
+	RankingMode ranking)
+{
+	// The word's live postings as ids and counts; for a frequent word that is
+	// its bitmap and count array decoded, without a url looked up. Every page
+	// is scored as getUrlScores would score it, over all the word's pages.
+	strToLower(word);
+	std::vector<HashedUrlCount> live;
+	getLivePostings(word, live);
+	std::sort(live.begin(), live.end(), hashedUrlCountIdLess);
+
+	std::vector<UrlScore> urlScores;
+	std::vector<int> counts;
+	std::vector<int> lengths;
+	std::string indexedUrl;
+	HashedUrlCount key;
+	for (unsigned int i = 0; i < urls.size(); i++)
+	{
+		// The id is made sure to be url's rather than another url's with the same hash
+		key.hashedUrl = urlToId(urls[i]);
+		std::vector<HashedUrlCount>::const_iterator it = std::lower_bound(live.begin(), live.end(), key,
+			hashedUrlCountIdLess);
+		if (it == live.end() || it->hashedUrl != key.hashedUrl || !m_urls.findUrl(key.hashedUrl, indexedUrl) ||
+			indexedUrl != urls[i])
+			continue;
+
+		UrlScore urlScore;
+		urlScore.url = urls[i];
+		urlScores.push_back(urlScore);
+		counts.push_back(it->count);
+		lengths.push_back(m_docLengths.get(key.hashedUrl));
+	}
+
+	std::vector<float> scores(urlScores.size());
+	if (!scores.empty())
+		scorePostings(ranking, live.size(), m_docLengths.docCount(), m_docLengths.averageLength(), &counts[0],
+			&lengths[0], scores.size(), &scores[0]);
+	for (unsigned int i = 0; i < urlScores.size(); i++)
+		urlScores[i].score = scores[i];
+	return urlScores;
+}
+
+void IndexerImpl::thaw()
+{
+	if (m_segments.empty())
+		return;
+	m_publishAll = true;
+
+	// Move the live postings of the frozen segments back into m_indexHashed.
+	// Removed pages keep theirs, as they would have in memory.
+	std::string term;
+	std::vector<HashedUrlCount> postings;
+	for (unsigned int s = 0; s < m_segments.size(); s++)
+	{
+		int generation = m_segments[s]->generation();
+		for (int i = 0; i < m_segments[s]->termCount(); i++)
+		{
+			m_segments[s]->getTerm(i, term);
+			m_segments[s]->getPostingsAt(i, postings);
+
+			std::vector<HashedUrlCount>* memoryPostings = nullptr;
+			for (unsigned int k = 0; k < postings.size(); k++)
+			{
+				if (m_docOwner[postings[k].hashedUrl] != generation)
+					continue;
+				if (memoryPostings == nullptr)
+				{
+					memoryPostings = m_indexHashed.find(term);
+					if (memoryPostings == nullptr)
+					{
+						m_indexHashed.associate(term, std::vector<HashedUrlCount>());
+						memoryPostings = m_indexHashed.find(term);
+						m_memoryBytes += term.size() + MEMORY_TERM_OVERHEAD_BYTES;
+						addMemoryTerm(term);
+					}
+				}
+				memoryPostings->push_back(postings[k]);
+				m_memoryBytes += sizeof(HashedUrlCount);
+			}
+		}
+	}
+
+	// Then those of the frequent words, with the counts kept beside their bitmaps
+	std::vector<std::string> frequentTerms;
+	m_frequentTerms.getTerms(frequentTerms);
+	std::vector<int> ids;
+	std::vector<int> counts;
+	HashedUrlCount posting;
+	for (unsigned int i = 0; i < frequentTerms.size(); i++)
+	{
+		const std::string& term = frequentTerms[i];
+		m_frequentTerms.getPostings(term, ids, counts);
+		std::vector<HashedUrlCount>* memoryPostings = m_indexHashed.find(term);
+		if (memoryPostings == nullptr)
+		{
+			m_indexHashed.associate(term, std::vector<HashedUrlCount>());
+			memoryPostings = m_indexHashed.find(term);
+			m_memoryBytes += term.size() + MEMORY_TERM_OVERHEAD_BYTES;
+			addMemoryTerm(term);
+		}
+		for (unsigned int k = 0; k < ids.size(); k++)
+		{
+			if (m_docOwner[ids[k]] != m_frequentTermsOwner)
+				continue;
+			posting.hashedUrl = ids[k];
+			posting.count = counts[k];
+			memoryPostings->push_back(posting);
+			m_memoryBytes += sizeof(HashedUrlCount);
+		}
+	}
+	m_frequentTerms.clear();
+
+	for (int id = 0; id < HASH_TABLE_SIZE; id++)
+	{
+		if (m_docOwner[id] > MEMORY_SEGMENT)
+			setOwner(id, MEMORY_SEGMENT);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		m_segments.clear();
+	}
+	m_docPostings.clear();
+	m_docPostingsBuilt = false;
+}
+
+void IndexerImpl::enableSnapshots()
+{
+	m_snapshotsEnabled = true;
+	publish();
+}
+
+IndexSnapshot IndexerImpl::snapshot() const
+{
+	return IndexSnapshot(std::atomic_load(&m_published));
+}
+
+void IndexerImpl::maintainSnapshots()
+{
+	if (!m_snapshotsEnabled)
+		return;
+
+	if (++m_changesSincePublish >= SNAPSHOT_PUBLISH_CHANGES || m_republishNeeded)
+		publishChanges();
+}
+
+// Publishes a snapshot with the whole in-memory index frozen afresh
+void IndexerImpl::publish()
+{
+	SegmentWriter writer(m_bloomOptions);
+	std::vector<int> memoryIds;
+	writeMemorySegment(writer, memoryIds);
+
+	m_publishedSegments.clear();
+	m_publishedGeneration.assign(HASH_TABLE_SIZE, NO_SEGMENT);
+	m_nextPublishedGeneration = NO_SEGMENT - 1;
+	addPublishedSegment(writer, memoryIds);
+
+	m_unpublishedIds.clear();
+	m_unpublished.clear();
+	m_unpublishedAddition.assign(HASH_TABLE_SIZE, -1);
+	m_unpublishedAdditions = 0;
+	m_publishAll = false;
+	publishSnapshot();
+}
+
+// Publishes a snapshot with only the pages added or replaced since the last
+// one frozen, so the cost follows the changes rather than the index
+void IndexerImpl::publishChanges()
+{
+	if (m_publishAll)
+	{
+		publish();
+		return;
+	}
+
+	if (!m_unpublishedIds.empty())
+	{
+		// A page replaced again since the last publish only has its latest postings frozen
+		std::vector<UnpublishedPosting> latest;
+		for (unsigned int i = 0; i < m_unpublished.size(); i++)
+		{
+			if (m_unpublished[i].addition == m_unpublishedAddition[m_unpublished[i].posting.hashedUrl])
+				latest.push_back(m_unpublished[i]);
+		}
+		std::vector<int> ids;
+		for (unsigned int i = 0; i < m_unpublishedIds.size(); i++)
+		{
+			if (m_unpublishedAddition[m_unpublishedIds[i]] == -1)
+				continue;
+			ids.push_back(m_unpublishedIds[i]);
+			m_unpublishedAddition[m_unpublishedIds[i]] = -1;
+		}
+		m_unpublishedIds.clear();
+		m_unpublished.clear();
+
+		SegmentWriter writer(m_bloomOptions);
+		std::sort(ids.begin(), ids.end());
+		for (unsigned int i = 0; i < ids.size(); i++)
+			writer.addDoc(ids[i], idToUrl(ids[i]));
+		std::sort(latest.begin(), latest.end(), unpublishedPostingLess);
+		std::vector<HashedUrlCount> postings;
+		for (unsigned int i = 0; i < latest.size(); i++)
+		{
+			postings.push_back(latest[i].posting);
+			if (i + 1 == latest.size() || latest[i + 1].term != latest[i].term)
+			{
+				writer.addTerm(latest[i].term, postings);
+				postings.clear();
+			}
+		}
+		addPublishedSegment(writer, ids);
+
+		if (!mergePublishedSegments())
+		{
+			publish();
+			return;
+		}
+	}
+	publishSnapshot();
+}
+
+void IndexerImpl::addPublishedSegment(SegmentWriter& writer, const std::vector<int>& ids)
+{
+	std::string frozen;
+	writer.finish(frozen);
+	int generation = m_nextPublishedGeneration--;
+	std::shared_ptr<IndexSegment> segment = std::make_shared<IndexSegment>(generation);
+	segment->openBuffer(frozen);
+	m_publishedSegments.push_back(segment);
+	for (unsigned int i = 0; i < ids.size(); i++)
+		m_publishedGeneration[ids[i]] = generation;
+}
+
+// Merges the newest two published segments while the older is less than
+// SNAPSHOT_MERGE_RATIO times the size of the newer. Pages published again in a
+// newer segment are left out of the merge.
+bool IndexerImpl::mergePublishedSegments()
+{
+	while (m_publishedSegments.size() >= 2)
+	{
+		std::shared_ptr<IndexSegment> older = m_publishedSegments[m_publishedSegments.size() - 2];
+		std::shared_ptr<IndexSegment> newer = m_publishedSegments.back();
+		if (older->sizeInBytes() >= SNAPSHOT_MERGE_RATIO * newer->sizeInBytes())
+			break;
+
+		std::vector<const IndexSegment*> inputs;
+		inputs.push_back(older.get());
+		inputs.push_back(newer.get());
+		std::string merged;
+		if (!mergeSegmentsToBuffer(inputs, m_publishedGeneration, merged, m_bloomOptions))
+			return false;
+
+		int generation = m_nextPublishedGeneration--;
+		std::shared_ptr<IndexSegment> segment = std::make_shared<IndexSegment>(generation);
+		if (!segment->openBuffer(merged))
+			return false;
+		m_publishedSegments.pop_back();
+		m_publishedSegments.back() = segment;
+		for (int id = 0; id < HASH_TABLE_SIZE; id++)
+		{
+			if (m_publishedGeneration[id] == older->generation() || m_publishedGeneration[id] == newer->generation())
+				m_publishedGeneration[id] = generation;
+		}
+	}
+	return true;
+}
+
+void IndexerImpl::publishSnapshot()
+{
+	std::shared_ptr<IndexSnapshotImpl> next = std::make_shared<IndexSnapshotImpl>();
+	{
+		std::lock_guard<std::mutex> lock(m_segmentMutex);
+		next->segments = m_segments;
+		next->owner = m_docOwner;
+		m_republishNeeded = false;
+	}
+
+	// In-memory pages are found in the published segment that holds them
+	for (int id = 0; id < HASH_TABLE_SIZE; id++)
+	{
+		if (next->owner[id] == MEMORY_SEGMENT)
+			next->owner[id] = m_publishedGeneration[id];
+	}
+	next->segments.insert(next->segments.end(), m_publishedSegments.begin(), m_publishedSegments.end());
+	next->deleted = m_deleted;
+	next->lengths = std::make_shared<DocumentLengths>(m_docLengths);
+
+	// Positions are frozen again only if they changed since the last snapshot
+	if (m_positionsEnabled)
+	{
+		if (m_positionsChanged || !m_publishedPositions)
+		{
+			std::string buf;
+			m_positions.freeze(buf);
+			std::shared_ptr<FrozenPositions> positions = std::make_shared<FrozenPositions>();
+			positions->openBuffer(buf);
+			m_publishedPositions = positions;
+			m_positionsChanged = false;
+		}
+		next->positions = m_publishedPositions;
+	}
+
+	std::atomic_store(&m_published, std::shared_ptr<const IndexSnapshotImpl>(next));
+	m_changesSincePublish = 0;
+}
+
+void IndexerImpl::attachLog(std::string filenameBase, bool fresh)
+{
+	detachLog();
+
+	// A fresh full save under this name replaces whatever was logged for it
+	if (fresh)
+	{
+		std::remove((filenameBase + ".wal").c_str());
+		std::remove((filenameBase + ".wal.old").c_str());
+		std::remove((filenameBase + ".ckpt.done").c_str());
+	}
+
+	// The file itself is only opened, and the files under this name put in
+	// order after a crash (see recoverLog), once there is something to log, so
+	// indexes that are loaded just to be searched never write to them
+	m_logBase = filenameBase;
+	m_logRecovered = fresh;
+	if (fresh)
+		m_tornLogs.clear();
+}
+
+void IndexerImpl::detachLog()
+{
+	m_log.close();
+	m_logBase.clear();
+}
 
-	if (existingBucketCheck == true)
+void IndexerImpl::logPage(char tag, const std::string& url, WordBag& wb, unsigned long long fingerprint)
+{
+	if (m_logBase.empty())
+		return;
+
+	std::string body;
+	putString(body, url);
+	if (tag == LOG_FINGERPRINT)
+		putFixed64(body, fingerprint);
+	encodeWordBag(wb, body);
+	logRecord(tag, body);
+}
+
+void IndexerImpl::logRecord(char tag, const std::string& body)
+{
+	if (!m_log.isOpen())
+	{
+		if (!recoverLog() || !m_log.open(m_logBase + ".wal"))
+		{
+			// The next save is a full one instead
+			detachLog();
+			return;
+		}
+		m_loggedPolicy = -1;
+	}
+
+	// Each file says which policy the pages after it were incorporated under
+	bool appended = true;
+	if (m_loggedPolicy != m_nearDuplicatePolicy)
+	{
+		std::string policy;
+		putVarint(policy, m_nearDuplicatePolicy);
+		appended = m_log.append(LOG_POLICY, policy);
+		m_loggedPolicy = m_nearDuplicatePolicy;
+	}
+	if (!appended || !m_log.append(tag, body))
+	{
+		std::cerr << "Error: Cannot append to " << m_logBase << ".wal" << std::endl;
+		detachLog();
+		return;
+	}
+
+	// Replaying a log much bigger than the index it rebuilds would make loading slow
+	if (!m_checkpointRunning && m_log.bytes() >= LOG_CHECKPOINT_MIN_BYTES && m_log.bytes() >= m_memoryBytes)
+		startCheckpoint();
+}
+
+// Finishes what a crash left undone under m_logBase before anything more is
+// written there: a complete checkpoint's files are moved into place, and the
+// torn records load skipped are cut off the logs
+bool IndexerImpl::recoverLog()
+{
+	if (m_logRecovered)
+		return true;
+
+	std::string done;
+	if (readWholeFile(m_logBase + ".ckpt.done", done) && !finishCheckpoint(m_logBase))
 		return false;
 
-	// m_hashTable is used for quick access to hashed url values in roughly O(1) time
-	m_hashTable.insert(convertedId, url);
+	// A .wal.old the checkpoint folded in is gone by now
+	for (unsigned int i = 0; i < m_tornLogs.size(); i++)
+	{
+		std::string contents;
+		if (readWholeFile(m_tornLogs[i].first, contents) && contents.size() > m_tornLogs[i].second &&
+			!replaceWholeFile(m_tornLogs[i].first, contents.substr(0, m_tornLogs[i].second)))
+			return false;
+	}
+	m_tornLogs.clear();
+	m_logRecovered = true;
+	return true;
+}
 
-	// Create/update urlToId, idToUrl, wordToIdCounts objects for saving and loading functions
-	associateHelperUrlIdTrees(url, convertedId);
+// Applies the changes in a log file, which is fine to be missing. The torn
+// record a crash may have left at its end is skipped, and only cut off once
+// the log is written to again (see recoverLog).
+bool IndexerImpl::replayLog(std::string filename)
+{
+	std::string contents;
+	if (!readWholeFile(filename, contents))
+		return true;
 
-	// Update the index. If we reach this point, then the url has not previously been incorporated
-	std::string tempWord;
-	int count;
+	IndexLogReader reader(contents);
+	if (!reader.valid())
+	{
+		std::cerr << "Error: " << filename << " is not an index log" << std::endl;
+		return false;
+	}
 
-	// Indexer m_indexHashed object is updated with the contents of the WordBag (wb) object
-	bool gotAWord = wb.getFirstWord(tempWord, count);
+	// Nothing is logged while the log is being replayed. The pages are
+	// incorporated under the policies the log records, then ours is put back.
+	std::string logBase;
+	logBase.swap(m_logBase);
+	m_log.close();
+	NearDuplicatePolicy policy = m_nearDuplicatePolicy;
 
-	HashedUrlCount tempHashedUrlCount;
+	char tag;
+	const char* body;
+	const char* bodyEnd;
+	bool applied = true;
+	while (applied && reader.next(tag, body, bodyEnd))
+		applied = applyLogRecord(tag, body, bodyEnd);
+	m_logBase.swap(logBase);
+	m_nearDuplicatePolicy = policy;
 
-	while (gotAWord)
+	if (!applied)
 	{
-		tempHashedUrlCount.count = count;
-		tempHashedUrlCount.hashedUrl = convertedId;
+		std::cerr << "Error: corrupt record in " << filename << std::endl;
+		return false;
+	}
+	if (reader.torn())
+	{
+		std::cerr << "Error: discarding the incomplete record at the end of " << filename << std::endl;
+		m_tornLogs.push_back(std::make_pair(filename, reader.goodBytes()));
+	}
+	return true;
+}
 
-		// A vector of type pointer to determine if a vector (UrlCount) of url to int association already exists
-		std::vector<HashedUrlCount>* tempVector = m_indexHashed.find(tempWord);
+bool IndexerImpl::applyLogRecord(char tag, const char* p, const char* end)
+{
+	std::string url;
+	std::string text;
+	unsigned long long fingerprint = 0;
+	if (tag == LOG_REMOVE)
+	{
+		if (!getString(p, end, url))
+			return false;
+		removePage(url);
+		return true;
+	}
 
-		// If no association between url and int exists, simply use a non-pointer HashedUrlCount vector to hold the new
-		// value and create the association
-		if (tempVector == nullptr)
-		{
-			std::vector<HashedUrlCount> tempVectorNonPtr;
-			tempVectorNonPtr.push_back(tempHashedUrlCount);
-			m_indexHashed.associate(tempWord, tempVectorNonPtr);
-		}
+	if (tag == LOG_POLICY)
+	{
+		int policy;
+		if (!getVarint(p, end, policy) || policy < INDEX_NEAR_DUPLICATES || policy > CLUSTER_NEAR_DUPLICATES)
+			return false;
+		m_nearDuplicatePolicy = static_cast<NearDuplicatePolicy>(policy);
+		return true;
+	}
 
-		// If an association DOES exists, use the pointer from above to update the EXISTING vector-type association
-		else
+	if (tag == LOG_BATCH)
+	{
+		int pageCount;
+		if (!getVarint(p, end, pageCount) || pageCount < 0 || pageCount > end - p)
+			return false;
+		std::vector<FetchedPage> pages(pageCount);
+		for (int i = 0; i < pageCount; i++)
 		{
-			tempVector->push_back(tempHashedUrlCount);
-			m_indexHashed.associate(tempWord, *tempVector);
+			if (!getString(p, end, pages[i].url) || !getString(p, end, pages[i].contents))
+				return false;
 		}
+		incorporateAll(pages, 0);
+		return true;
+	}
 
-		gotAWord = wb.getNextWord(tempWord, count);
+	if (!getString(p, end, url) || (tag == LOG_FINGERPRINT && !getFixed64(p, end, fingerprint)) ||
+		!decodeWordBag(p, end, text))
+		return false;
+	WordBag wb(text, m_positionsEnabled);
+	if (tag == LOG_INCORPORATE)
+		incorporatePage(url, wb);
+	else if (tag == LOG_FINGERPRINT)
+		incorporatePage(url, wb, fingerprint);
+	else if (tag == LOG_REPLACE)
+		replacePage(url, wb);
+	else
+		return false;
+	return true;
+}
+
+// Folds the log into the saved index on a thread of its own. The log is
+// renamed to .wal.old and a new one started; the thread then loads the saved
+// index into an indexer of its own, replays .wal.old, and saves the result
+// under filenameBase + ".ckpt". Once those files are all written, a .ckpt.done
+// marker says they are complete, so that if moving them into place is cut
+// short, the next load finishes it (see finishCheckpoint).
+bool IndexerImpl::startCheckpoint()
+{
+	if (m_logBase.empty() || m_checkpointRunning || !recoverLog())
+		return false;
+	waitForCheckpoint();
+
+	// The new records go on to a log of their own. If a checkpoint that failed
+	// left a .wal.old behind, the current log is added to it instead.
+	m_log.close();
+	std::string current = m_logBase + ".wal";
+	std::string old = m_logBase + ".wal.old";
+	std::ifstream probe(old.c_str());
+	if (probe)
+	{
+		probe.close();
+		std::string contents;
+		if (readWholeFile(current, contents) && contents.size() > static_cast<size_t>(LOG_MAGIC_LENGTH) &&
+			!appendToFile(old, contents.substr(LOG_MAGIC_LENGTH)))
+			return false;
+		std::remove(current.c_str());
 	}
+	else if (std::rename(current.c_str(), old.c_str()) != 0)
+		return false;  // nothing has been logged
 
+	m_checkpointRunning = true;
+	m_checkpointThread = std::thread(&IndexerImpl::runCheckpoint, m_logBase, m_nearDuplicatePolicy,
+		m_positionsEnabled, m_bloomOptions, &m_checkpointRunning);
 	return true;
 }
 
-std::vector<UrlCount> IndexerImpl::getUrlCounts(std::string word)
+void IndexerImpl::waitForCheckpoint()
+{
+	if (m_checkpointThread.joinable())
+		m_checkpointThread.join();
+}
+
+void IndexerImpl::runCheckpoint(std::string filenameBase, NearDuplicatePolicy policy, bool positionsEnabled,
+	BloomFilterOptions bloomOptions, std::atomic<bool>* running)
+{
+	std::string checkpointBase = filenameBase + ".ckpt";
+	for (int e = 0; e < SAVE_EXTENSION_COUNT; e++)
+		std::remove((checkpointBase + SAVE_EXTENSIONS[e]).c_str());
+
+	// Nothing is shared with the indexer that started the checkpoint but the
+	// files, none of which it writes until the checkpoint is over
+	bool checkpointed;
+	{
+		IndexerImpl rebuilt;
+		rebuilt.m_nearDuplicatePolicy = policy;
+		rebuilt.m_positionsEnabled = positionsEnabled;
+		rebuilt.setBloomFilter(bloomOptions.falsePositiveRate, bloomOptions.maxBytes);
+		checkpointed = rebuilt.loadIndexFiles(filenameBase) && rebuilt.replayLog(filenameBase + ".wal.old") &&
+			rebuilt.saveFull(checkpointBase) && writeWholeFile(checkpointBase + ".done", "") &&
+			finishCheckpoint(filenameBase);
+	}
+	if (!checkpointed)
+		std::cerr << "Error: checkpoint of " << filenameBase << " failed; its log is kept" << std::endl;
+	*running = false;
+}
+
+// Moves the files of a complete checkpoint into place, then forgets the log it
+// folded in
+bool IndexerImpl::finishCheckpoint(std::string filenameBase)
+{
+	std::string checkpointBase = filenameBase + ".ckpt";
+	for (int e = 0; e < SAVE_EXTENSION_COUNT; e++)
+	{
+		std::string from = checkpointBase + SAVE_EXTENSIONS[e];
+		std::string to = filenameBase + SAVE_EXTENSIONS[e];
+		std::ifstream probe(from.c_str());
+		if (!probe)
+			continue;  // already moved, or not part of this index
+		probe.close();
+		std::remove(to.c_str());
+		if (std::rename(from.c_str(), to.c_str()) != 0)
+		{
+			std::cerr << "Error: Cannot rename " << from << " to " << to << std::endl;
+			return false;
+		}
+	}
+	std::remove((filenameBase + ".wal.old").c_str());
+	std::remove((checkpointBase + ".done").c_str());
+	return true;
+}
+
+std::vector<std::string> IndexSnapshotImpl::getTermsWithPrefix(std::string prefix) const
+{
+	strToLower(prefix);
+
+	std::vector<std::string> terms;
+	for (unsigned int s = 0; s < segments.size(); s++)
+		segments[s]->getTermsWithPrefix(prefix, terms);
+	std::sort(terms.begin(), terms.end());
+	terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+	return terms;
+}
+
+int IndexSnapshotImpl::estimatePostings(std::string word) const
+{
+	strToLower(word);
+
+	int postingCount = 0;
+	for (unsigned int s = 0; s < segments.size(); s++)
+		postingCount += segments[s]->getPostingCount(word);
+	return postingCount;
+}
+
+std::vector<UrlCount> IndexSnapshotImpl::getUrlCounts(std::string word) const
 {
-	// Passed in word is NOT case sensitive, and since all previously associated words have been converted to
-	// lower case, the passed in word here must also be converted to lower case.
 	strToLower(word);
-	std::vector<HashedUrlCount>* temp = m_indexHashed.find(word);
+	std::vector<HashedUrlCount> postings;
+	std::vector<std::string> urls;
+	getLivePostings(word, postings, urls);
 
-	// If the result of find is nullptr, create an empty vector and return
-	if (temp == nullptr)
+	std::vector<UrlCount> urlCounts(postings.size());
+	for (unsigned int i = 0; i < postings.size(); i++)
 	{
-		std::vector<UrlCount> emptyVector;
-		return emptyVector;
+		urlCounts[i].url.swap(urls[i]);
+		urlCounts[i].count = postings[i].count;
 	}
+	return urlCounts;
+}
 
-	// Otherwise convert HashedUrlCount to UrlCount and return the pointer to the found vector
-	std::vector<UrlCount> tempVector;
-	UrlCount copiedVector;
+void IndexSnapshotImpl::getLivePostings(const std::string& word, std::vector<HashedUrlCount>& live,
+	std::vector<std::string>& urls) const
+{
+	live.clear();
+	urls.clear();
+	std::vector<HashedUrlCount> postings;
+	std::string url;
+	for (unsigned int s = 0; s < segments.size(); s++)
+	{
+		if (!segments[s]->getPostings(word, postings))
+			continue;
+
+		// A page's url is stored in the segment that owns it
+		int generation = segments[s]->generation();
+		for (unsigned int i = 0; i < postings.size(); i++)
+		{
+			int id = postings[i].hashedUrl;
+			if (owner[id] != generation || deleted[id] || !segments[s]->findUrl(id, url))
+				continue;
+			live.push_back(postings[i]);
+			urls.push_back(url);
+		}
+	}
+}
 
-	// TODO: Understand why I have to do the following. Couldn't get the pointer version to work
-	std::vector <HashedUrlCount> copiedHashedVector = *temp;
+std::vector<UrlPositions> IndexSnapshotImpl::getUrlPositions(std::string word) const
+{
+	std::vector<UrlPositions> urlPositions;
+	if (!positions)
+		return urlPositions;
+
+	strToLower(word);
+	std::vector<DocPositions> docs;
+	positions->getPositions(word, docs);
 
-	for (unsigned int i = 0; i < temp->size(); i++)
+	UrlPositions entry;
+	for (unsigned int i = 0; i < docs.size(); i++)
 	{
-		copiedVector.count = copiedHashedVector[i].count;
-		copiedVector.url = idToUrl(copiedHashedVector[i].hashedUrl);
-		tempVector.push_back(copiedVector);
+		int id = docs[i].id;
+		if (owner[id] == NO_SEGMENT || deleted[id])
+			continue;
+
+		// The url is stored in the segment that owns the page
+		bool found = false;
+		for (unsigned int s = 0; s < segments.size() && !found; s++)
+		{
+			if (segments[s]->generation() == owner[id])
+				found = segments[s]->findUrl(id, entry.url);
+		}
+		if (!found)
+			continue;
+		entry.positions.swap(docs[i].positions);
+		urlPositions.push_back(entry);
 	}
+	return urlPositions;
+}
 
-	return tempVector;
+std::vector<UrlScore> IndexSnapshotImpl::getUrlScores(std::string word, RankingMode ranking) const
+{
+	strToLower(word);
+	std::vector<HashedUrlCount> postings;
+	std::vector<std::string> urls;
+	getLivePostings(word, postings, urls);
+	std::vector<float> scores;
+	scoreHashedPostings(postings, *lengths, ranking, scores);
+
+	std::vector<UrlScore> urlScores(postings.size());
+	for (unsigned int i = 0; i < postings.size(); i++)
+	{
+		urlScores[i].url.swap(urls[i]);
+		urlScores[i].score = scores[i];
+	}
+	return urlScores;
 }
 
-bool IndexerImpl::save(std::string filenameBase)
+std::vector<UrlScore> IndexSnapshotImpl::scoreUrlCounts(const std::vector<UrlCount>& urlCounts, RankingMode ranking) const
 {
-	// The following association is simply used to be able to pass the size of m_urlToId and m_itToUrl
-	// to the public saveMyMap method which otherwise wouldn't have access to this private data.
-	// This is done in order to meet spec requirements. Otherwise we could easily add a public method
-	// to IndexderImpl to retrieve this value.
-	m_countHolder.associate("", m_hashedMapCount);
+	std::vector<HashedUrlCount> postings(urlCounts.size());
+	for (unsigned int i = 0; i < urlCounts.size(); i++)
+	{
+		postings[i].hashedUrl = urlIdFor(urlCounts[i].url, HASH_TABLE_SIZE);
+		postings[i].count = urlCounts[i].count;
+	}
+	std::vector<float> scores;
+	scoreHashedPostings(postings, *lengths, ranking, scores);
 
-	return saveMyMap(filenameBase + ".ac", m_countHolder) &&	// .ac		= "association count"
-		saveMyMap(filenameBase + ".uti", m_urlToId) &&			// .uti		= "url to id"
-		saveMyMap(filenameBase + ".itu", m_idToUrl) &&			// .itu		= "id to url"
-		saveMyMap(filenameBase + ".wtic", m_indexHashed);		// .wtic	= "word to id counts"
+	std::vector<UrlScore> urlScores(urlCounts.size());
+	for (unsigned int i = 0; i < urlCounts.size(); i++)
+	{
+		urlScores[i].url = urlCounts[i].url;
+		urlScores[i].score = scores[i];
+	}
+	return urlScores;
 }
 
-bool IndexerImpl::load(std::string filenameBase)
+std::shared_ptr<const IndexSnapshotImpl> openSharedIndex(const std::string& filenameBase)
 {
-	// Must refill the hash table
-	ClosedHashTable hashTableCopy;
+	std::shared_ptr<IndexSegment> segment = std::make_shared<IndexSegment>(0);
+	if (!segment->openMapped(filenameBase + ".shared"))
+		return std::shared_ptr<const IndexSnapshotImpl>();
 
-	// Must also transfer over m_hashedMapCount
-	m_hashedMapCount = loadAC(filenameBase + ".ac");
-	if (m_hashedMapCount == -1) // Error loading value from file
-		return false;
+	std::shared_ptr<IndexSnapshotImpl> impl = std::make_shared<IndexSnapshotImpl>();
+	impl->owner.assign(HASH_TABLE_SIZE, NO_SEGMENT);
+	impl->deleted.assign(HASH_TABLE_SIZE, false);
+	int id;
+	std::string url;
+	for (int i = 0; i < segment->docCount(); i++)
+	{
+		segment->getDoc(i, id, url);
+		if (id < HASH_TABLE_SIZE)
+			impl->owner[id] = segment->generation();
+	}
+	impl->segments.push_back(segment);
 
-	bool loadCheck = (
-		loadMyMap(filenameBase + ".uti", m_urlToId) &&
-		loadMyMap(filenameBase + ".itu", m_idToUrl) &&
-		loadWtic(filenameBase + ".wtic", m_indexHashed) &&
-		loadHashTable(m_urlToId, hashTableCopy) );
+	// Files written without lengths can still rank by counts
+	std::shared_ptr<DocumentLengths> lengths = std::make_shared<DocumentLengths>(HASH_TABLE_SIZE);
+	lengths->load(filenameBase + ".len");
+	impl->lengths = lengths;
+	return impl;
+}
 
-	if (!loadCheck)
-		return false;
+//******************** IndexSnapshot functions *******************************
 
-	// Default assignment operator
-	m_hashTable = hashTableCopy;
+IndexSnapshot::IndexSnapshot()
+{
+}
 
-	return true;
+IndexSnapshot::IndexSnapshot(std::shared_ptr<const IndexSnapshotImpl> impl)
+	: m_impl(impl)
+{
 }
 
-int IndexerImpl::urlToId(std::string url)
+std::vector<UrlCount> IndexSnapshot::getUrlCounts(std::string word) const
 {
-	int hashedUrl = m_hashTable.hashString(url);
-	return hashedUrl;
+	if (!m_impl)
+		return std::vector<UrlCount>();
+	return m_impl->getUrlCounts(word);
 }
 
-std::string IndexerImpl::idToUrl(int id)
+std::vector<UrlScore> IndexSnapshot::getUrlScores(std::string word, RankingMode ranking) const
 {
-	// Hash table search function returns a string by reference.
-	std::string originalUrl;
-	m_hashTable.search(id, originalUrl);
-	return originalUrl;
+	if (!m_impl)
+		return std::vector<UrlScore>();
+	return m_impl->getUrlScores(word, ranking);
 }
 
-void IndexerImpl::associateHelperUrlIdTrees(std::string url, int id)
+std::vector<UrlScore> IndexSnapshot::scoreUrlCounts(const std::vector<UrlCount>& urlCounts, RankingMode ranking) const
 {
-	m_urlToId.associate(url, id);
-	m_idToUrl.associate(id, url);
+	if (!m_impl)
+		return std::vector<UrlScore>();
+	return m_impl->scoreUrlCounts(urlCounts, ranking);
+}
 
-	// Update the size count for use in the save and load functions.
-	m_hashedMapCount++;
+std::vector<UrlPositions> IndexSnapshot::getUrlPositions(std::string word) const
+{
+	if (!m_impl)
+		return std::vector<UrlPositions>();
+	return m_impl->getUrlPositions(word);
+}
+
+bool IndexSnapshot::hasPositions() const
+{
+	return m_impl && m_impl->positions;
+}
+
+std::vector<std::string> IndexSnapshot::getTermsWithPrefix(std::string prefix) const
+{
+	if (!m_impl)
+		return std::vector<std::string>();
+	return m_impl->getTermsWithPrefix(prefix);
+}
+
+int IndexSnapshot::estimatePostings(std::string word) const
+{
+	if (!m_impl)
+		return 0;
+	return m_impl->estimatePostings(word);
 }
 
 //******************** Indexer functions *******************************
@@ -173,11 +3215,168 @@ bool Indexer::incorporate(std::string url, WordBag& wb)
 	return m_impl->incorporate(url, wb);
 }
 
+bool Indexer::incorporate(std::string url, WordBag& wb, unsigned long long fingerprint)
+{
+	return m_impl->incorporate(url, wb, fingerprint);
+}
+
+bool Indexer::isUnchanged(std::string url, unsigned long long fingerprint)
+{
+	return m_impl->isUnchanged(url, fingerprint);
+}
+
+void Indexer::setNearDuplicatePolicy(NearDuplicatePolicy policy)
+{
+	m_impl->setNearDuplicatePolicy(policy);
+}
+
+DedupStats Indexer::getDedupStats() const
+{
+	return m_impl->getDedupStats();
+}
+
+std::vector<std::string> Indexer::getNearDuplicates(std::string url)
+{
+	return m_impl->getNearDuplicates(url);
+}
+
+bool Indexer::remove(std::string url)
+{
+	return m_impl->remove(url);
+}
+
+bool Indexer::replace(std::string url, WordBag& wb)
+{
+	return m_impl->replace(url, wb);
+}
+
+void Indexer::compact()
+{
+	m_impl->compact();
+}
+
+bool Indexer::useSegments(std::string filenameBase, int flushThreshold)
+{
+	return m_impl->useSegments(filenameBase, flushThreshold);
+}
+
+int Indexer::incorporateAll(const std::vector<FetchedPage>& pages, int threadCount)
+{
+	return m_impl->incorporateAll(pages, threadCount);
+}
+
+bool Indexer::buildExternal(bool(*nextPage)(std::string& url, std::string& contents), std::string filenameBase,
+	size_t memoryBudget, ExternalBuildStats& stats)
+{
+	return m_impl->buildExternal(nextPage, filenameBase, memoryBudget, stats);
+}
+
+bool Indexer::saveShards(std::string filenameBase, int shardCount)
+{
+	return m_impl->saveShards(filenameBase, shardCount);
+}
+
+bool Indexer::saveShared(std::string filenameBase)
+{
+	return m_impl->saveShared(filenameBase);
+}
+
+void Indexer::setBloomFilter(double falsePositiveRate, size_t maxBytes)
+{
+	m_impl->setBloomFilter(falsePositiveRate, maxBytes);
+}
+
+void Indexer::enablePositions()
+{
+	m_impl->enablePositions();
+}
+
+bool Indexer::positionsEnabled() const
+{
+	return m_impl->positionsEnabled();
+}
+
+void Indexer::freeze()
+{
+	m_impl->freeze(FREEZE_ARENA);
+}
+
+void Indexer::freeze(FreezeMode mode)
+{
+	m_impl->freeze(mode);
+}
+
+void Indexer::setFrequentTerms(double minPageFraction, std::vector<std::string> stopwords)
+{
+	m_impl->setFrequentTerms(minPageFraction, stopwords);
+}
+
+bool Indexer::isFrequentTerm(std::string word)
+{
+	return m_impl->isFrequentTerm(word);
+}
+
+std::vector<UrlScore> Indexer::getUrlScoresAmong(std::string word, const std::vector<std::string>& urls,
+	RankingMode ranking)
+{
+	return m_impl->getUrlScoresAmong(word, urls, ranking);
+}
+
+void Indexer::enableSnapshots()
+{
+	m_impl->enableSnapshots();
+}
+
+IndexSnapshot Indexer::snapshot() const
+{
+	return m_impl->snapshot();
+}
+
 std::vector<UrlCount> Indexer::getUrlCounts(std::string word)
 {
 	return m_impl->getUrlCounts(word);
 }
 
+std::vector<UrlScore> Indexer::getUrlScores(std::string word, RankingMode ranking)
+{
+	return m_impl->getUrlScores(word, ranking);
+}
+
+std::vector<UrlScore> Indexer::scoreUrlCounts(const std::vector<UrlCount>& urlCounts, RankingMode ranking)
+{
+	return m_impl->scoreUrlCounts(urlCounts, ranking);
+}
+
+std::vector<UrlPositions> Indexer::getUrlPositions(std::string word)
+{
+	return m_impl->getUrlPositions(word);
+}
+
+std::vector<std::string> Indexer::getTermsWithPrefix(std::string prefix)
+{
+	return m_impl->getTermsWithPrefix(prefix);
+}
+
+int Indexer::estimatePostings(std::string word)
+{
+	return m_impl->estimatePostings(word);
+}
+
+bool Indexer::checkpoint()
+{
+	return m_impl->startCheckpoint();
+}
+
+void Indexer::waitForCheckpoint()
+{
+	m_impl->waitForCheckpoint();
+}
+
+IndexMemoryStats Indexer::memoryStats()
+{
+	return m_impl->memoryStats();
+}
+
 bool Indexer::save(std::string filenameBase)
 {
 	return m_impl->save(filenameBase);
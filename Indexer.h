@@ -3,7 +3,25 @@
 
 #include "provided.h"
 #include "MyMap.h"
+#include "BinaryIO.h"
+#include "NearDuplicates.h"
+#include "Segment.h"
+#include "Shards.h"
+#include "UrlDictionary.h"
+#include "PositionIndex.h"
+#include "Ranking.h"
+#include "Metrics.h"
+#include "IndexLog.h"
+#include "MappedFile.h"
+#include "FrequentTerms.h"
 #include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <fstream>  // for save and load
 #include <sstream>  // for istringstream
 
@@ -12,6 +30,55 @@
 // 10,007 is the closest prime number after 10,000 (for more equal distribution)
 static const int HASH_TABLE_SIZE = 10007;
 
+// Once more than this fraction of the incorporated urls have been removed, the
+// posting lists they appear in are rewritten without them (see IndexerImpl::compact).
+// Each call that modifies the index rewrites at most COMPACTION_STEP_LISTS lists,
+// so the work of a compaction pass is spread over many calls instead of stalling one.
+static const double COMPACTION_THRESHOLD = 0.2;
+static const int COMPACTION_STEP_LISTS = 256;
+
+// Segmented indexes (see Segment.h and IndexerImpl::useSegments). The in-memory
+// segment is written to disk once it holds SEGMENT_FLUSH_DOCS pages (unless
+// useSegments is given another threshold). Segments are grouped into size
+// tiers, each SEGMENT_MERGE_FACTOR times bigger than the one below, starting at
+// SEGMENT_TIER_BASE_BYTES; whenever a tier holds SEGMENT_MERGE_FACTOR segments
+// the background merge thread combines them into one segment of the next tier.
+static const int SEGMENT_FLUSH_DOCS = 1000;
+static const int SEGMENT_MERGE_FACTOR = 4;
+static const size_t SEGMENT_TIER_BASE_BYTES = 64 * 1024;
+
+// External-memory builds (see IndexerImpl::buildExternal) spill the in-memory
+// segment as a sorted run whenever its estimated size reaches the memory budget,
+// then merge up to EXTERNAL_MERGE_FANIN runs at a time until one is left. The
+// estimate charges each posting its own size and each term its characters plus
+// MEMORY_TERM_OVERHEAD_BYTES for the MyMap node and empty vector holding it.
+static const size_t EXTERNAL_BUILD_BUDGET_BYTES = 256 * 1024 * 1024;
+static const int EXTERNAL_MERGE_FANIN = 64;
+static const size_t MEMORY_TERM_OVERHEAD_BYTES = 96;
+
+// .wtic files are written out through a buffer of about this size, instead of
+// a line at a time
+static const size_t WTIC_WRITE_BUFFER_BYTES = 1024 * 1024;
+
+// The Bloom filter over the in-memory index's terms starts out sized for this
+// many terms and is rebuilt for twice as many whenever it fills up
+static const int MEMORY_TERM_FILTER_MIN_TERMS = 1024;
+
+// Once snapshots are enabled, a new one is published after this many changes
+// to the index (and whenever the set of segments changes)
+static const int SNAPSHOT_PUBLISH_CHANGES = 64;
+
+// Each publish freezes only the pages changed since the last one, into a small
+// segment of its own. The newest two of those are merged while the older is
+// less than this many times the size of the newer, so their sizes grow
+// geometrically: there are only logarithmically many, and each posting is
+// copied logarithmically often.
+static const size_t SNAPSHOT_MERGE_RATIO = 2;
+
+// Special m_docOwner values; segment generations start at 1
+static const int NO_SEGMENT = -1;
+static const int MEMORY_SEGMENT = 0;
+
 // Similar to the UrlCount struct in provided.h but this version potentially saves
 // much more space by using converted lengthy url strings to smaller ints
 struct HashedUrlCount
@@ -20,118 +87,206 @@ struct HashedUrlCount
 	int count;
 };
 
-class ClosedHashTable
+inline bool hashedUrlCountIdLess(const HashedUrlCount& a, const HashedUrlCount& b)
 {
-private:
-	struct Bucket
-	{
-		// Default false used value
-		Bucket()
-		{ 
-			used = false; 
-			hashedId = 0;
-		}
-		int hashedId;
-		std::string originalId;
-		bool used;
-	};
-
-public:
-	void insert(int hashedId, std::string originalId)
-	{
-		int bucket = hashedId;
-		for (int tries = 0; tries < HASH_TABLE_SIZE; tries++)
-		{
-			if (m_buckets[bucket].used == false)
-			{
-				m_buckets[bucket].hashedId = hashedId;
-				m_buckets[bucket].originalId = originalId;
-				m_buckets[bucket].used = true;
-				return;
-			}
-			bucket = (bucket + 1) % HASH_TABLE_SIZE;
-		}
-	}
+	return a.hashedUrl < b.hashedUrl;
+}
 
-	bool search(int hashedId, std::string& originalId)
+// Scores of the live postings of one term (see Ranking.h)
+inline void scoreHashedPostings(const std::vector<HashedUrlCount>& postings, const DocumentLengths& lengths,
+	RankingMode ranking, std::vector<float>& scores)
+{
+	// Gather into flat arrays first so the scoring loop itself does no lookups
+	int n = postings.size();
+	std::vector<int> counts(n);
+	std::vector<int> docLengths(n);
+	for (int i = 0; i < n; i++)
 	{
-		int bucket = hashedId;
-		for (int tries = 0; tries < HASH_TABLE_SIZE; tries++)
-		{
-			if (m_buckets[bucket].used == false)
-				return false;
-	
-			if (m_buckets[bucket].hashedId == hashedId)
-			{
-				// Returns the original url by reference
-				originalId = m_buckets[bucket].originalId;
-				return true;
-			}
-
-			bucket = (bucket + 1) % HASH_TABLE_SIZE;
-		}
-		return false;
+		counts[i] = postings[i].count;
+		docLengths[i] = lengths.get(postings[i].hashedUrl);
 	}
 
-	int hashString(std::string& url)
-	{
-		int total = 0;
+	scores.resize(n);
+	if (n > 0)
+		scorePostings(ranking, n, lengths.docCount(), lengths.averageLength(), &counts[0], &docLengths[0], n, &scores[0]);
+}
 
-		for (unsigned int i = 0; i < url.length(); i++)
-			total = total + (i + 1) * url[i];
+// The data behind an IndexSnapshot. Never modified once published: the
+// segments are immutable, the in-memory index is frozen into a segment held
+// in memory, and the ownership table and deleted bitmap are private copies.
+class IndexSnapshotImpl
+{
+public:
+	std::vector<UrlCount> getUrlCounts(std::string word) const;
+	std::vector<UrlScore> getUrlScores(std::string word, RankingMode ranking) const;
+	std::vector<UrlScore> scoreUrlCounts(const std::vector<UrlCount>& urlCounts, RankingMode ranking) const;
+	std::vector<UrlPositions> getUrlPositions(std::string word) const;
+	std::vector<std::string> getTermsWithPrefix(std::string prefix) const;
+	int estimatePostings(std::string word) const;
+	void getLivePostings(const std::string& word, std::vector<HashedUrlCount>& live, std::vector<std::string>& urls) const;
+
+	std::vector<std::shared_ptr<IndexSegment> > segments;
+	std::vector<int> owner;
+	std::vector<bool> deleted;
+	std::shared_ptr<const DocumentLengths> lengths;
+	std::shared_ptr<const FrozenPositions> positions;  // null unless the index keeps positions
+};
 
-		total = total % HASH_TABLE_SIZE;
+// A posting added to the in-memory index since the last snapshot was
+// published, and which of the page's additions it came from (see
+// IndexerImpl::publishChanges)
+struct UnpublishedPosting
+{
+	std::string term;
+	HashedUrlCount posting;
+	int addition;
+};
 
-		return total;
-	}
+inline bool unpublishedPostingLess(const UnpublishedPosting& a, const UnpublishedPosting& b)
+{
+	if (a.term != b.term)
+		return a.term < b.term;
+	return a.posting.hashedUrl < b.posting.hashedUrl;
+}
 
-	// TODO: REMOVE THE FOLLOWING AFTER TESTING
-	void printHashTable(int start, int end)
+// Partial index built by one incorporateAll worker thread over the pages whose
+// ids fall in its range. Since the ranges are disjoint and ordered, a term's
+// postings from shard 0, shard 1, ... concatenated are sorted by id.
+struct IndexShard
+{
+	struct Doc
 	{
-		if (start < 0 || start >= HASH_TABLE_SIZE)
-			return;
-		if (end < start || end < 0 || end >= HASH_TABLE_SIZE)
-			return;
-
-		for (int i = start; i < end; i++)
-		{
-			std::cerr << i << " "
-				<< m_buckets[i].hashedId << " "
-				<< m_buckets[i].originalId << " "
-				<< m_buckets[i].used << std::endl;
-		}
-	}
+		int id;
+		std::string url;
+		unsigned long long fingerprint;
+		unsigned long long signature;
+		int length;
+	};
 
-private:
-	Bucket m_buckets[HASH_TABLE_SIZE];
+	std::vector<Doc> docs;
+	std::vector<std::pair<std::string, std::vector<HashedUrlCount> > > terms;  // sorted by term
+	std::shared_ptr<PositionIndex> positions;  // only if the index keeps positions
 };
 
 class IndexerImpl
 {
 public:
 	IndexerImpl();  // Constructor
+	~IndexerImpl();
 	bool incorporate(std::string url, WordBag& wb);
+	bool incorporate(std::string url, WordBag& wb, unsigned long long fingerprint);
+	bool isUnchanged(std::string url, unsigned long long fingerprint);
+	void setNearDuplicatePolicy(NearDuplicatePolicy policy);
+	DedupStats getDedupStats() const;
+	std::vector<std::string> getNearDuplicates(std::string url);
+	bool remove(std::string url);
+	bool replace(std::string url, WordBag& wb);
+	void compact();
+	bool useSegments(std::string filenameBase, int flushThreshold);
+	int incorporateAll(const std::vector<FetchedPage>& pages, int threadCount);
+	bool buildExternal(bool(*nextPage)(std::string& url, std::string& contents), std::string filenameBase,
+		size_t memoryBudget, ExternalBuildStats& stats);
+	void setBloomFilter(double falsePositiveRate, size_t maxBytes);
+	void enablePositions();
+	bool positionsEnabled() const;
+	void freeze(FreezeMode mode);
+	void setFrequentTerms(double minPageFraction, std::vector<std::string> stopwords);
+	bool isFrequentTerm(std::string word);
+	std::vector<UrlScore> getUrlScoresAmong(std::string word, const std::vector<std::string>& urls, RankingMode ranking);
+	void enableSnapshots();
+	IndexSnapshot snapshot() const;
 	std::vector<UrlCount> getUrlCounts(std::string word);
+	std::vector<UrlScore> getUrlScores(std::string word, RankingMode ranking);
+	std::vector<UrlScore> scoreUrlCounts(const std::vector<UrlCount>& urlCounts, RankingMode ranking);
+	std::vector<UrlPositions> getUrlPositions(std::string word);
+	std::vector<std::string> getTermsWithPrefix(std::string prefix);
+	int estimatePostings(std::string word);
+	IndexMemoryStats memoryStats();
+	bool startCheckpoint();
+	void waitForCheckpoint();
 	bool save(std::string filenameBase);
+	bool saveShards(std::string filenameBase, int shardCount);
+	bool saveShared(std::string filenameBase);
 	bool load(std::string filenameBase);
 
-	// TODO: REMOVE AFTER TESTING
-	void testPrintHash(int a, int b)
-	{
-		m_hashTable.printHashTable(a, b);
-	}
-
 private:
 	// Private methods
+	bool incorporatePage(std::string url, WordBag& wb);
+	bool incorporatePage(std::string url, WordBag& wb, unsigned long long fingerprint);
+	bool removePage(std::string url);
+	bool replacePage(std::string url, WordBag& wb);
+	bool saveFull(std::string filenameBase);
+	void attachLog(std::string filenameBase, bool fresh);
+	void detachLog();
+	void logPage(char tag, const std::string& url, WordBag& wb, unsigned long long fingerprint);
+	void logRecord(char tag, const std::string& body);
+	bool recoverLog();
+	bool replayLog(std::string filename);
+	bool applyLogRecord(char tag, const char* p, const char* end);
+	static void runCheckpoint(std::string filenameBase, NearDuplicatePolicy policy, bool positionsEnabled,
+		BloomFilterOptions bloomOptions, std::atomic<bool>* running);
+	static bool finishCheckpoint(std::string filenameBase);
 	int urlToId(std::string url);
 	std::string idToUrl(int id);
-	void associateHelperUrlIdTrees(std::string url, int id);
-	int hashString(std::string& url);
+	void addUrl(std::string url, int id);
+	void getAllTerms(std::vector<std::string>& terms);
+	void getLivePostings(const std::string& word, std::vector<HashedUrlCount>& live);
+	void addPostings(int id, WordBag& wb);
+	void removePostings(int id);
+	void buildDocPostings();
+	bool saveFingerprints(std::string filename);
+	bool loadFingerprints(std::string filename);
+	bool admitNearDuplicate(std::string url, WordBag& wb, unsigned long long& signature);
+	bool saveSimHashes(std::string filename);
+	bool loadSimHashes(std::string filename);
+	bool findIncorporated(const std::string& url, int& id);
+	void maintainCompaction();
+	void startCompaction();
+	bool compactStep(int maxLists);
+	void finishCompaction();
+	bool saveDeleted(std::string filename);
+	bool loadDeleted(std::string filename);
+	void setOwner(int id, int owner);
+	std::string segmentFileName(int generation);
+	void maintainSegments();
+	template <typename Writer>
+	void writeMemorySegment(Writer& writer, std::vector<int>& memoryIds);
+	bool writeRun(int& generation, std::vector<int>& memoryIds);
+	void clearMemorySegment();
+	void addMemoryTerm(const std::string& term);
+	void rebuildMemoryTermFilter();
+	bool saveMemoryTermFilter(std::string filename);
+	bool loadMemoryTermFilter(std::string filename);
+	bool savePositions(std::string filename);
+	bool loadPositions(std::string filename);
+	bool loadDocLengths(std::string filename);
+	void rebuildDocLengths();
+	bool flushMemorySegment();
+	bool mergeRuns(const std::vector<int>& runs, int& generation);
+	void clearIndex();
+	bool saveSegmented(std::string filenameBase);
+	bool loadSegmented(std::string filenameBase);
+	void startMerging();
+	void stopMerging();
+	void mergeLoop();
+	bool pickMerge(std::vector<std::shared_ptr<IndexSegment> >& inputs);
+	void buildShard(const std::vector<FetchedPage>& pages, const std::vector<int>& pageIds,
+		const std::vector<int>& pageNumbers, IndexShard& shard);
+	void mergeShards(std::vector<IndexShard>& shards);
+	bool loadIndexFiles(std::string filenameBase, bool checkpointed = false);
+	bool loadLegacyUrls(std::string filename);
+	void thaw();
+	void tierFrequentTerms();
+	void maintainSnapshots();
+	void publish();
+	void publishChanges();
+	void addPublishedSegment(SegmentWriter& writer, const std::vector<int>& ids);
+	bool mergePublishedSegments();
+	void publishSnapshot();
 
 	// Private data members
-	ClosedHashTable m_hashTable;
-	MyMap<std::string, int> m_urlToId;
-	MyMap<int, std::string> m_idToUrl;
+	// Every incorporated url, stored once (see UrlDictionary.h)
+	UrlDictionary m_urls;
 	MyMap<std::string, int> m_countHolder;  // Used to hold just one value: m_hashedMapCount to meet spec requirements
 	int m_hashedMapCount;
 
@@ -140,28 +295,134 @@ private:
 
 	// More space efficient version of m_index used for saving and loading
 	MyMap < std::string, std::vector<HashedUrlCount> > m_indexHashed;
-};
 
-// TEMPLATE FUNCTIONS 
-template <class KeyType, class ValueType>
-bool loadHashTable(MyMap<KeyType, ValueType>& m, ClosedHashTable& cht)
-{
-	// MyMap <key, value> type of <Url to Id> (ex. "www.a.com" -> 4221)
-	KeyType tempKey;
-	ValueType* tempValue = m.getFirst(tempKey);
-
-	if (tempValue == nullptr)
-		return false;
+	// Bloom filter over the terms in m_indexHashed (segments carry their own),
+	// so lookups of words that were never incorporated skip the tree walk. The
+	// merge thread reads m_bloomOptions too, so it is only set under m_segmentMutex.
+	BloomFilterOptions m_bloomOptions;
+	BloomFilter m_memoryTermFilter;
+	int m_memoryTermCount;
+	int m_memoryTermFilterCapacity;
+
+	// Length in tokens of each page, for ranking (see Ranking.h)
+	DocumentLengths m_docLengths;
+
+	// Token positions of each page, kept only once enablePositions has been
+	// called (or an index with positions has been loaded). They stay in memory
+	// whether or not the page's postings are in a segment.
+	bool m_positionsEnabled;
+	PositionIndex m_positions;
+	bool m_positionsChanged;  // since m_publishedPositions was frozen
+	std::shared_ptr<const FrozenPositions> m_publishedPositions;
+
+	// Content fingerprint of each incorporated page (see contentFingerprint)
+	MyMap<int, unsigned long long> m_fingerprints;
+
+	// Forward index from a url id to the posting vectors it appears in, so a changed
+	// page's old postings can be removed without scanning the whole index. It is only
+	// needed once a page actually changes, so it is built on first use and kept up
+	// to date from then on.
+	MyMap<int, std::vector<std::vector<HashedUrlCount>*> > m_docPostings;
+	bool m_docPostingsBuilt;
+
+	// Near-duplicate detection (see NearDuplicates.h). m_clusters maps the id of an
+	// indexed page to the urls that were clustered with it instead of being indexed.
+	NearDuplicatePolicy m_nearDuplicatePolicy;
+	SimHashIndex m_simHashes;
+	MyMap<int, std::vector<std::string> > m_clusters;
+	DedupStats m_dedupStats;
+
+	// Removed urls. Their postings stay in m_indexHashed (and are skipped by
+	// getUrlCounts) until a compaction pass rewrites the posting lists they are in;
+	// only then is the url itself forgotten and its id free to be used again.
+	std::vector<bool> m_deleted;
+	int m_deletedCount;
+
+	// State of the compaction pass in progress, if any: the posting lists still to
+	// be rewritten and the ids that will be forgotten once they all have been
+	std::vector<std::vector<HashedUrlCount>*> m_compactionQueue;
+	std::vector<int> m_compactingIds;
+
+	// Segmented index state (m_segmentBase is empty for a plain index). Each url id
+	// is owned by the one place its live postings are in: m_indexHashed
+	// (MEMORY_SEGMENT) or the segment with that generation. Postings for the id
+	// found anywhere else are from an older version of the page and are ignored.
+	std::string m_segmentBase;
+	int m_segmentFlushDocs;
+	int m_memoryDocs;
+	size_t m_memoryBytes;  // estimated size of m_indexHashed
+	int m_nextGeneration;
+	std::vector<int> m_docOwner;
+	std::vector<std::shared_ptr<IndexSegment> > m_segments;
+	std::vector<std::string> m_obsoleteSegmentFiles;  // merged away; deleted by the next save
+
+	// Words on at least m_frequentTermFraction of the pages, and the stopwords,
+	// are moved into m_frequentTerms when a plain index is frozen (see
+	// FrequentTerms.h). Their bits only count for pages the frozen segment,
+	// m_frequentTermsOwner, still owns.
+	double m_frequentTermFraction;  // 0 for none
+	std::vector<std::string> m_stopwords;  // sorted
+	FrequentTermTier m_frequentTerms;
+	int m_frequentTermsOwner;
+
+	// The merge thread only touches the members above, always under m_segmentMutex
+	std::mutex m_segmentMutex;
+	std::condition_variable m_mergeWake;
+	std::thread m_mergeThread;
+	bool m_stopMerging;
+
+	// Published snapshot, read by other threads with std::atomic_load only. The
+	// merge thread can't publish (the in-memory index belongs to the writer), so
+	// it just asks for the next publish to happen right away.
+	std::shared_ptr<const IndexSnapshotImpl> m_published;
+	bool m_snapshotsEnabled;
+	int m_changesSincePublish;
+	std::atomic<bool> m_republishNeeded;
+
+	// The in-memory index as published: frozen segments, oldest first, with
+	// generations of their own below NO_SEGMENT. m_publishedGeneration[id] is
+	// the one holding in-memory page id. The pages and postings added since (by
+	// addPostings) are in m_unpublishedIds and m_unpublished,
+	// m_unpublishedAddition[id] being the number of the latest addition for page
+	// id, or -1. Anything else that changes the in-memory index sets
+	// m_publishAll, and the next publish freezes all of it again.
+	std::vector<std::shared_ptr<IndexSegment> > m_publishedSegments;
+	std::vector<int> m_publishedGeneration;
+	int m_nextPublishedGeneration;
+	std::vector<int> m_unpublishedIds;
+	std::vector<UnpublishedPosting> m_unpublished;
+	std::vector<int> m_unpublishedAddition;
+	int m_unpublishedAdditions;
+	bool m_publishAll;
+
+	// Write-ahead log of the changes since the index was last saved in full under
+	// m_logBase (empty when nothing is being logged; see IndexLog.h), and the
+	// thread folding an older log into that save, if one is running
+	std::string m_logBase;
+	IndexLog m_log;
+	int m_loggedPolicy;  // last policy recorded in m_log's file, -1 if none yet
+
+	// Whether the files under m_logBase are in order to be written to, and the
+	// logs load replayed only up to a torn record (file, bytes before it)
+	bool m_logRecovered;
+	std::vector<std::pair<std::string, size_t> > m_tornLogs;
+	std::thread m_checkpointThread;
+	std::atomic<bool> m_checkpointRunning;
+};
 
-	while (tempValue != nullptr)
-	{
-		cht.insert(*tempValue, tempKey);
-		tempValue = m.getNext(tempKey);
-	}
+// Snapshot of a shared index file (see Indexer::saveShared) mapped read-only,
+// or null if it can't be opened. All it holds apart from the mapping is the
+// ownership table, deleted bitmap and page lengths, a few bytes per possible id.
+std::shared_ptr<const IndexSnapshotImpl> openSharedIndex(const std::string& filenameBase);
 
-	return true;
-}
+// The .wtic file of a plain index (see Indexer.cpp). Terms are read in the
+// order they are in the file, which is increasing unless an older version wrote it.
+bool saveWtic(const std::string& filename, MyMap<std::string, std::vector<HashedUrlCount> >& index);
+bool readWtic(const std::string& filename, std::vector<std::pair<std::string, std::vector<HashedUrlCount> > >& terms);
+bool wticTermLess(const std::pair<std::string, std::vector<HashedUrlCount> >& a,
+	const std::pair<std::string, std::vector<HashedUrlCount> >& b);
 
+// TEMPLATE FUNCTIONS 
 inline void writeItem(std::ostream& stream, std::string s)
 {
 	stream << s << std::endl;
@@ -212,8 +473,8 @@ inline bool readItem(std::istream& stream, int& i)
 	std::string line;
 	if (!getline(stream, line))
 	{
-		std::cerr << "LINE " << __LINE__ << ": Error loading int/string "
-			<< __FILE__ << std::endl;
+		// Also how the end of a file is found, so not reported
+		METRIC_ADD(COUNTER_READ_ITEM_FAILURES, 1);
 		return false;
 	}
 
@@ -224,8 +485,7 @@ inline bool readItem(std::istream& stream, int& i)
 	//std::cerr << "int: " << i << std::endl;
 	if (!iss)
 	{
-		std::cerr << "LINE " << __LINE__ << ": Error loading istringstream "
-			<< __FILE__ << std::endl;
+		METRIC_ADD(COUNTER_READ_ITEM_FAILURES, 1);
 		return false;
 	}
 	else
@@ -322,60 +582,6 @@ void fillInUtiItuFile(std::istream& stream, int count, MyMap<KeyType, ValueType>
 	}
 }
 
-inline void fillLoadingVector(std::istream& stream, MyMap<std::string, std::vector<HashedUrlCount> >& m, int count,
-	std::vector<HashedUrlCount>& vec)
-{
-	// Clear vector of prior values
-	vec.clear();
-
-	// Contents of a HashedUrlCount object
-	HashedUrlCount temp;
-	int tempHashedUrl;
-	int tempCount;
-
-	for (int i = 0; i < count / 2; i++)
-	{
-		readItem(stream, tempHashedUrl);
-		readItem(stream, tempCount);
-		//std::cerr << "tempHashedUrl: " << tempHashedUrl << std::endl;
-		//std::cerr << "tempCount: " << tempCount << std::endl;
-		temp.hashedUrl = tempHashedUrl;
-		temp.count = tempCount;
-		vec.push_back(temp);
-	}
-
-
-}
-
-inline void fillInWticFile(std::istream& stream, MyMap<std::string, std::vector<HashedUrlCount> >& m)
-{
-	std::string tempWord;
-	std::vector<HashedUrlCount> tempVec;
-	int tempVectorCount;
-	int counter = 0;
-
-	// TODO: FIX BUG HERE (PROBABLY HAS TO DO WITH TEMPLATED FUNCTIONS BEING IN THIS FILE
-	// CURRENTLY WORKS WITH THIS WORK-AROUND FUNCTION AND fillLoadingVector ^^above
-
-	for (;;)
-	{
-		if (counter % 2 != 0)  // Odd numbers
-		{
-			if (!readItem(stream, tempVectorCount))
-				break;
-
-			fillLoadingVector(stream, m, tempVectorCount, tempVec);
-		}
-		else
-		{
-			if (!readItem(stream, tempWord))
-				break;
-		}
-		m.associate(tempWord, tempVec);
-		counter++;
-	}
-}
-
 template <class KeyType, class ValueType>
 bool loadMyMap(std::string filename, MyMap<KeyType, ValueType>& m)
 {
@@ -417,13 +623,6 @@ bool loadMyMap(std::string filename, MyMap<KeyType, ValueType>& m)
 		return true;
 	}
 
-	//else if (getFileExtension(filename) == "wtic")
-	//{
-
-	//fillInWticFile(stream, m);
-	//return true;
-	//}
-
 	else
 	{
 		std::cerr << "Error: unrecognized file extension" << std::endl;
@@ -431,25 +630,6 @@ bool loadMyMap(std::string filename, MyMap<KeyType, ValueType>& m)
 	}
 }
 
-inline bool loadWtic(std::string filename, MyMap<std::string, std::vector<HashedUrlCount> >& m)
-{
-	std::ifstream stream(filename);
-	if (!stream)
-	{
-		std::cerr << "Error: Cannot read from " << filename << std::endl;
-		return false;
-	}
-
-	if (getFileExtension(filename) == "wtic")
-	{
-
-		fillInWticFile(stream, m);
-		return true;
-	}
-	else
-		return false;
-}
-
 inline int loadAC(std::string filename)
 {
 	std::ifstream stream(filename);
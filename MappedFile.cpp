@@ -0,0 +1,217 @@
+#include "MappedFile.h"
+#include <algorithm>
+
+#ifdef _MSC_VER  // Windows
+#include <windows.h>
+#else  //  Mac OS X and LINUX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	m_data = nullptr;
+	m_size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+	close();
+
+	// The file and mapping handles can be closed as soon as the view exists;
+	// the view keeps the file open until it is unmapped
+#ifdef _MSC_VER
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+	if (size.QuadPart == 0)  // can't be mapped, but is a perfectly good empty file
+	{
+		CloseHandle(file);
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL)
+		return false;
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (view == NULL)
+		return false;
+
+	m_data = static_cast<const char*>(view);
+	m_size = static_cast<size_t>(size.QuadPart);
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode))
+	{
+		::close(fd);
+		return false;
+	}
+	if (status.st_size == 0)
+	{
+		::close(fd);
+		return true;
+	}
+
+	void* view = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED)
+		return false;
+
+	m_data = static_cast<const char*>(view);
+	m_size = static_cast<size_t>(status.st_size);
+#endif
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_data != nullptr)
+	{
+#ifdef _MSC_VER
+		UnmapViewOfFile(m_data);
+#else
+		munmap(const_cast<char*>(m_data), m_size);
+#endif
+	}
+	m_data = nullptr;
+	m_size = 0;
+}
+
+const char* MappedFile::data() const
+{
+	return m_data;
+}
+
+size_t MappedFile::size() const
+{
+	return m_size;
+}
+
+//******************** MemoryArena functions *******************************
+
+MemoryArena::MemoryArena()
+{
+	m_data = nullptr;
+	m_size = 0;
+	m_hugePages = false;
+}
+
+MemoryArena::~MemoryArena()
+{
+	release();
+}
+
+bool MemoryArena::allocate(size_t bytes, bool hugePages)
+{
+	release();
+	if (bytes == 0)
+		return true;
+
+#ifdef _MSC_VER
+	SIZE_T largePage = hugePages ? GetLargePageMinimum() : 0;
+	if (largePage > 0)
+	{
+		size_t rounded = (bytes + largePage - 1) / largePage * largePage;
+		void* block = VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (block != NULL)
+		{
+			m_data = static_cast<char*>(block);
+			m_size = rounded;
+			m_hugePages = true;
+			return true;
+		}
+	}
+
+	void* block = VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (block == NULL)
+		return false;
+	m_data = static_cast<char*>(block);
+	m_size = bytes;
+#else
+	// Huge pages only back whole, aligned huge pages of the range, so the
+	// range is over-allocated by one and the slack on either side given back
+	size_t rounded = hugePages ? (bytes + ARENA_HUGE_PAGE_BYTES - 1) / ARENA_HUGE_PAGE_BYTES * ARENA_HUGE_PAGE_BYTES :
+		bytes;
+	size_t reserved = hugePages ? rounded + ARENA_HUGE_PAGE_BYTES : rounded;
+	void* block = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (block == MAP_FAILED)
+		return false;
+
+	char* start = static_cast<char*>(block);
+	if (hugePages)
+	{
+		size_t misalignment = reinterpret_cast<size_t>(start) % ARENA_HUGE_PAGE_BYTES;
+		size_t head = misalignment == 0 ? 0 : ARENA_HUGE_PAGE_BYTES - misalignment;
+		size_t tail = reserved - head - rounded;
+		if (head > 0)
+			munmap(start, head);
+		if (tail > 0)
+			munmap(start + head + rounded, tail);
+		start += head;
+#ifdef MADV_HUGEPAGE
+		m_hugePages = madvise(start, rounded, MADV_HUGEPAGE) == 0;
+#endif
+	}
+	m_data = start;
+	m_size = rounded;
+#endif
+	return true;
+}
+
+void MemoryArena::release()
+{
+	if (m_data != nullptr)
+	{
+#ifdef _MSC_VER
+		VirtualFree(m_data, 0, MEM_RELEASE);
+#else
+		munmap(m_data, m_size);
+#endif
+	}
+	m_data = nullptr;
+	m_size = 0;
+	m_hugePages = false;
+}
+
+void MemoryArena::swap(MemoryArena& other)
+{
+	std::swap(m_data, other.m_data);
+	std::swap(m_size, other.m_size);
+	std::swap(m_hugePages, other.m_hugePages);
+}
+
+char* MemoryArena::data() const
+{
+	return m_data;
+}
+
+size_t MemoryArena::size() const
+{
+	return m_size;
+}
+
+bool MemoryArena::hugePages() const
+{
+	return m_hugePages;
+}
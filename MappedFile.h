@@ -0,0 +1,67 @@
+#ifndef MAPPEDFILE_INCLUDED
+#define MAPPEDFILE_INCLUDED
+
+#include <string>
+#include <cstddef>
+
+// A whole file mapped read-only into memory. The operating system pages it in
+// as it is read, so opening even a very large file costs next to nothing until
+// its contents are actually used.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::string& filename);  // false (and closed) if it can't be mapped
+	void close();
+
+	const char* data() const;  // null for an empty or closed file
+	size_t size() const;
+
+private:
+	const char* m_data;
+	size_t m_size;
+
+	// The mapping belongs to one object only
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+};
+
+// Huge pages are assumed to be this big where the system doesn't say otherwise
+static const size_t ARENA_HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
+// One contiguous block of memory mapped straight from the operating system
+// instead of allocated from the heap, for data that is written once and then
+// only read (see IndexerImpl::freeze). Packing such data into one arena means
+// scans over it touch as few pages, and TLB entries, as possible; backed by
+// huge pages, a handful of entries cover all of it. Its pages are placed, like
+// any others, on the NUMA node of the thread that first writes them.
+class MemoryArena
+{
+public:
+	MemoryArena();
+	~MemoryArena();
+
+	// Maps at least bytes of zeroed memory. With hugePages it is asked to be
+	// backed by huge pages (transparent huge pages on Linux, large pages on
+	// Windows when the process may use them); ordinary pages are used where
+	// that isn't possible.
+	bool allocate(size_t bytes, bool hugePages);
+	void release();
+	void swap(MemoryArena& other);
+
+	char* data() const;  // null for an empty arena
+	size_t size() const;
+	bool hugePages() const;  // whether huge pages were granted (or, on Linux, requested)
+
+private:
+	char* m_data;
+	size_t m_size;
+	bool m_hugePages;
+
+	MemoryArena(const MemoryArena&);
+	MemoryArena& operator=(const MemoryArena&);
+};
+
+#endif // MAPPEDFILE_INCLUDED
@@ -0,0 +1,279 @@
+#include "Metrics.h"
+#include "BinaryIO.h"
+#include <algorithm>
+#include <sstream>
+
+static const char* const COUNTER_NAMES[METRIC_COUNTER_COUNT] =
+{
+	"pagesFetched",
+	"fetchFailures",
+	"bytesFetched",
+	"tokens",
+	"pagesIncorporated",
+	"searches",
+	"partialSearches",
+	"postingsScored",
+	"searchResults",
+	"readItemFailures"
+};
+
+static const char* const GAUGE_NAMES[METRIC_GAUGE_COUNT] =
+{
+	"memoryIndexBytes",
+	"segments",
+	"deletedUrls"
+};
+
+static const char* const HISTOGRAM_NAMES[METRIC_HISTOGRAM_COUNT] =
+{
+	"fetch",
+	"tokenize",
+	"incorporate",
+	"save",
+	"load",
+	"search",
+	"searchParse",
+	"searchPostings",
+	"searchMerge",
+	"searchSort"
+};
+
+//******************** LatencyHistogram functions *******************************
+
+LatencyHistogram::LatencyHistogram()
+{
+	clear();
+}
+
+void LatencyHistogram::record(unsigned long long nanoseconds)
+{
+	m_buckets[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+	unsigned long long max = m_max.load(std::memory_order_relaxed);
+	while (nanoseconds > max && !m_max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+		;
+}
+
+void LatencyHistogram::clear()
+{
+	for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+		m_buckets[b].store(0, std::memory_order_relaxed);
+	m_count.store(0, std::memory_order_relaxed);
+	m_sum.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+unsigned long long LatencyHistogram::count() const
+{
+	return m_count.load(std::memory_order_relaxed);
+}
+
+unsigned long long LatencyHistogram::max() const
+{
+	return m_max.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const
+{
+	unsigned long long n = count();
+	return n == 0 ? 0 : static_cast<double>(m_sum.load(std::memory_order_relaxed)) / n;
+}
+
+unsigned long long LatencyHistogram::percentile(double fraction) const
+{
+	unsigned long long n = count();
+	if (n == 0)
+		return 0;
+
+	// The bucket holding the value that fraction of the recorded values are at or below
+	unsigned long long rank = static_cast<unsigned long long>(fraction * n);
+	if (rank >= n)
+		rank = n - 1;
+	unsigned long long seen = 0;
+	for (int b = 0; b < HISTOGRAM_BUCKETS; b++)
+	{
+		seen += m_buckets[b].load(std::memory_order_relaxed);
+		if (seen > rank)
+			return std::min(bucketLimit(b), max());
+	}
+	return max();
+}
+
+// Values below 2 * HISTOGRAM_SUB_BUCKETS have a bucket each. Above that, a
+// value whose highest bit is bit k falls in one of the HISTOGRAM_SUB_BUCKETS
+// equal slices of [2^k, 2^(k+1)), picked by the bits just below the highest.
+int LatencyHistogram::bucketOf(unsigned long long value)
+{
+	if (value < static_cast<unsigned long long>(2 * HISTOGRAM_SUB_BUCKETS))
+		return static_cast<int>(value);
+
+	int shift = 0;
+	while ((value >> shift) >= static_cast<unsigned long long>(2 * HISTOGRAM_SUB_BUCKETS))
+		shift++;
+	int bucket = (shift + 1) * HISTOGRAM_SUB_BUCKETS + static_cast<int>(value >> shift) - HISTOGRAM_SUB_BUCKETS;
+	return std::min(bucket, HISTOGRAM_BUCKETS - 1);
+}
+
+unsigned long long LatencyHistogram::bucketLimit(int bucket)
+{
+	if (bucket < 2 * HISTOGRAM_SUB_BUCKETS)
+		return bucket;
+
+	int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+	unsigned long long slice = bucket % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+	return ((slice + 1) << shift) - 1;
+}
+
+//******************** MetricsRegistry functions *******************************
+
+MetricsRegistry& MetricsRegistry::get()
+{
+	static MetricsRegistry registry;
+	return registry;
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+	for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+		m_counters[c].store(0);
+	for (int g = 0; g < METRIC_GAUGE_COUNT; g++)
+		m_gauges[g].store(0);
+}
+
+void MetricsRegistry::reset()
+{
+	for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+		m_counters[c].store(0, std::memory_order_relaxed);
+	for (int g = 0; g < METRIC_GAUGE_COUNT; g++)
+		m_gauges[g].store(0, std::memory_order_relaxed);
+	for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++)
+		m_histograms[h].clear();
+}
+
+std::string MetricsRegistry::dump(MetricsFormat format) const
+{
+	// Latencies are reported in microseconds
+	std::ostringstream out;
+	if (format == METRICS_JSON)
+	{
+		out << "{\"counters\": {";
+		for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+			out << (c == 0 ? "" : ", ") << "\"" << COUNTER_NAMES[c] << "\": " << m_counters[c].load(std::memory_order_relaxed);
+		out << "}, \"gauges\": {";
+		for (int g = 0; g < METRIC_GAUGE_COUNT; g++)
+			out << (g == 0 ? "" : ", ") << "\"" << GAUGE_NAMES[g] << "\": " << m_gauges[g].load(std::memory_order_relaxed);
+		out << "}, \"histograms\": {";
+		for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++)
+		{
+			const LatencyHistogram& histogram = m_histograms[h];
+			out << (h == 0 ? "" : ", ") << "\"" << HISTOGRAM_NAMES[h] << "\": {\"count\": " << histogram.count()
+				<< ", \"meanMicroseconds\": " << histogram.mean() / 1000
+				<< ", \"p50Microseconds\": " << histogram.percentile(0.50) / 1000.0
+				<< ", \"p99Microseconds\": " << histogram.percentile(0.99) / 1000.0
+				<< ", \"p999Microseconds\": " << histogram.percentile(0.999) / 1000.0
+				<< ", \"maxMicroseconds\": " << histogram.max() / 1000.0 << "}";
+		}
+		out << "}}\n";
+		return out.str();
+	}
+
+	for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+		out << "counter " << COUNTER_NAMES[c] << " " << m_counters[c].load(std::memory_order_relaxed) << "\n";
+	for (int g = 0; g < METRIC_GAUGE_COUNT; g++)
+		out << "gauge " << GAUGE_NAMES[g] << " " << m_gauges[g].load(std::memory_order_relaxed) << "\n";
+	for (int h = 0; h < METRIC_HISTOGRAM_COUNT; h++)
+	{
+		const LatencyHistogram& histogram = m_histograms[h];
+		out << "histogram " << HISTOGRAM_NAMES[h] << " count " << histogram.count()
+			<< " mean " << histogram.mean() / 1000 << "us"
+			<< " p50 " << histogram.percentile(0.50) / 1000.0 << "us"
+			<< " p99 " << histogram.percentile(0.99) / 1000.0 << "us"
+			<< " p999 " << histogram.percentile(0.999) / 1000.0 << "us"
+			<< " max " << histogram.max() / 1000.0 << "us\n";
+	}
+	return out.str();
+}
+
+//******************** Free functions *******************************
+
+bool metricsEnabled()
+{
+#ifdef P4_METRICS
+	return true;
+#else
+	return false;
+#endif
+}
+
+std::string dumpMetrics(MetricsFormat format)
+{
+	if (!metricsEnabled())
+		return format == METRICS_JSON ? "{\"enabled\": false}\n" : "metrics compiled out (define P4_METRICS)\n";
+	return MetricsRegistry::get().dump(format);
+}
+
+void resetMetrics()
+{
+	MetricsRegistry::get().reset();
+}
+
+//******************** MetricsExporter functions *******************************
+
+MetricsExporter::MetricsExporter()
+{
+	m_format = METRICS_TEXT;
+	m_intervalSeconds = 0;
+	m_stopping = false;
+}
+
+MetricsExporter::~MetricsExporter()
+{
+	stop();
+}
+
+bool MetricsExporter::start(const std::string& filename, MetricsFormat format, double intervalSeconds)
+{
+	stop();
+	if (intervalSeconds <= 0)
+		return false;
+
+	m_filename = filename;
+	m_format = format;
+	m_intervalSeconds = intervalSeconds;
+	m_stopping = false;
+	m_thread = std::thread(&MetricsExporter::exportLoop, this);
+	return true;
+}
+
+void MetricsExporter::stop()
+{
+	if (!m_thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+}
+
+void MetricsExporter::exportLoop()
+{
+	std::chrono::duration<double> interval(m_intervalSeconds);
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;)
+	{
+		if (!m_stopping)
+			m_wake.wait_for(lock, interval);
+
+		// Written one last time when stopping, so the file ends up current
+		bool stopping = m_stopping;
+		lock.unlock();
+		replaceWholeFile(m_filename, dumpMetrics(m_format));
+		lock.lock();
+		if (stopping)
+			break;
+	}
+}
@@ -0,0 +1,203 @@
+#ifndef METRICS_INCLUDED
+#define METRICS_INCLUDED
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Counters, gauges and latency histograms for the crawler, indexer and
+// searcher. The instrumentation is only compiled in when P4_METRICS is
+// defined; otherwise the METRIC_ macros below expand to nothing, so the hot
+// paths are exactly what they were without it. dumpMetrics and
+// MetricsExporter are always there (reporting that metrics are compiled out),
+// so code using them builds either way.
+//
+// Every metric is a fixed slot named by an enum, so recording one is a single
+// relaxed atomic operation with no lookup by name. Histograms are HDR-style:
+// HISTOGRAM_SUB_BUCKETS linear buckets for every power of two, which keeps
+// each recorded latency to within about 6% from a nanosecond to many minutes.
+
+enum MetricCounter
+{
+	COUNTER_PAGES_FETCHED,
+	COUNTER_FETCH_FAILURES,
+	COUNTER_BYTES_FETCHED,
+	COUNTER_TOKENS,
+	COUNTER_PAGES_INCORPORATED,
+	COUNTER_SEARCHES,
+	COUNTER_PARTIAL_SEARCHES,
+	COUNTER_POSTINGS_SCORED,
+	COUNTER_SEARCH_RESULTS,
+	COUNTER_READ_ITEM_FAILURES,	// lines of the text index files that couldn't be read
+	METRIC_COUNTER_COUNT
+};
+
+enum MetricGauge
+{
+	GAUGE_MEMORY_INDEX_BYTES,	// estimated size of the in-memory postings
+	GAUGE_SEGMENTS,
+	GAUGE_DELETED_URLS,			// removed urls still waiting for compaction
+	METRIC_GAUGE_COUNT
+};
+
+enum MetricHistogram
+{
+	HISTOGRAM_FETCH,
+	HISTOGRAM_TOKENIZE,
+	HISTOGRAM_INCORPORATE,
+	HISTOGRAM_SAVE,
+	HISTOGRAM_LOAD,
+	HISTOGRAM_SEARCH,
+	HISTOGRAM_SEARCH_PARSE,
+	HISTOGRAM_SEARCH_POSTINGS,	// per query item
+	HISTOGRAM_SEARCH_MERGE,		// per query item
+	HISTOGRAM_SEARCH_SORT,
+	METRIC_HISTOGRAM_COUNT
+};
+
+enum MetricsFormat
+{
+	METRICS_TEXT,
+	METRICS_JSON
+};
+
+static const int HISTOGRAM_SUB_BUCKETS = 16;
+static const int HISTOGRAM_MAGNITUDES = 48;  // up to 2^48 ns, about 3 days
+static const int HISTOGRAM_BUCKETS = HISTOGRAM_SUB_BUCKETS * HISTOGRAM_MAGNITUDES;
+
+// Latencies in nanoseconds
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+	void record(unsigned long long nanoseconds);
+	void clear();
+
+	unsigned long long count() const;
+	unsigned long long max() const;
+	double mean() const;
+	unsigned long long percentile(double fraction) const;  // upper end of the bucket it falls in
+
+private:
+	static int bucketOf(unsigned long long value);
+	static unsigned long long bucketLimit(int bucket);
+
+	std::atomic<unsigned long long> m_buckets[HISTOGRAM_BUCKETS];
+	std::atomic<unsigned long long> m_count;
+	std::atomic<unsigned long long> m_sum;
+	std::atomic<unsigned long long> m_max;
+};
+
+class MetricsRegistry
+{
+public:
+	static MetricsRegistry& get();
+
+	void add(MetricCounter counter, long long n)
+	{
+		m_counters[counter].fetch_add(n, std::memory_order_relaxed);
+	}
+
+	void set(MetricGauge gauge, long long value)
+	{
+		m_gauges[gauge].store(value, std::memory_order_relaxed);
+	}
+
+	void record(MetricHistogram histogram, unsigned long long nanoseconds)
+	{
+		m_histograms[histogram].record(nanoseconds);
+	}
+
+	std::string dump(MetricsFormat format) const;
+	void reset();
+
+private:
+	MetricsRegistry();
+
+	std::atomic<long long> m_counters[METRIC_COUNTER_COUNT];
+	std::atomic<long long> m_gauges[METRIC_GAUGE_COUNT];
+	LatencyHistogram m_histograms[METRIC_HISTOGRAM_COUNT];
+
+	MetricsRegistry(const MetricsRegistry&);
+	MetricsRegistry& operator=(const MetricsRegistry&);
+};
+
+// Records the time from its construction to the end of its scope
+class ScopedMetricTimer
+{
+public:
+	ScopedMetricTimer(MetricHistogram histogram)
+		: m_histogram(histogram), m_start(std::chrono::steady_clock::now())
+	{
+	}
+
+	~ScopedMetricTimer()
+	{
+		MetricsRegistry::get().record(m_histogram, std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - m_start).count());
+	}
+
+private:
+	MetricHistogram m_histogram;
+	std::chrono::steady_clock::time_point m_start;
+};
+
+#define METRIC_CONCAT_(a, b) a##b
+#define METRIC_CONCAT(a, b) METRIC_CONCAT_(a, b)
+
+#ifdef P4_METRICS
+#define METRIC_ADD(counter, n) MetricsRegistry::get().add(counter, n)
+#define METRIC_SET(gauge, value) MetricsRegistry::get().set(gauge, value)
+#define METRIC_TIMER(histogram) ScopedMetricTimer METRIC_CONCAT(metricTimer, __LINE__)(histogram)
+// A named clock for stages that aren't a scope of their own: METRIC_LAP records
+// the time since the clock was started (or last lapped) and restarts it
+#define METRIC_CLOCK(clock) std::chrono::steady_clock::time_point clock = std::chrono::steady_clock::now()
+#define METRIC_LAP(histogram, clock) \
+	do \
+	{ \
+		std::chrono::steady_clock::time_point metricNow = std::chrono::steady_clock::now(); \
+		MetricsRegistry::get().record(histogram, \
+			std::chrono::duration_cast<std::chrono::nanoseconds>(metricNow - clock).count()); \
+		clock = metricNow; \
+	} while (false)
+#else
+#define METRIC_ADD(counter, n) ((void)0)
+#define METRIC_SET(gauge, value) ((void)0)
+#define METRIC_TIMER(histogram) ((void)0)
+#define METRIC_CLOCK(clock) ((void)0)
+#define METRIC_LAP(histogram, clock) ((void)0)
+#endif
+
+bool metricsEnabled();
+std::string dumpMetrics(MetricsFormat format = METRICS_TEXT);
+void resetMetrics();
+
+// Writes dumpMetrics to a file every so often from a thread of its own,
+// replacing the file each time, until stopped or destroyed
+class MetricsExporter
+{
+public:
+	MetricsExporter();
+	~MetricsExporter();
+	bool start(const std::string& filename, MetricsFormat format, double intervalSeconds);
+	void stop();
+
+private:
+	void exportLoop();
+
+	std::string m_filename;
+	MetricsFormat m_format;
+	double m_intervalSeconds;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stopping;
+
+	MetricsExporter(const MetricsExporter&);
+	MetricsExporter& operator=(const MetricsExporter&);
+};
+
+#endif // METRICS_INCLUDED
@@ -4,6 +4,110 @@
 #include <iostream>
 #include <string>
 #include <queue>
+#include <vector>
+#include <utility>
+#include <cmath>
+#include <algorithm>
+
+// Estimated bookkeeping the heap allocator adds to every block it hands out
+// (a size header, and rounding up to its alignment)
+static const size_t HEAP_BLOCK_OVERHEAD_BYTES = 16;
+
+// Strings up to this long are kept inside the string object itself (in both
+// the Visual C++ and the GNU libraries)
+static const size_t SHORT_STRING_CAPACITY = 15;
+
+// Heap memory a key or value owns beyond its own sizeof: its bytes and the
+// number of blocks they are in. Overloaded for the types the maps hold;
+// anything else owns nothing.
+struct HeapUsage
+{
+	HeapUsage()
+	{
+		bytes = 0;
+		blocks = 0;
+	}
+
+	size_t bytes;
+	size_t blocks;
+};
+
+template <class T>
+void addHeapUsage(const T&, HeapUsage&)
+{
+}
+
+inline void addHeapUsage(const std::string& s, HeapUsage& usage)
+{
+	if (s.capacity() > SHORT_STRING_CAPACITY)
+	{
+		usage.bytes += s.capacity() + 1;
+		usage.blocks++;
+	}
+}
+
+template <class T>
+void addHeapUsage(const std::vector<T>& v, HeapUsage& usage)
+{
+	if (v.capacity() > 0)
+	{
+		usage.bytes += v.capacity() * sizeof(T);
+		usage.blocks++;
+	}
+	for (unsigned int i = 0; i < v.size(); i++)
+		addHeapUsage(v[i], usage);
+}
+
+// Memory taken by a MyMap and the shape of its tree (see MyMap::memoryStats)
+struct MapMemoryStats
+{
+	MapMemoryStats()
+	{
+		nodes = 0;
+		nodeBytes = 0;
+		keyBytes = 0;
+		valueBytes = 0;
+		overheadBytes = 0;
+		height = 0;
+		totalDepth = 0;
+	}
+
+	size_t totalBytes() const
+	{
+		return nodeBytes + keyBytes + valueBytes + overheadBytes;
+	}
+
+	// Height of a perfectly balanced tree with as many nodes
+	int balancedHeight() const
+	{
+		return nodes == 0 ? 0 : static_cast<int>(std::ceil(std::log(nodes + 1.0) / std::log(2.0) - 1e-9));
+	}
+
+	double averageDepth() const
+	{
+		return nodes == 0 ? 0 : static_cast<double>(totalDepth) / nodes;
+	}
+
+	// Adds in the stats of another map; the height is that of the taller one
+	void add(const MapMemoryStats& other)
+	{
+		nodes += other.nodes;
+		nodeBytes += other.nodeBytes;
+		keyBytes += other.keyBytes;
+		valueBytes += other.valueBytes;
+		overheadBytes += other.overheadBytes;
+		height = std::max(height, other.height);
+		totalDepth += other.totalDepth;
+	}
+
+	size_t nodes;
+	size_t nodeBytes;		// the nodes themselves, with the keys' and values' own sizeof
+	size_t keyBytes;		// heap memory the keys own
+	size_t valueBytes;		// heap memory the values own
+	size_t overheadBytes;	// allocator bookkeeping for all of the above
+	int height;				// nodes on the longest path from the root, 0 for an empty map
+	size_t totalDepth;		// sum of the depths of all nodes, the root being at depth 1
+};
 
 template <class KeyType, class ValueType>
 class MyMap
@@ -105,6 +209,53 @@ public:
 		}
 	}
 
+	bool remove(const KeyType& key)
+	{
+		BSTNODE* cur = m_root;
+		while (cur != nullptr && !(key == cur->key))
+		{
+			if (key < cur->key)
+				cur = cur->left;
+			else
+				cur = cur->right;
+		}
+
+		if (cur == nullptr)
+			return false;
+
+		// A node with two children takes over the key and value of its in-order
+		// successor, and the successor (which has no left child) is unlinked instead.
+		// Note that this moves a value to a different node, so pointers previously
+		// returned by find must not be kept across a remove.
+		if (cur->left != nullptr && cur->right != nullptr)
+		{
+			BSTNODE* successor = cur->right;
+			while (successor->left != nullptr)
+				successor = successor->left;
+			cur->key = successor->key;
+			cur->value = successor->value;
+			cur = successor;
+		}
+
+		BSTNODE* child = (cur->left != nullptr) ? cur->left : cur->right;
+		if (child != nullptr)
+			child->parent = cur->parent;
+
+		if (cur->parent == nullptr)
+			m_root = child;
+		else if (cur->parent->left == cur)
+			cur->parent->left = child;
+		else
+			cur->parent->right = child;
+
+		delete cur;
+		m_nodeCounter--;
+
+		// An unfinished getFirst/getNext traversal may refer to the deleted node
+		m_traverseQueue = std::queue<BSTNODE*>();
+		return true;
+	}
+
 	const ValueType* find(const KeyType& key) const
 	{
 		BSTNODE* cur = m_root;
@@ -142,6 +293,9 @@ public:
 
 		BSTNODE* temp = m_root;
 
+		// Drop whatever is left of an earlier traversal that was not run to the end
+		m_traverseQueue = std::queue<BSTNODE*>();
+
 		// Using a queue to complete a level-order traversal
 		addChildrenNodesToQueue(temp);
 
@@ -167,6 +321,78 @@ public:
 		return getValue;
 	}
 
+	// Replaces the contents of the map with items, which must be sorted by key
+	// with no key twice. The tree is built perfectly balanced in time proportional
+	// to the number of items, instead of by associating them one at a time. The
+	// keys and values are swapped out of items, which is left with empty ones.
+	void assignSorted(std::vector<std::pair<KeyType, ValueType> >& items)
+	{
+		clear();
+		m_traverseQueue = std::queue<BSTNODE*>();
+		m_root = buildBalanced(items, 0, items.size(), nullptr);
+		m_nodeCounter = items.size();
+		m_valid = (m_root != nullptr);
+	}
+
+	// Every key in increasing order, with its value
+	void getSortedItems(std::vector<std::pair<const KeyType*, ValueType*> >& items)
+	{
+		items.clear();
+		items.reserve(m_nodeCounter);
+
+		// In-order with an explicit stack, since a degenerate tree can be as deep
+		// as it is big
+		std::vector<BSTNODE*> stack;
+		BSTNODE* cur = m_root;
+		while (cur != nullptr || !stack.empty())
+		{
+			for (; cur != nullptr; cur = cur->left)
+				stack.push_back(cur);
+			cur = stack.back();
+			stack.pop_back();
+			items.push_back(std::make_pair(static_cast<const KeyType*>(&cur->key), &cur->value));
+			cur = cur->right;
+		}
+	}
+
+	// Walks the whole tree, so it takes time proportional to the size of the map
+	MapMemoryStats memoryStats() const
+	{
+		MapMemoryStats stats;
+		HeapUsage keys;
+		HeapUsage values;
+
+		// Depth-first with an explicit stack, since a degenerate tree can be as
+		// deep as it is big
+		std::vector<std::pair<const BSTNODE*, int> > stack;
+		if (m_root != nullptr)
+			stack.push_back(std::make_pair(static_cast<const BSTNODE*>(m_root), 1));
+		while (!stack.empty())
+		{
+			const BSTNODE* cur = stack.back().first;
+			int depth = stack.back().second;
+			stack.pop_back();
+
+			stats.nodes++;
+			stats.totalDepth += depth;
+			if (depth > stats.height)
+				stats.height = depth;
+			addHeapUsage(cur->key, keys);
+			addHeapUsage(cur->value, values);
+
+			if (cur->left != nullptr)
+				stack.push_back(std::make_pair(static_cast<const BSTNODE*>(cur->left), depth + 1));
+			if (cur->right != nullptr)
+				stack.push_back(std::make_pair(static_cast<const BSTNODE*>(cur->right), depth + 1));
+		}
+
+		stats.nodeBytes = stats.nodes * sizeof(BSTNODE);
+		stats.keyBytes = keys.bytes;
+		stats.valueBytes = values.bytes;
+		stats.overheadBytes = (stats.nodes + keys.blocks + values.blocks) * HEAP_BLOCK_OVERHEAD_BYTES;
+		return stats;
+	}
+
 	// Test printing
 	// TODO: Remove 
 	void testPrintIndexInit()
@@ -213,6 +439,8 @@ private:
 
 	// Private methods
 	void freeTree(BSTNODE* cur);
+	BSTNODE* buildBalanced(std::vector<std::pair<KeyType, ValueType> >& items, size_t begin, size_t end,
+		BSTNODE* parent);
 	bool isValid();
 	void addChildrenNodesToQueue(BSTNODE* cur);
 
@@ -236,6 +464,25 @@ void MyMap<KeyType, ValueType>::freeTree(BSTNODE* cur)
 	delete cur;
 }
 
+// The middle item of [begin, end) becomes the root, and each half a subtree,
+// so the recursion is only as deep as the tree it builds
+template <class KeyType, class ValueType>
+typename MyMap<KeyType, ValueType>::BSTNODE* MyMap<KeyType, ValueType>::buildBalanced(
+	std::vector<std::pair<KeyType, ValueType> >& items, size_t begin, size_t end, BSTNODE* parent)
+{
+	if (begin == end)
+		return nullptr;
+
+	size_t middle = begin + (end - begin) / 2;
+	BSTNODE* node = new BSTNODE(KeyType(), ValueType());
+	std::swap(node->key, items[middle].first);
+	std::swap(node->value, items[middle].second);
+	node->parent = parent;
+	node->left = buildBalanced(items, begin, middle, node);
+	node->right = buildBalanced(items, middle + 1, end, node);
+	return node;
+}
+
 template <class KeyType, class ValueType>
 bool MyMap<KeyType, ValueType>::isValid()
 {
@@ -0,0 +1,136 @@
+#ifndef NEARDUPLICATES_INCLUDED
+#define NEARDUPLICATES_INCLUDED
+
+#include "provided.h"
+#include "MyMap.h"
+#include <string>
+#include <vector>
+
+// SimHash signatures with a banded LSH index, used to find pages whose
+// content is nearly the same as a page that is already in the index
+// (mirrors, printer-friendly versions, session-id variants of one url).
+//
+// Two pages whose signatures differ in at most SIMHASH_MAX_DISTANCE bits
+// are near-duplicates. Splitting the 64-bit signature into
+// SIMHASH_MAX_DISTANCE + 1 bands guarantees (pigeonhole) that two such pages
+// agree exactly on at least one band, so only pages sharing a band value
+// ever have to be compared.
+
+static const int SIMHASH_BANDS = 4;
+static const int SIMHASH_BAND_BITS = 64 / SIMHASH_BANDS;
+static const int SIMHASH_MAX_DISTANCE = SIMHASH_BANDS - 1;
+
+// Each term votes on every bit of the signature with its count as weight
+inline unsigned long long simHash(WordBag& wb)
+{
+	int votes[64] = { 0 };
+
+	std::string word;
+	int count;
+	for (bool gotAWord = wb.getFirstWord(word, count); gotAWord; gotAWord = wb.getNextWord(word, count))
+	{
+		unsigned long long h = contentFingerprint(word);
+		for (int bit = 0; bit < 64; bit++)
+			votes[bit] += ((h >> bit) & 1) ? count : -count;
+	}
+
+	unsigned long long signature = 0;
+	for (int bit = 0; bit < 64; bit++)
+	{
+		if (votes[bit] > 0)
+			signature |= 1ULL << bit;
+	}
+	return signature;
+}
+
+inline int hammingDistance(unsigned long long a, unsigned long long b)
+{
+	int distance = 0;
+	for (unsigned long long x = a ^ b; x != 0; x &= x - 1)
+		distance++;
+	return distance;
+}
+
+class SimHashIndex
+{
+public:
+	void clear()
+	{
+		m_signatures.clear();
+		for (int band = 0; band < SIMHASH_BANDS; band++)
+			m_bands[band].clear();
+	}
+
+	// Remember the signature of url id. Re-adding an id replaces its signature;
+	// the band entries of the old one are left behind and filtered out by
+	// findNearDuplicate, which always compares against the current signature.
+	void insert(int id, unsigned long long signature)
+	{
+		m_signatures.associate(id, signature);
+		for (int band = 0; band < SIMHASH_BANDS; band++)
+		{
+			int key = bandValue(signature, band);
+			std::vector<int>* ids = m_bands[band].find(key);
+			if (ids == nullptr)
+				m_bands[band].associate(key, std::vector<int>(1, id));
+			else
+				ids->push_back(id);
+		}
+	}
+
+	// Forget the signature of a removed page. Its band entries stay behind and
+	// are skipped because the id no longer has a signature.
+	void erase(int id)
+	{
+		m_signatures.remove(id);
+	}
+
+	// Returns the id of an indexed page within SIMHASH_MAX_DISTANCE of signature
+	// (other than excludeId), or -1 if there isn't one
+	int findNearDuplicate(unsigned long long signature, int excludeId)
+	{
+		for (int band = 0; band < SIMHASH_BANDS; band++)
+		{
+			std::vector<int>* ids = m_bands[band].find(bandValue(signature, band));
+			if (ids == nullptr)
+				continue;
+
+			for (unsigned int i = 0; i < ids->size(); i++)
+			{
+				int candidate = (*ids)[i];
+				if (candidate == excludeId)
+					continue;
+				unsigned long long* candidateSignature = m_signatures.find(candidate);
+				if (candidateSignature != nullptr &&
+					hammingDistance(*candidateSignature, signature) <= SIMHASH_MAX_DISTANCE)
+					return candidate;
+			}
+		}
+		return -1;
+	}
+
+	// The signatures and all the bands, as if they were one tree
+	MapMemoryStats memoryStats() const
+	{
+		MapMemoryStats stats = m_signatures.memoryStats();
+		for (int band = 0; band < SIMHASH_BANDS; band++)
+			stats.add(m_bands[band].memoryStats());
+		return stats;
+	}
+
+	MyMap<int, unsigned long long>& signatures()
+	{
+		return m_signatures;
+	}
+
+private:
+	static int bandValue(unsigned long long signature, int band)
+	{
+		return static_cast<int>((signature >> (band * SIMHASH_BAND_BITS)) & ((1ULL << SIMHASH_BAND_BITS) - 1));
+	}
+
+	MyMap<int, unsigned long long> m_signatures;
+	MyMap<int, std::vector<int> > m_bands[SIMHASH_BANDS];
+};
+
+#endif // NEARDUPLICATES_INCLUDED
@@ -0,0 +1,366 @@
+#include "PositionIndex.h"
+#include "BinaryIO.h"
+#include <algorithm>
+#include <utility>
+
+
+// Positions from their gaps, which take up [p, end)
+static bool decodeGaps(const char* p, const char* end, std::vector<int>& positions)
+{
+	positions.clear();
+	int position = 0;
+	int gap;
+	while (p != end)
+	{
+		if (!getVarint(p, end, gap))
+			return false;
+		position += gap;
+		positions.push_back(position);
+	}
+	return true;
+}
+
+static void encodeGaps(const std::vector<int>& positions, std::string& gaps)
+{
+	gaps.clear();
+	int previous = 0;
+	for (unsigned int i = 0; i < positions.size(); i++)
+	{
+		putVarint(gaps, positions[i] - previous);
+		previous = positions[i];
+	}
+}
+
+// Steps p over an entry's length-prefixed gaps, which are left in [gaps, p)
+static bool skipGaps(const char*& p, const char* end, const char*& gaps)
+{
+	unsigned long long length;
+	if (!getVarint(p, end, length) || length > static_cast<unsigned long long>(end - p))
+		return false;
+	gaps = p;
+	p += length;
+	return true;
+}
+
+//******************** FrozenPositions functions *******************************
+
+bool FrozenPositions::openBuffer(std::string& data)
+{
+	m_data.swap(data);
+	m_terms.clear();
+	const char* p = m_data.data();
+	const char* end = p + m_data.size();
+
+	int termCount;
+	if (!getVarint(p, end, termCount))
+		return false;
+
+	std::string term;
+	std::string previousTerm;
+	for (int i = 0; i < termCount; i++)
+	{
+		if (!getString(p, end, term) || (i > 0 && term <= previousTerm))
+			return false;
+		m_terms.add(term, p - m_data.data());
+		previousTerm.swap(term);
+
+		int entryCount = 0;
+		int id = 0;
+		if (!getVarint(p, end, entryCount))
+			return false;
+		for (int k = 0; k < entryCount; k++)
+		{
+			const char* gaps;
+			if (!getVarint(p, end, id) || !skipGaps(p, end, gaps))
+				return false;
+		}
+	}
+	return p == end;
+}
+
+void FrozenPositions::getPositions(const std::string& term, std::vector<DocPositions>& docs) const
+{
+	docs.clear();
+	unsigned long long offset;
+	if (!m_terms.find(term, offset))
+		return;
+
+	const char* p = m_data.data() + offset;
+	const char* end = m_data.data() + m_data.size();
+	int entryCount = 0;
+	getVarint(p, end, entryCount);
+
+	// Validated by openBuffer
+	docs.resize(entryCount);
+	for (int k = 0; k < entryCount; k++)
+	{
+		const char* gaps;
+		getVarint(p, end, docs[k].id);
+		skipGaps(p, end, gaps);
+		decodeGaps(gaps, p, docs[k].positions);
+	}
+}
+
+size_t FrozenPositions::sizeInBytes() const
+{
+	return m_data.size() + m_terms.sizeInBytes();
+}
+
+//******************** PositionIndex functions *******************************
+
+PositionIndex::PositionIndex(int idLimit)
+{
+	m_idLimit = idLimit;
+	clear();
+}
+
+void PositionIndex::clear()
+{
+	m_lists.clear();
+	m_version.assign(m_idLimit, 0);
+	m_docBytes.assign(m_idLimit, 0);
+	m_bytes = 0;
+	m_staleBytes = 0;
+}
+
+void PositionIndex::addDoc(int id, WordBag& wb)
+{
+	if (m_docBytes[id] > 0)
+		removeDoc(id);
+
+	std::string word;
+	std::vector<int> positions;
+	std::string gaps;
+	for (bool gotAWord = wb.getFirstWord(word, positions); gotAWord; gotAWord = wb.getNextWord(word, positions))
+	{
+		encodeGaps(positions, gaps);
+		appendEntry(word, id, gaps);
+	}
+}
+
+void PositionIndex::removeDoc(int id)
+{
+	m_version[id]++;
+	m_staleBytes += m_docBytes[id];
+	m_docBytes[id] = 0;
+
+	if (m_staleBytes > POSITION_STALE_FRACTION * m_bytes)
+		compact();
+}
+
+void PositionIndex::absorb(PositionIndex& other)
+{
+	std::string term;
+	std::string gaps;
+	for (std::string* list = other.m_lists.getFirst(term); list != nullptr; list = other.m_lists.getNext(term))
+	{
+		const char* p = list->data();
+		const char* end = p + list->size();
+		int id = 0;
+		int version = 0;
+		while (p != end)
+		{
+			getVarint(p, end, id);
+			getVarint(p, end, version);
+			getString(p, end, gaps);
+			if (version == other.m_version[id])
+				appendEntry(term, id, gaps);
+		}
+	}
+}
+
+void PositionIndex::getPositions(const std::string& term, std::vector<DocPositions>& docs) const
+{
+	docs.clear();
+	const std::string* list = m_lists.find(term);
+	if (list == nullptr)
+		return;
+
+	const char* p = list->data();
+	const char* end = p + list->size();
+	DocPositions doc;
+	int version = 0;
+	while (p != end)
+	{
+		const char* gaps;
+		getVarint(p, end, doc.id);
+		getVarint(p, end, version);
+		skipGaps(p, end, gaps);
+		if (version != m_version[doc.id])
+			continue;
+		decodeGaps(gaps, p, doc.positions);
+		docs.push_back(doc);
+	}
+}
+
+size_t PositionIndex::sizeInBytes() const
+{
+	return m_bytes;
+}
+
+MapMemoryStats PositionIndex::memoryStats() const
+{
+	MapMemoryStats stats = m_lists.memoryStats();
+	stats.valueBytes += m_version.capacity() * sizeof(int) + m_docBytes.capacity() * sizeof(size_t);
+	stats.overheadBytes += 2 * HEAP_BLOCK_OVERHEAD_BYTES;
+	return stats;
+}
+
+static bool termListLess(const std::pair<std::string, std::string*>& a, const std::pair<std::string, std::string*>& b)
+{
+	return a.first < b.first;
+}
+
+void PositionIndex::freeze(std::string& buf)
+{
+	std::vector<std::pair<std::string, std::string*> > lists;
+	std::string term;
+	for (std::string* list = m_lists.getFirst(term); list != nullptr; list = m_lists.getNext(term))
+		lists.push_back(std::make_pair(term, list));
+	std::sort(lists.begin(), lists.end(), termListLess);
+
+	// Only the current entries, so the term count is known at the end
+	std::string body;
+	std::string entries;
+	int termCount = 0;
+	for (unsigned int t = 0; t < lists.size(); t++)
+	{
+		const char* p = lists[t].second->data();
+		const char* end = p + lists[t].second->size();
+		int id = 0;
+		int version = 0;
+		int entryCount = 0;
+		entries.clear();
+		while (p != end)
+		{
+			const char* gaps;
+			getVarint(p, end, id);
+			getVarint(p, end, version);
+			skipGaps(p, end, gaps);
+			if (version != m_version[id])
+				continue;
+			putVarint(entries, id);
+			putVarint(entries, p - gaps);
+			entries.append(gaps, p);
+			entryCount++;
+		}
+		if (entryCount == 0)
+			continue;
+
+		putString(body, lists[t].first);
+		putVarint(body, entryCount);
+		body += entries;
+		termCount++;
+	}
+
+	buf.clear();
+	putVarint(buf, termCount);
+	buf += body;
+}
+
+bool PositionIndex::save(const std::string& filename)
+{
+	std::string buf;
+	freeze(buf);
+	return replaceWholeFile(filename, buf);
+}
+
+bool PositionIndex::load(const std::string& filename)
+{
+	clear();
+
+	std::string buf;
+	if (!readWholeFile(filename, buf))
+	{
+		std::cerr << "Error: Cannot read from " << filename << std::endl;
+		return false;
+	}
+
+	// Let FrozenPositions check the file, then copy its lists
+	FrozenPositions frozen;
+	const char* p = buf.data();
+	const char* end = p + buf.size();
+	std::string data = buf;
+	int termCount;
+	if (!frozen.openBuffer(data) || !getVarint(p, end, termCount))
+	{
+		std::cerr << "Error: corrupt position file " << filename << std::endl;
+		return false;
+	}
+
+	std::string term;
+	std::string gaps;
+	for (int t = 0; t < termCount; t++)
+	{
+		int entryCount = 0;
+		getString(p, end, term);
+		getVarint(p, end, entryCount);
+		for (int k = 0; k < entryCount; k++)
+		{
+			int id = 0;
+			getVarint(p, end, id);
+			getString(p, end, gaps);
+			if (id < 0 || id >= m_idLimit)
+			{
+				std::cerr << "Error: corrupt position file " << filename << std::endl;
+				clear();
+				return false;
+			}
+			appendEntry(term, id, gaps);
+		}
+	}
+	return true;
+}
+
+void PositionIndex::appendEntry(const std::string& term, int id, const std::string& gaps)
+{
+	std::string* list = m_lists.find(term);
+	if (list == nullptr)
+	{
+		m_lists.associate(term, std::string());
+		list = m_lists.find(term);
+	}
+
+	size_t before = list->size();
+	putVarint(*list, id);
+	putVarint(*list, m_version[id]);
+	putString(*list, gaps);
+	m_docBytes[id] += list->size() - before;
+	m_bytes += list->size() - before;
+}
+
+void PositionIndex::compact()
+{
+	std::vector<std::string> emptied;
+	std::string term;
+	std::string kept;
+	for (std::string* list = m_lists.getFirst(term); list != nullptr; list = m_lists.getNext(term))
+	{
+		const char* p = list->data();
+		const char* end = p + list->size();
+		int id = 0;
+		int version = 0;
+		kept.clear();
+		while (p != end)
+		{
+			const char* entry = p;
+			const char* gaps;
+			getVarint(p, end, id);
+			getVarint(p, end, version);
+			skipGaps(p, end, gaps);
+			if (version == m_version[id])
+				kept.append(entry, p);
+		}
+		if (kept.empty())
+			emptied.push_back(term);
+		else
+			list->assign(kept);
+	}
+
+	// Not removed during the traversal, which would upset it
+	for (unsigned int i = 0; i < emptied.size(); i++)
+		m_lists.remove(emptied[i]);
+
+	m_bytes -= m_staleBytes;
+	m_staleBytes = 0;
+}
@@ -0,0 +1,78 @@
+#ifndef POSITIONINDEX_INCLUDED
+#define POSITIONINDEX_INCLUDED
+
+#include "provided.h"
+#include "MyMap.h"
+#include "TermDictionary.h"
+#include <string>
+#include <vector>
+
+// Token positions of every (term, page) pair, for phrase and proximity queries
+// (see Indexer::enablePositions). They are kept apart from the count postings,
+// so lookups that only need counts never read them. A page's positions for a
+// term are stored as the gaps between consecutive positions, which are mostly
+// small enough for one varint byte.
+//
+// A page that is removed or indexed again isn't taken out of the lists right
+// away. Every id has a version, entries written under an older version are
+// skipped, and the lists are rewritten without them once they take up more
+// than POSITION_STALE_FRACTION of the bytes.
+//
+// Saved and frozen layout (all integers are varints, see BinaryIO.h):
+//
+//   termCount
+//   termCount * (term, entryCount,				terms in increasing std::string order
+//		entryCount * (id, gaps))				gaps is length-prefixed
+
+static const double POSITION_STALE_FRACTION = 0.5;
+
+struct DocPositions
+{
+	int id;
+	std::vector<int> positions;  // increasing
+};
+
+// Read-only copy of a PositionIndex, which index snapshots share
+class FrozenPositions
+{
+public:
+	bool openBuffer(std::string& data);  // takes over the contents of data
+	void getPositions(const std::string& term, std::vector<DocPositions>& docs) const;
+	size_t sizeInBytes() const;
+
+private:
+	std::string m_data;
+	TermDictionary m_terms;  // where each term's entry count is in m_data
+};
+
+class PositionIndex
+{
+public:
+	PositionIndex(int idLimit);
+
+	void clear();
+	void addDoc(int id, WordBag& wb);  // replaces the positions id had before
+	void removeDoc(int id);
+	void absorb(PositionIndex& other);  // other's pages must not be in this index yet
+
+	void getPositions(const std::string& term, std::vector<DocPositions>& docs) const;
+	size_t sizeInBytes() const;  // of the encoded lists, stale entries included
+	MapMemoryStats memoryStats() const;  // the per-id tables are counted as values
+
+	void freeze(std::string& buf);
+	bool save(const std::string& filename);
+	bool load(const std::string& filename);
+
+private:
+	void appendEntry(const std::string& term, int id, const std::string& gaps);
+	void compact();
+
+	int m_idLimit;
+	MyMap<std::string, std::string> m_lists;  // term -> (id, version, gaps) entries
+	std::vector<int> m_version;
+	std::vector<size_t> m_docBytes;  // bytes of each id's current entries
+	size_t m_bytes;
+	size_t m_staleBytes;
+};
+
+#endif // POSITIONINDEX_INCLUDED
@@ -0,0 +1,153 @@
+#ifndef RANKING_INCLUDED
+#define RANKING_INCLUDED
+
+#include "provided.h"
+#include "BinaryIO.h"
+#include <string>
+#include <vector>
+#include <cmath>
+
+// Term weights for RANK_BY_TF_IDF and RANK_BY_BM25 (see RankingMode).
+//
+// Both need a term's document frequency and, for BM25, each page's length in
+// tokens relative to the average. The document frequency is the length of
+// the term's live posting list, which a lookup has in hand anyway (segments
+// store it with each term), so it costs nothing extra and stays exact as pages
+// are removed. Page lengths are kept in a dense array indexed by url id, so
+// scoring a posting list is a gather followed by a plain loop over ints and
+// floats, with no lookups per posting.
+
+static const float BM25_K1 = 1.2f;
+static const float BM25_B = 0.75f;
+
+// Length in tokens of every page in an index, by url id (0 for ids that
+// aren't in use), and the totals the average is taken from.
+//
+// File: varint (id, length) pairs for every page with a length
+class DocumentLengths
+{
+public:
+	DocumentLengths(int idLimit)
+	{
+		m_lengths.assign(idLimit, 0);
+		m_docCount = 0;
+		m_totalLength = 0;
+	}
+
+	void clear()
+	{
+		m_lengths.assign(m_lengths.size(), 0);
+		m_docCount = 0;
+		m_totalLength = 0;
+	}
+
+	void set(int id, int length)
+	{
+		m_docCount += (length > 0) - (m_lengths[id] > 0);
+		m_totalLength += length - m_lengths[id];
+		m_lengths[id] = length;
+	}
+
+	int get(int id) const
+	{
+		return m_lengths[id];
+	}
+
+	size_t sizeInBytes() const
+	{
+		return sizeof(*this) + m_lengths.capacity() * sizeof(int);
+	}
+
+	int docCount() const
+	{
+		return m_docCount;
+	}
+
+	float averageLength() const
+	{
+		return m_docCount == 0 ? 1.0f : static_cast<float>(static_cast<double>(m_totalLength) / m_docCount);
+	}
+
+	bool save(const std::string& filename) const
+	{
+		std::string buf;
+		for (unsigned int id = 0; id < m_lengths.size(); id++)
+		{
+			if (m_lengths[id] == 0)
+				continue;
+			putVarint(buf, id);
+			putVarint(buf, m_lengths[id]);
+		}
+		return replaceWholeFile(filename, buf);
+	}
+
+	// False (and empty) if the file is missing or corrupt
+	bool load(const std::string& filename)
+	{
+		clear();
+		std::string buf;
+		if (!readWholeFile(filename, buf))
+			return false;
+
+		const char* p = buf.data();
+		const char* end = p + buf.size();
+		int id;
+		int length;
+		while (p != end)
+		{
+			if (!getVarint(p, end, id) || !getVarint(p, end, length) ||
+				id < 0 || id >= static_cast<int>(m_lengths.size()) || length < 0)
+			{
+				std::cerr << "Error: corrupt document length file " << filename << std::endl;
+				clear();
+				return false;
+			}
+			set(id, length);
+		}
+		return true;
+	}
+
+private:
+	std::vector<int> m_lengths;
+	int m_docCount;
+	long long m_totalLength;
+};
+
+// Scores of one term's postings, given as parallel arrays of their counts and
+// page lengths. docFrequency is the number of pages the term is in and
+// docCount the number of pages in the index.
+inline void scorePostings(RankingMode ranking, int docFrequency, int docCount, float averageLength,
+	const int* counts, const int* lengths, int n, float* scores)
+{
+	if (ranking == RANK_BY_COUNTS)
+	{
+		for (int i = 0; i < n; i++)
+			scores[i] = static_cast<float>(counts[i]);
+		return;
+	}
+
+	// Kept positive even for a term that is in every page, so such a term still
+	// orders the pages it is in
+	float df = static_cast<float>(docFrequency);
+	float pages = static_cast<float>(std::max(docCount, docFrequency));
+	if (ranking == RANK_BY_TF_IDF)
+	{
+		float idf = std::log(1.0f + pages / df);
+		for (int i = 0; i < n; i++)
+			scores[i] = static_cast<float>(counts[i]) * idf;
+		return;
+	}
+
+	// BM25: count / (count + K1 * (1 - B + B * length / averageLength)), scaled
+	float idf = std::log(1.0f + (pages - df + 0.5f) / (df + 0.5f));
+	float constantPart = BM25_K1 * (1.0f - BM25_B);
+	float lengthPart = BM25_K1 * BM25_B / averageLength;
+	float scale = idf * (BM25_K1 + 1.0f);
+	for (int i = 0; i < n; i++)
+	{
+		float count = static_cast<float>(counts[i]);
+		scores[i] = scale * count / (count + constantPart + lengthPart * static_cast<float>(lengths[i]));
+	}
+}
+
+#endif // RANKING_INCLUDED
@@ -1,5 +1,13 @@
 #include "provided.h"
+#include "Indexer.h"
+#include "Shards.h"
+#include "MyMap.h"
+#include "BinaryIO.h"
+#include "Metrics.h"
+#include "DocumentStore.h"
 #include <string>
+#include <chrono>
+#include <cstdlib>  // for atoi
 using namespace std;
 
 
@@ -8,7 +16,7 @@ struct urlSearchResults
 {
 	string url;
 	int occurences;
-	int score;
+	double score;
 };
 
 bool urlSearchSortFunction(const urlSearchResults &target, urlSearchResults &src)
@@ -16,53 +24,200 @@ bool urlSearchSortFunction(const urlSearchResults &target, urlSearchResults &src
 	return target.score > src.score;
 }
 
+// Phrase items ("new york", or "new york"~2 to allow up to 2 other tokens in
+// between) need an index that keeps positions (see Indexer::enablePositions);
+// on any other they match like their words. Slops above this are cut down to it.
+static const int PHRASE_MAX_SLOP = 1000;
+
+static bool urlPositionsLess(const UrlPositions& a, const UrlPositions& b)
+{
+	return a.url < b.url;
+}
+
+static bool urlPositionsUrlLess(const UrlPositions& a, const string& url)
+{
+	return a.url < url;
+}
+
+// Number of places in a page where the words of a phrase (given by their
+// positions, in phrase order) occur in order, starting at an occurrence of
+// the first word and with at most slop other tokens in between
+static int countPhraseMatches(const vector<const vector<int>*>& positions, int slop)
+{
+	int matches = 0;
+	const vector<int>& first = *positions[0];
+	for (unsigned int i = 0; i < first.size(); i++)
+	{
+		// The earliest occurrence of each word after the one before it gives the
+		// shortest span starting here
+		int last = first[i];
+		bool complete = true;
+		for (unsigned int w = 1; w < positions.size() && complete; w++)
+		{
+			vector<int>::const_iterator next = std::upper_bound(positions[w]->begin(), positions[w]->end(), last);
+			if (next == positions[w]->end() || *next - first[i] - static_cast<int>(w) > slop)
+				complete = false;
+			else
+				last = *next;
+		}
+		if (complete)
+			matches++;
+	}
+	return matches;
+}
+
 class SearcherImpl
 {
 public:
+	SearcherImpl();
 	vector<string> search(string terms);
+	void setRanking(RankingMode ranking);
+	void setBudget(double maxMilliseconds, int maxPostings);
+	void setFreezeMode(FreezeMode mode);
+	void setFrequentTerms(double minPageFraction, const vector<string>& stopwords);
+	bool lastSearchWasPartial() const;
+	SearchStats getSearchStats() const;
 	bool load(string filenameBase);
+	bool loadShards(string filenameBase);
+	vector<size_t> getShardBytes() const;
+	bool loadShared(string filenameBase);
+	string getSnippet(string url) const;
+	void attach(const Indexer& indexer);
+	void attach(const WebCrawler& crawler);
 
 private:
+	void loadDocuments(const string& filenameBase);
+	void addSearchItem(const string& item);
+	void addWordItems(const string& text);
+	void addPhraseItem(const string& text, int slop, bool positions);
+	vector<UrlScore> getItemUrlScores(const string& item, const IndexSnapshot& snapshot, bool useSnapshot);
+	vector<UrlCount> getPhraseUrlCounts(const string& item, const IndexSnapshot& snapshot, bool useSnapshot);
+	int estimateItemPostings(const string& item, const IndexSnapshot& snapshot, bool useSnapshot);
+	void orderItemsRarestFirst(const IndexSnapshot& snapshot, bool useSnapshot, vector<int>& itemPostings);
+	void splitFrequentItems(int T);
+	void applyFrequentItems(int T, MyMap<string, int>& resultIndex);
+	bool budgetExhausted(int postingsRead);
+	void addItemScores(const vector<UrlScore>& urlScores, MyMap<string, int>& resultIndex);
+	void gatherFromShards(MyMap<string, int>& resultIndex);
+	bool awaitReply(future<vector<ShardMatch> >& reply);
+	void addShardMatches(const vector<ShardMatch>& matches, MyMap<string, int>& resultIndex);
 	
 	Indexer m_searcherIndex;
+
+	// When attached to a live Indexer or WebCrawler, queries run against its
+	// latest published snapshot instead of m_searcherIndex
+	const Indexer* m_attachedIndexer;
+	const WebCrawler* m_attachedCrawler;
+
+	// How results are scored (see Ranking.h); the sum of counts unless set otherwise
+	RankingMode m_ranking;
+
+	// How a loaded index is packed once it is loaded (see Indexer::freeze)
+	FreezeMode m_freezeMode;
+
+	// Per-search budget (0 means unlimited) and what happened to it: a search
+	// that runs out stops evaluating items, skipping the rest, and its results
+	// are flagged as partial
+	double m_maxMilliseconds;
+	int m_maxPostings;
+	chrono::steady_clock::time_point m_searchStart;
+	bool m_lastSearchPartial;
+	int m_itemsSkipped;
+	SearchStats m_stats;
+
+	// When shards are loaded, queries are scattered over their servers instead
+	vector<shared_ptr<ShardServer> > m_shards;
+
+	// When a shared index is loaded, queries read it where it is mapped, through
+	// a snapshot that never changes (see Indexer::saveShared)
+	IndexSnapshot m_sharedIndex;
+	bool m_shared;
+
+	// Page texts saved alongside the index by a crawler with its document store
+	// enabled, for snippets; empty when there are none (or when attached)
+	DocumentStore m_documents;
+
 	vector<string> m_searchMatches;
 	vector<string> m_searchTerms;
-	vector<UrlCount> m_urlCountContainer;
+
+	// Items of the last search for words the index keeps as bitmaps, checked
+	// only on the pages m_searchTerms found (see setFrequentTerms)
+	vector<string> m_filterTerms;
 	vector<urlSearchResults> m_unsortedSearchResults;
 };
 
+SearcherImpl::SearcherImpl()
+	: m_documents(HASH_TABLE_SIZE)
+{
+	m_attachedIndexer = nullptr;
+	m_attachedCrawler = nullptr;
+	m_shared = false;
+	m_ranking = RANK_BY_COUNTS;
+	m_freezeMode = FREEZE_ARENA;
+	m_maxMilliseconds = 0;
+	m_maxPostings = 0;
+	m_lastSearchPartial = false;
+	m_itemsSkipped = 0;
+	m_stats.searches = 0;
+	m_stats.partialSearches = 0;
+	m_stats.timeBudgetHits = 0;
+	m_stats.postingBudgetHits = 0;
+	m_stats.itemsSkipped = 0;
+	m_stats.itemsFiltered = 0;
+}
+
 vector<string> SearcherImpl::search(string terms)
 {
+	METRIC_TIMER(HISTOGRAM_SEARCH);
+	METRIC_CLOCK(stageStart);
+	METRIC_ADD(COUNTER_SEARCHES, 1);
+
 	// Clear out vectors of anything they may have contained
 	m_searchMatches.clear();
 	m_searchTerms.clear();
+	m_filterTerms.clear();
 	m_unsortedSearchResults.clear();
-	m_urlCountContainer.clear();
+
+	// One snapshot for the whole query, so every term sees the same version of a live index
+	IndexSnapshot snapshot;
+	if (m_attachedIndexer != nullptr)
+		snapshot = m_attachedIndexer->snapshot();
+	else if (m_attachedCrawler != nullptr)
+		snapshot = m_attachedCrawler->snapshot();
+	else if (m_shared)
+		snapshot = m_sharedIndex;
+	bool useSnapshot = (m_attachedIndexer != nullptr || m_attachedCrawler != nullptr || m_shared);
+
+	// Shard servers don't keep positions
+	bool positions = m_shards.empty() && (useSnapshot ? snapshot.hasPositions() : m_searcherIndex.positionsEnabled());
 
 	// Search terms are NOT case sensitive and can be more than one word so parse out
 	// Also treat word repetition as just a single word
 	std::transform(terms.begin(), terms.end(), terms.begin(), ::tolower);
-	Tokenizer t(terms);
-	std::string tempString;
 
-	while (t.getNextToken(tempString))
+	// Quoted text is a single phrase item, optionally followed by ~N; the rest
+	// is split into word items
+	size_t start = 0;
+	while (start < terms.size())
 	{
-		if (m_searchTerms.size() == 0)
-			m_searchTerms.push_back(tempString);
-
-		else
+		size_t quote = terms.find('"', start);
+		addWordItems(terms.substr(start, quote == string::npos ? string::npos : quote - start));
+		if (quote == string::npos)
+			break;
+
+		size_t close = terms.find('"', quote + 1);
+		if (close == string::npos)
+			close = terms.size();
+		string phrase = terms.substr(quote + 1, close - quote - 1);
+		start = close + 1;
+
+		int slop = 0;
+		if (start < terms.size() && terms[start] == '~')
 		{
-			for (unsigned int i = 0; i < m_searchTerms.size(); i++)
-			{
-				// Checks for duplicates
-				if (m_searchTerms[i] == tempString)
-					break;
-
-				// If on last iteration and no match, then there are no duplicates
-				if (i == m_searchTerms.size() - 1)
-					m_searchTerms.push_back(tempString);
-			}
+			for (start++; start < terms.size() && std::isdigit(static_cast<unsigned char>(terms[start])); start++)
+				slop = std::min(slop * 10 + (terms[start] - '0'), PHRASE_MAX_SLOP);
 		}
+		addPhraseItem(phrase, slop, positions);
 	}
 
 	// A given web page matches a search query if at least T of the N distinct items found in that page:
@@ -77,8 +232,6 @@ vector<string> SearcherImpl::search(string terms)
 		T = N * 0.7;
 	else
 		return m_searchMatches;
-	std::cerr << "N: " << N << std::endl;
-	std::cerr << "T: " << T << std::endl;
 
 	// Results must be returned in order of greatest relevance
 	// Relevance score = add up occurences of term per page per term
@@ -92,102 +245,664 @@ vector<string> SearcherImpl::search(string terms)
 	//		www.b.com would have a score of 12 (8 + 4) and have a greater
 	//		relevance than www.a.com which has a score of 8 (5 + 2 + 1).
 
-	urlSearchResults tempSearchResults;
-	UrlCount tempUrlCountVar;
-	vector<UrlCount> tempUrlCountContainer;
+	// With RANK_BY_TF_IDF or RANK_BY_BM25 the counts are replaced by the scores
+	// of Ranking.h, and those are added up instead
+
+	vector<UrlScore> tempUrlScoreContainer;
+
+	// Only a loaded index sets frequent words apart
+	if (!useSnapshot && m_shards.empty())
+		splitFrequentItems(T);
+	int driving = m_searchTerms.size();
+
+	// With a budget (see setBudget) the rarest items go first, so whatever is
+	// left out when it runs out is what would have cost the most
+	m_searchStart = chrono::steady_clock::now();
+	m_lastSearchPartial = false;
+	m_itemsSkipped = 0;
+	vector<int> itemPostings(driving, 0);
+	if (m_maxMilliseconds > 0 || m_maxPostings > 0)
+		orderItemsRarestFirst(snapshot, useSnapshot, itemPostings);
 
-	for (unsigned int i = 0; i < N; i++)
+	// Parsing the query and planning its evaluation
+	METRIC_LAP(HISTOGRAM_SEARCH_PARSE, stageStart);
+
+	MyMap<string, int> resultIndex;  // url -> position in m_unsortedSearchResults
+	if (!m_shards.empty())
 	{
-		tempUrlCountContainer = m_searcherIndex.getUrlCounts(m_searchTerms[i]);
+		gatherFromShards(resultIndex);
+		METRIC_LAP(HISTOGRAM_SEARCH_POSTINGS, stageStart);
+	}
 
-		for (unsigned int k = 0; k < tempUrlCountContainer.size(); k++)
+	int postingsRead = 0;
+	for (int i = 0; i < driving && m_shards.empty(); i++)
+	{
+		if (budgetExhausted(postingsRead))
 		{
-			// TODO: REMOVE AFTER TESTING
-			std::cerr << m_searchTerms[i] << " appears in " << tempUrlCountContainer[k].count
-				<< " times at " << tempUrlCountContainer[k].url << std::endl;
-
-			// Transfer over the temp variables over to m_urlCountContainer
-			tempUrlCountVar.count = tempUrlCountContainer[k].count;
-			tempUrlCountVar.url = tempUrlCountContainer[k].url;
-			m_urlCountContainer.push_back(tempUrlCountVar);
+			m_itemsSkipped = driving - i;
+			break;
 		}
 
-		//std::cerr << "TEST SIZE: " << tempUrlCountContainer.size() << std::endl;
+		tempUrlScoreContainer = getItemUrlScores(m_searchTerms[i], snapshot, useSnapshot);
+		postingsRead += std::max(itemPostings[i], static_cast<int>(tempUrlScoreContainer.size()));
+		METRIC_LAP(HISTOGRAM_SEARCH_POSTINGS, stageStart);
+		METRIC_ADD(COUNTER_POSTINGS_SCORED, tempUrlScoreContainer.size());
+
+		// Consolidate into m_unsortedSearchResults right away: one entry per url
+		// with its score summed over the items it matched
+		addItemScores(tempUrlScoreContainer, resultIndex);
+		METRIC_LAP(HISTOGRAM_SEARCH_MERGE, stageStart);
 	}
+	applyFrequentItems(T, resultIndex);
 
+	if (m_lastSearchPartial)
+	{
+		m_stats.partialSearches++;
+		m_stats.itemsSkipped += m_itemsSkipped;
+		METRIC_ADD(COUNTER_PARTIAL_SEARCHES, 1);
+	}
+	m_stats.searches++;
 
+	// Sort m_unsortedSearchResults based on score (See urlSearchSortFunction at beginning of file)
+	std::sort(m_unsortedSearchResults.begin(), m_unsortedSearchResults.end(), urlSearchSortFunction);
+	METRIC_LAP(HISTOGRAM_SEARCH_SORT, stageStart);
 
-	for (int k = 0; k < m_urlCountContainer.size(); k++)
+	// Iterate through now sorted m_unsortedSearchResults and push valid values into m_searchMatches.
+	// After a partial search, pages that could still have reached T through the
+	// skipped items are kept as well.
+	string tempUrl;
+	for (unsigned int z = 0; z < m_unsortedSearchResults.size(); z++)
 	{
+		if (m_unsortedSearchResults[z].occurences + m_itemsSkipped >= T)
+		{
+			tempUrl = m_unsortedSearchResults[z].url;
+			m_searchMatches.push_back(tempUrl);
+		}
+	}
+	METRIC_ADD(COUNTER_SEARCH_RESULTS, m_searchMatches.size());
+	
+	return m_searchMatches; 
+}
 
-			// We're basically consolidating the urlCounts vector into m_unsortedSearchResults
-			// Then afterwards we'll sort it and copy the valid contents into m_searchMatches
-			if (k == 0)
+void SearcherImpl::addSearchItem(const string& item)
+{
+	if (m_searchTerms.size() == 0)
+		m_searchTerms.push_back(item);
+
+	else
+	{
+		for (unsigned int i = 0; i < m_searchTerms.size(); i++)
+		{
+			// Checks for duplicates
+			if (m_searchTerms[i] == item)
+				break;
+
+			// If on last iteration and no match, then there are no duplicates
+			if (i == m_searchTerms.size() - 1)
+				m_searchTerms.push_back(item);
+		}
+	}
+}
+
+void SearcherImpl::addWordItems(const string& text)
+{
+	Tokenizer t(text);
+	std::string tempString;
+
+	while (t.getNextToken(tempString))
+	{
+		// A trailing * asks for every word that starts with the token
+		if (t.tokenFollowedBy('*'))
+			tempString += '*';
+
+		addSearchItem(tempString);
+	}
+}
+
+void SearcherImpl::addPhraseItem(const string& text, int slop, bool positions)
+{
+	vector<string> words;
+	Tokenizer t(text);
+	std::string word;
+	while (t.getNextToken(word))
+		words.push_back(word);
+
+	if (words.empty())
+		return;
+
+	// Without positions (shard servers and shared indexes never have them) a
+	// phrase is just its words
+	if (words.size() == 1 || !positions)
+	{
+		for (unsigned int i = 0; i < words.size(); i++)
+			addSearchItem(words[i]);
+		return;
+	}
+
+	// The item is the phrase in a normal form: "word word ..." and the slop, if any
+	string item = "\"";
+	for (unsigned int i = 0; i < words.size(); i++)
+		item += (i == 0 ? "" : " ") + words[i];
+	item += '"';
+	if (slop > 0)
+		item += "~" + std::to_string(slop);
+	addSearchItem(item);
+}
+
+vector<UrlScore> SearcherImpl::getItemUrlScores(const string& item, const IndexSnapshot& snapshot, bool useSnapshot)
+{
+	// A phrase is scored like a word whose count in a page is the number of
+	// times the phrase occurs there
+	if (item[0] == '"')
+	{
+		vector<UrlCount> urlCounts = getPhraseUrlCounts(item, snapshot, useSnapshot);
+		return useSnapshot ? snapshot.scoreUrlCounts(urlCounts, m_ranking) : m_searcherIndex.scoreUrlCounts(urlCounts, m_ranking);
+	}
+
+	if (item[item.size() - 1] != '*')
+		return useSnapshot ? snapshot.getUrlScores(item, m_ranking) : m_searcherIndex.getUrlScores(item, m_ranking);
+
+	// A prefix item matches a page once, however many of its words the page has,
+	// and its score is the sum of the scores of all of them
+	string prefix = item.substr(0, item.size() - 1);
+	vector<string> words = useSnapshot ? snapshot.getTermsWithPrefix(prefix) : m_searcherIndex.getTermsWithPrefix(prefix);
+
+	vector<UrlScore> combined;
+	MyMap<string, int> combinedIndex;  // url -> position in combined
+	for (unsigned int w = 0; w < words.size(); w++)
+	{
+		vector<UrlScore> urlScores = useSnapshot ? snapshot.getUrlScores(words[w], m_ranking) :
+			m_searcherIndex.getUrlScores(words[w], m_ranking);
+		for (unsigned int k = 0; k < urlScores.size(); k++)
+		{
+			int* position = combinedIndex.find(urlScores[k].url);
+			if (position != nullptr)
+				combined[*position].score += urlScores[k].score;
+			else
 			{
-				tempSearchResults.url = m_urlCountContainer[k].url;
-				tempSearchResults.score = m_urlCountContainer[k].count;
-				tempSearchResults.occurences = 1;
-				m_unsortedSearchResults.push_back(tempSearchResults);
+				combinedIndex.associate(urlScores[k].url, combined.size());
+				combined.push_back(urlScores[k]);
 			}
+		}
+	}
+	return combined;
+}
 
-			else
+vector<UrlCount> SearcherImpl::getPhraseUrlCounts(const string& item, const IndexSnapshot& snapshot, bool useSnapshot)
+{
+	size_t close = item.find('"', 1);
+	int slop = close + 1 < item.size() ? std::atoi(item.c_str() + close + 2) : 0;
+
+	vector<string> words;
+	Tokenizer t(item.substr(1, close - 1));
+	std::string word;
+	while (t.getNextToken(word))
+		words.push_back(word);
+
+	// Every word's pages, sorted by url so they can be merged
+	vector<UrlCount> matches;
+	vector<vector<UrlPositions> > lists(words.size());
+	unsigned int rarest = 0;
+	for (unsigned int w = 0; w < words.size(); w++)
+	{
+		lists[w] = useSnapshot ? snapshot.getUrlPositions(words[w]) : m_searcherIndex.getUrlPositions(words[w]);
+		if (lists[w].empty())
+			return matches;
+		std::sort(lists[w].begin(), lists[w].end(), urlPositionsLess);
+		if (lists[w].size() < lists[rarest].size())
+			rarest = w;
+	}
+
+	// Walk the rarest word's pages and leapfrog every other list forward to
+	// each of them; only pages that have all the words get their positions checked
+	vector<unsigned int> cursors(words.size(), 0);
+	vector<const vector<int>*> positions(words.size());
+	UrlCount match;
+	for (unsigned int i = 0; i < lists[rarest].size(); i++)
+	{
+		const string& url = lists[rarest][i].url;
+		bool inAll = true;
+		for (unsigned int w = 0; w < words.size() && inAll; w++)
+		{
+			vector<UrlPositions>::const_iterator it = std::lower_bound(lists[w].begin() + cursors[w], lists[w].end(),
+				url, urlPositionsUrlLess);
+			cursors[w] = it - lists[w].begin();
+			inAll = it != lists[w].end() && it->url == url;
+			if (inAll)
+				positions[w] = &it->positions;
+		}
+		if (!inAll)
+			continue;
+
+		match.count = countPhraseMatches(positions, slop);
+		if (match.count > 0)
+		{
+			match.url = url;
+			matches.push_back(match);
+		}
+	}
+	return matches;
+}
+
+// Number of postings evaluating an item reads, from posting list lengths
+// alone. Phrases are bounded by their rarest word, since the other lists are
+// only leapfrogged over.
+int SearcherImpl::estimateItemPostings(const string& item, const IndexSnapshot& snapshot, bool useSnapshot)
+{
+	if (item[0] == '"')
+	{
+		size_t close = item.find('"', 1);
+		Tokenizer t(item.substr(1, close - 1));
+		std::string word;
+		int rarest = -1;
+		while (t.getNextToken(word))
+		{
+			int postings = useSnapshot ? snapshot.estimatePostings(word) : m_searcherIndex.estimatePostings(word);
+			if (rarest < 0 || postings < rarest)
+				rarest = postings;
+		}
+		return std::max(rarest, 0);
+	}
+
+	if (item[item.size() - 1] != '*')
+		return useSnapshot ? snapshot.estimatePostings(item) : m_searcherIndex.estimatePostings(item);
+
+	string prefix = item.substr(0, item.size() - 1);
+	vector<string> words = useSnapshot ? snapshot.getTermsWithPrefix(prefix) : m_searcherIndex.getTermsWithPrefix(prefix);
+	int postings = 0;
+	for (unsigned int w = 0; w < words.size(); w++)
+		postings += useSnapshot ? snapshot.estimatePostings(words[w]) : m_searcherIndex.estimatePostings(words[w]);
+	return postings;
+}
+
+void SearcherImpl::splitFrequentItems(int T)
+{
+	// Only word items can be checked against a bitmap
+	vector<pair<int, int> > frequent;  // (postings, item)
+	for (unsigned int i = 0; i < m_searchTerms.size(); i++)
+	{
+		const string& item = m_searchTerms[i];
+		if (item[0] != '"' && item[item.size() - 1] != '*' && m_searcherIndex.isFrequentTerm(item))
+			frequent.push_back(make_pair(m_searcherIndex.estimatePostings(item), i));
+	}
+	if (frequent.empty())
+		return;
+
+	// A page that none of the driving items found can still match through its
+	// filters alone if there are T of them, so of the frequent items the
+	// rarest drive as well until fewer than T are left as filters
+	std::sort(frequent.begin(), frequent.end());
+	vector<bool> filter(m_searchTerms.size(), false);
+	for (unsigned int k = std::max(0, static_cast<int>(frequent.size()) - (T - 1)); k < frequent.size(); k++)
+		filter[frequent[k].second] = true;
+
+	vector<string> driving;
+	for (unsigned int i = 0; i < m_searchTerms.size(); i++)
+	{
+		if (filter[i])
+			m_filterTerms.push_back(m_searchTerms[i]);
+		else
+			driving.push_back(m_searchTerms[i]);
+	}
+	m_searchTerms.swap(driving);
+}
+
+void SearcherImpl::applyFrequentItems(int T, MyMap<string, int>& resultIndex)
+{
+	if (m_filterTerms.empty())
+		return;
+
+	// Pages that can't reach T even with every filter aren't checked at all.
+	// The others get each filter's score just as if it had driven the search.
+	int filterCount = m_filterTerms.size();
+	vector<string> candidates;
+	for (unsigned int z = 0; z < m_unsortedSearchResults.size(); z++)
+	{
+		if (m_unsortedSearchResults[z].occurences + m_itemsSkipped + filterCount >= T)
+			candidates.push_back(m_unsortedSearchResults[z].url);
+	}
+	for (int f = 0; f < filterCount && !candidates.empty(); f++)
+		addItemScores(m_searcherIndex.getUrlScoresAmong(m_filterTerms[f], candidates, m_ranking), resultIndex);
+	m_stats.itemsFiltered += filterCount;
+}
+
+void SearcherImpl::orderItemsRarestFirst(const IndexSnapshot& snapshot, bool useSnapshot, vector<int>& itemPostings)
+{
+	// Shard servers estimate nothing; each one answers all of its terms at once
+	if (!m_shards.empty())
+		return;
+
+	vector<pair<int, string> > items;
+	for (unsigned int i = 0; i < m_searchTerms.size(); i++)
+		items.push_back(make_pair(estimateItemPostings(m_searchTerms[i], snapshot, useSnapshot), m_searchTerms[i]));
+	std::sort(items.begin(), items.end());
+
+	for (unsigned int i = 0; i < items.size(); i++)
+	{
+		itemPostings[i] = items[i].first;
+		m_searchTerms[i] = items[i].second;
+	}
+}
+
+bool SearcherImpl::budgetExhausted(int postingsRead)
+{
+	if (m_maxPostings > 0 && postingsRead >= m_maxPostings)
+	{
+		m_stats.postingBudgetHits++;
+		m_lastSearchPartial = true;
+		return true;
+	}
+
+	chrono::duration<double, std::milli> elapsed = chrono::steady_clock::now() - m_searchStart;
+	if (m_maxMilliseconds > 0 && elapsed.count() >= m_maxMilliseconds)
+	{
+		m_stats.timeBudgetHits++;
+		m_lastSearchPartial = true;
+		return true;
+	}
+	return false;
+}
+
+void SearcherImpl::addItemScores(const vector<UrlScore>& urlScores, MyMap<string, int>& resultIndex)
+{
+	urlSearchResults tempSearchResults;
+	for (unsigned int k = 0; k < urlScores.size(); k++)
+	{
+		int* position = resultIndex.find(urlScores[k].url);
+		if (position != nullptr)
+		{
+			m_unsortedSearchResults[*position].occurences++;
+			m_unsortedSearchResults[*position].score += urlScores[k].score;
+			continue;
+		}
+
+		tempSearchResults.url = urlScores[k].url;
+		tempSearchResults.occurences = 1;
+		tempSearchResults.score = urlScores[k].score;
+		resultIndex.associate(urlScores[k].url, m_unsortedSearchResults.size());
+		m_unsortedSearchResults.push_back(tempSearchResults);
+	}
+}
+
+void SearcherImpl::gatherFromShards(MyMap<string, int>& resultIndex)
+{
+	// Scatter: each shard gets the query terms it owns, and every shard gets
+	// each prefix item
+	vector<vector<string> > shardTerms(m_shards.size());
+	vector<string> prefixes;
+	for (unsigned int i = 0; i < m_searchTerms.size(); i++)
+	{
+		const string& item = m_searchTerms[i];
+		if (item[item.size() - 1] == '*')
+			prefixes.push_back(item.substr(0, item.size() - 1));
+		else
+			shardTerms[shardOfTerm(item, m_shards.size())].push_back(item);
+	}
+
+	vector<future<vector<ShardMatch> > > replies;
+	vector<int> replyTerms;
+	for (unsigned int k = 0; k < m_shards.size(); k++)
+	{
+		if (!shardTerms[k].empty())
+		{
+			replies.push_back(m_shards[k]->submit(shardTerms[k], m_ranking));
+			replyTerms.push_back(shardTerms[k].size());
+		}
+	}
+	vector<vector<future<vector<ShardMatch> > > > prefixReplies(prefixes.size());
+	for (unsigned int p = 0; p < prefixes.size(); p++)
+	{
+		for (unsigned int k = 0; k < m_shards.size(); k++)
+			prefixReplies[p].push_back(m_shards[k]->submitPrefix(prefixes[p], m_ranking));
+	}
+
+	// Gather: add up each page's partial term counts and scores from every shard.
+	// Replies that miss the time budget are left out, along with their terms.
+	for (unsigned int r = 0; r < replies.size(); r++)
+	{
+		if (awaitReply(replies[r]))
+			addShardMatches(replies[r].get(), resultIndex);
+		else
+			m_itemsSkipped += replyTerms[r];
+	}
+
+	// A page can match a prefix item on several shards but counts it once
+	for (unsigned int p = 0; p < prefixReplies.size(); p++)
+	{
+		vector<ShardMatch> combined;
+		MyMap<string, int> combinedIndex;  // url -> position in combined
+		bool complete = true;
+		for (unsigned int k = 0; k < prefixReplies[p].size(); k++)
+		{
+			if (!awaitReply(prefixReplies[p][k]))
 			{
-				for (unsigned int g = 0; g < m_unsortedSearchResults.size(); g++)
+				complete = false;
+				continue;
+			}
+			vector<ShardMatch> matches = prefixReplies[p][k].get();
+			for (unsigned int m = 0; m < matches.size(); m++)
+			{
+				int* position = combinedIndex.find(matches[m].url);
+				if (position != nullptr)
+					combined[*position].score += matches[m].score;
+				else
 				{
-					// Check for existing url and update info if existing found
-					if (m_unsortedSearchResults[g].url == m_urlCountContainer[k].url)
-					{
-						m_unsortedSearchResults[g].score += m_urlCountContainer[k].count;
-						m_unsortedSearchResults[g].occurences++;
-						break;
-					}
-
-					// If we're at the end of the loop and previous condition not met, then push the new value
-					if (g == m_unsortedSearchResults.size() - 1)
-					{
-						tempSearchResults.url = m_urlCountContainer[k].url;
-						tempSearchResults.score = m_urlCountContainer[k].count;
-						tempSearchResults.occurences = 1;
-						m_unsortedSearchResults.push_back(tempSearchResults);
-						break;  // TODO: Understand why I need this break here. Bug otherwise
-					}
+					combinedIndex.associate(matches[m].url, combined.size());
+					combined.push_back(matches[m]);
 				}
 			}
 		}
+		addShardMatches(combined, resultIndex);
+		if (!complete)
+			m_itemsSkipped++;
+	}
+}
 
-	// TODO: REMOVE AFTER TESTING
-	/*for (int q = 0; q < m_unsortedSearchResults.size(); q++)
-		std::cerr << m_unsortedSearchResults[q].url << " "
-			<< m_unsortedSearchResults[q].occurences << " "
-			<< m_unsortedSearchResults[q].score << std::endl;*/
+// Waits for a shard's reply until the time budget runs out, if there is one.
+// Unanswered requests are abandoned; their servers still answer them, but
+// nobody reads the reply.
+bool SearcherImpl::awaitReply(future<vector<ShardMatch> >& reply)
+{
+	if (m_maxMilliseconds <= 0)
+		return true;
+
+	chrono::steady_clock::time_point deadline = m_searchStart +
+		chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, std::milli>(m_maxMilliseconds));
+	if (reply.wait_until(deadline) == future_status::ready)
+		return true;
+
+	// One search is one budget hit, however many of its replies were missed
+	if (!m_lastSearchPartial)
+		m_stats.timeBudgetHits++;
+	m_lastSearchPartial = true;
+	return false;
+}
 
-	// Sort m_unsortedSearchResults based on score (See urlSearchSortFunction at beginning of file)
-	std::cerr << "Sort function initializing" << std::endl;
-	std::sort(m_unsortedSearchResults.begin(), m_unsortedSearchResults.end(), urlSearchSortFunction);
+void SearcherImpl::addShardMatches(const vector<ShardMatch>& matches, MyMap<string, int>& resultIndex)
+{
+	urlSearchResults tempSearchResults;
+	for (unsigned int m = 0; m < matches.size(); m++)
+	{
+		int* position = resultIndex.find(matches[m].url);
+		if (position != nullptr)
+		{
+			m_unsortedSearchResults[*position].occurences += matches[m].termsMatched;
+			m_unsortedSearchResults[*position].score += matches[m].score;
+			continue;
+		}
 
-	// TODO: REMOVE AFTER TESTING
-	for (int q = 0; q < m_unsortedSearchResults.size(); q++)
-		std::cerr << m_unsortedSearchResults[q].url << " "
-		<< m_unsortedSearchResults[q].occurences << " "
-		<< m_unsortedSearchResults[q].score << std::endl;
+		tempSearchResults.url = matches[m].url;
+		tempSearchResults.occurences = matches[m].termsMatched;
+		tempSearchResults.score = matches[m].score;
+		resultIndex.associate(matches[m].url, m_unsortedSearchResults.size());
+		m_unsortedSearchResults.push_back(tempSearchResults);
+	}
+}
 
-	// Iterate through now sorted m_unsortedSearchResults and push valid values into m_searchMatches
-	string tempUrl;
-	for (unsigned int z = 0; z < m_unsortedSearchResults.size(); z++)
+void SearcherImpl::setRanking(RankingMode ranking)
+{
+	m_ranking = ranking;
+}
+
+void SearcherImpl::setBudget(double maxMilliseconds, int maxPostings)
+{
+	m_maxMilliseconds = maxMilliseconds;
+	m_maxPostings = maxPostings;
+}
+
+void SearcherImpl::setFrequentTerms(double minPageFraction, const vector<string>& stopwords)
+{
+	// Takes effect when the next index is loaded, which is when it is frozen
+	m_searcherIndex.setFrequentTerms(minPageFraction, stopwords);
+}
+
+void SearcherImpl::setFreezeMode(FreezeMode mode)
+{
+	m_freezeMode = mode;
+}
+
+bool SearcherImpl::lastSearchWasPartial() const
+{
+	return m_lastSearchPartial;
+}
+
+SearchStats SearcherImpl::getSearchStats() const
+{
+	return m_stats;
+}
+
+bool SearcherImpl::load(string filenameBase)
+{
+	m_attachedIndexer = nullptr;
+	m_attachedCrawler = nullptr;
+	m_shards.clear();
+	m_shared = false;
+	m_sharedIndex = IndexSnapshot();
+	loadDocuments(filenameBase);
+	if (!m_searcherIndex.load(filenameBase))
+		return false;
+
+	// Searches only read the index, so it can go into its compact frozen form
+	m_searcherIndex.freeze(m_freezeMode);
+	return true;
+}
+
+bool SearcherImpl::loadShards(string filenameBase)
+{
+	m_attachedIndexer = nullptr;
+	m_attachedCrawler = nullptr;
+	m_shards.clear();
+	m_shared = false;
+	m_sharedIndex = IndexSnapshot();
+	loadDocuments(filenameBase);
+
+	string manifest;
+	if (!readWholeFile(filenameBase + ".shards", manifest))
+	{
+		std::cerr << "Error: Cannot read from " << filenameBase << ".shards" << std::endl;
+		return false;
+	}
+	const char* p = manifest.data();
+	int shardCount;
+	if (!getVarint(p, p + manifest.size(), shardCount) || shardCount <= 0)
+	{
+		std::cerr << "Error: corrupt shard manifest " << filenameBase << ".shards" << std::endl;
+		return false;
+	}
+
+	for (int k = 0; k < shardCount; k++)
 	{
-		if (m_unsortedSearchResults[z].occurences >= T)
+		shared_ptr<ShardServer> shard = make_shared<ShardServer>(k);
+		if (!shard->open(filenameBase))
 		{
-			tempUrl = m_unsortedSearchResults[z].url;
-			m_searchMatches.push_back(tempUrl);
+			m_shards.clear();
+			return false;
 		}
+		m_shards.push_back(shard);
 	}
-	
-	return m_searchMatches; 
+	return true;
 }
 
-bool SearcherImpl::load(string filenameBase)
+bool SearcherImpl::loadShared(string filenameBase)
+{
+	m_attachedIndexer = nullptr;
+	m_attachedCrawler = nullptr;
+	m_shards.clear();
+	m_shared = false;
+	m_sharedIndex = IndexSnapshot();
+	loadDocuments(filenameBase);
+
+	// Any number of searcher processes can map the same file; each one only
+	// holds its own per-query state on top of it
+	shared_ptr<const IndexSnapshotImpl> shared = openSharedIndex(filenameBase);
+	if (!shared)
+		return false;
+	m_sharedIndex = IndexSnapshot(shared);
+	m_shared = true;
+	return true;
+}
+
+// Memory held by each shard server, empty unless loaded with loadShards
+vector<size_t> SearcherImpl::getShardBytes() const
 {
-	return m_searcherIndex.load(filenameBase);
+	vector<size_t> bytes;
+	for (unsigned int k = 0; k < m_shards.size(); k++)
+		bytes.push_back(m_shards[k]->sizeInBytes());
+	return bytes;
+}
+
+string SearcherImpl::getSnippet(string url) const
+{
+	string text;
+	if (!m_documents.get(urlIdFor(url, HASH_TABLE_SIZE), text))
+		return "";
+
+	// Highlights the words of the last search: a phrase item's words each on
+	// their own, a prefix item with its *
+	vector<string> items = m_searchTerms;
+	items.insert(items.end(), m_filterTerms.begin(), m_filterTerms.end());
+	vector<string> words;
+	for (unsigned int i = 0; i < items.size(); i++)
+	{
+		const string& item = items[i];
+		if (item[0] != '"')
+		{
+			words.push_back(item);
+			continue;
+		}
+		Tokenizer t(item.substr(1, item.rfind('"') - 1));
+		string word;
+		while (t.getNextToken(word))
+			words.push_back(word);
+	}
+	return makeSnippet(text, words);
+}
+
+void SearcherImpl::loadDocuments(const string& filenameBase)
+{
+	// Most indexes are saved without page texts, so a missing store just
+	// means no snippets
+	m_documents.load(filenameBase + ".docs");
+}
+
+void SearcherImpl::attach(const Indexer& indexer)
+{
+	m_attachedIndexer = &indexer;
+	m_attachedCrawler = nullptr;
+	m_shards.clear();
+	m_shared = false;
+	m_sharedIndex = IndexSnapshot();
+	m_documents.clear();
+}
+
+void SearcherImpl::attach(const WebCrawler& crawler)
+{
+	m_attachedIndexer = nullptr;
+	m_attachedCrawler = &crawler;
+	m_shards.clear();
+	m_shared = false;
+	m_sharedIndex = IndexSnapshot();
+	m_documents.clear();
 }
 
 //******************** Searcher functions *******************************
@@ -210,7 +925,67 @@ vector<string> Searcher::search(string terms)
 	return m_impl->search(terms);
 }
 
+void Searcher::setRanking(RankingMode ranking)
+{
+	m_impl->setRanking(ranking);
+}
+
+void Searcher::setBudget(double maxMilliseconds, int maxPostings)
+{
+	m_impl->setBudget(maxMilliseconds, maxPostings);
+}
+
+void Searcher::setFrequentTerms(double minPageFraction, vector<string> stopwords)
+{
+	m_impl->setFrequentTerms(minPageFraction, stopwords);
+}
+
+void Searcher::setFreezeMode(FreezeMode mode)
+{
+	m_impl->setFreezeMode(mode);
+}
+
+bool Searcher::lastSearchWasPartial() const
+{
+	return m_impl->lastSearchWasPartial();
+}
+
+SearchStats Searcher::getSearchStats() const
+{
+	return m_impl->getSearchStats();
+}
+
 bool Searcher::load(string filenameBase)
 {
 	return m_impl->load(filenameBase);
 }
+
+bool Searcher::loadShards(string filenameBase)
+{
+	return m_impl->loadShards(filenameBase);
+}
+
+vector<size_t> Searcher::getShardBytes() const
+{
+	return m_impl->getShardBytes();
+}
+
+bool Searcher::loadShared(string filenameBase)
+{
+	return m_impl->loadShared(filenameBase);
+}
+
+string Searcher::getSnippet(string url) const
+{
+	return m_impl->getSnippet(url);
+}
+
+void Searcher::attach(const Indexer& indexer)
+{
+	m_impl->attach(indexer);
+}
+
+void Searcher::attach(const WebCrawler& crawler)
+{
+	m_impl->attach(crawler);
+}
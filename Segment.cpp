@@ -0,0 +1,856 @@
+#include "Segment.h"
+#include "Indexer.h"
+#include <queue>
+#include <memory>
+
+
+IndexSegment::IndexSegment(int generation)
+{
+	m_generation = generation;
+	m_postings = nullptr;
+	m_end = nullptr;
+	m_image = nullptr;
+	m_imageBytes = 0;
+	m_docTable = nullptr;
+	m_docCount = 0;
+}
+
+bool IndexSegment::open(const std::string& filename)
+{
+	std::string data;
+	if (!readWholeFile(filename, data))
+	{
+		std::cerr << "Error: Cannot read from " << filename << std::endl;
+		return false;
+	}
+
+	if (!openBuffer(data))
+	{
+		std::cerr << "Error: corrupt segment " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool IndexSegment::openBuffer(std::string& data)
+{
+	m_mapped.close();
+	m_arena.release();
+	m_docTable = nullptr;
+	m_data.swap(data);
+	const char* p = m_data.data();
+	const char* end = p + m_data.size();
+	m_postings = p;
+	m_end = end;
+
+	if (m_data.compare(0, SEGMENT_MAGIC_LENGTH, SEGMENT_MAGIC) != 0)
+		return false;
+	p += SEGMENT_MAGIC_LENGTH;
+
+	int docCount;
+	if (!getVarint(p, end, docCount))
+		return false;
+
+	m_docCount = docCount;
+	m_docIds.resize(docCount);
+	m_docUrls.resize(docCount);
+	for (int i = 0; i < docCount; i++)
+	{
+		if (!getVarint(p, end, m_docIds[i]) || !getString(p, end, m_docUrls[i]))
+			return false;
+		m_docsById.push_back(std::make_pair(m_docIds[i], i));
+	}
+	std::sort(m_docsById.begin(), m_docsById.end());
+
+	// Only where each term's postings start is recorded here; they are decoded on lookup
+	int termCount;
+	if (!getVarint(p, end, termCount))
+		return false;
+
+	m_terms.clear();
+	std::string term;
+	std::string previousTerm;
+	for (int i = 0; i < termCount; i++)
+	{
+		if (!getString(p, end, term) || (i > 0 && term <= previousTerm))
+			return false;
+		m_terms.add(term, p - m_data.data());
+		previousTerm.swap(term);
+
+		int postingCount;
+		if (!getVarint(p, end, postingCount))
+			return false;
+
+		unsigned long long skipped;
+		for (int k = 0; k < 2 * postingCount; k++)
+		{
+			if (!getVarint(p, end, skipped))
+				return false;
+		}
+	}
+
+	m_termFilter = BloomFilter();
+	if (p != end && !m_termFilter.decode(p, end))
+		return false;
+
+	return true;
+}
+
+bool IndexSegment::openMapped(const std::string& filename)
+{
+	m_arena.release();
+	if (!m_mapped.open(filename))
+	{
+		std::cerr << "Error: Cannot read from " << filename << std::endl;
+		return false;
+	}
+	if (!openImage(m_mapped.data(), m_mapped.size()))
+	{
+		std::cerr << "Error: corrupt shared index " << filename << std::endl;
+		m_mapped.close();
+		return false;
+	}
+	return true;
+}
+
+bool IndexSegment::openArena(MemoryArena& arena, size_t bytes)
+{
+	m_mapped.close();
+	m_arena.swap(arena);
+	if (bytes > m_arena.size() || !openImage(m_arena.data(), bytes))
+	{
+		m_arena.release();
+		return false;
+	}
+	return true;
+}
+
+bool IndexSegment::openImage(const char* image, size_t bytes)
+{
+	m_data.clear();
+	m_terms.clear();
+	m_docTable = nullptr;
+	m_docCount = 0;
+
+	const char* end = image + bytes;
+	const char* p = image + SHARED_HEADER_BYTES - 8 * SHARED_HEADER_FIELDS;
+	unsigned long long header[SHARED_HEADER_FIELDS];
+	bool valid = bytes >= static_cast<size_t>(SHARED_HEADER_BYTES) &&
+		std::string(image, SHARED_MAGIC_LENGTH) == SHARED_MAGIC;
+	for (int f = 0; f < SHARED_HEADER_FIELDS && valid; f++)
+		valid = getFixed64(p, end, header[f]);
+	if (!valid)
+		return false;
+
+	// The parts must follow each other in the order of the layout and end
+	// where the image does
+	unsigned long long docCount = header[0];
+	unsigned long long termCount = header[1];
+	unsigned long long blockTableOffset = header[2];
+	unsigned long long entriesOffset = header[3];
+	unsigned long long entriesBytes = header[4];
+	unsigned long long postingsOffset = header[5];
+	unsigned long long docTableOffset = header[6];
+	unsigned long long fileBytes = header[7];
+	unsigned long long blockCount = (termCount + TERM_BLOCK_SIZE - 1) / TERM_BLOCK_SIZE;
+	if (fileBytes != bytes || termCount >= 0x7FFFFFFF ||
+		blockTableOffset != static_cast<unsigned long long>(SHARED_HEADER_BYTES) ||
+		entriesOffset != blockTableOffset + 4 * blockCount || entriesOffset > fileBytes ||
+		entriesBytes > fileBytes - entriesOffset || postingsOffset != entriesOffset + entriesBytes ||
+		docTableOffset < postingsOffset || docTableOffset > fileBytes ||
+		docCount > (fileBytes - docTableOffset) / SHARED_DOC_ENTRY_BYTES)
+		return false;
+	if (!m_terms.view(image + entriesOffset, static_cast<size_t>(entriesBytes), image + blockTableOffset,
+		static_cast<int>(termCount)))
+		return false;
+
+	m_image = image;
+	m_imageBytes = bytes;
+	m_postings = image + postingsOffset;
+	m_end = image + docTableOffset;
+	m_docTable = image + docTableOffset;
+	m_docCount = static_cast<int>(docCount);
+	m_termFilter = BloomFilter();
+
+	// findUrl relies on the doc table being sorted
+	int previousId = -1;
+	int id;
+	for (int i = 0; i < m_docCount; i++)
+	{
+		if (!readImageDoc(i, id, nullptr) || id <= previousId)
+		{
+			m_terms.clear();
+			m_docTable = nullptr;
+			m_docCount = 0;
+			return false;
+		}
+		previousId = id;
+	}
+	return true;
+}
+
+bool IndexSegment::readImageDoc(int i, int& id, std::string* url) const
+{
+	const char* entry = m_docTable + static_cast<size_t>(i) * SHARED_DOC_ENTRY_BYTES;
+	id = static_cast<int>(fixed32At(entry));
+	size_t urlOffset = fixed32At(entry + 4);
+	if (id < 0 || urlOffset > m_imageBytes)
+		return false;
+	if (url == nullptr)
+		return true;
+
+	const char* p = m_image + urlOffset;
+	return getString(p, m_image + m_imageBytes, *url);
+}
+
+int IndexSegment::generation() const
+{
+	return m_generation;
+}
+
+size_t IndexSegment::sizeInBytes() const
+{
+	return m_docTable != nullptr ? m_imageBytes : m_data.size();
+}
+
+size_t IndexSegment::memoryBytes() const
+{
+	size_t bytes = sizeof(*this) + m_data.capacity() + m_arena.size() + m_termFilter.sizeInBytes() + m_terms.sizeInBytes() +
+		m_docIds.capacity() * sizeof(int) + m_docUrls.capacity() * sizeof(std::string) +
+		m_docsById.capacity() * sizeof(std::pair<int, int>);
+	for (unsigned int i = 0; i < m_docUrls.size(); i++)
+	{
+		if (m_docUrls[i].capacity() > SHORT_STRING_CAPACITY)
+			bytes += m_docUrls[i].capacity() + 1;
+	}
+	return bytes;
+}
+
+int IndexSegment::docCount() const
+{
+	return m_docCount;
+}
+
+void IndexSegment::getDoc(int i, int& id, std::string& url) const
+{
+	if (m_docTable != nullptr)
+	{
+		readImageDoc(i, id, &url);
+		return;
+	}
+	id = m_docIds[i];
+	url = m_docUrls[i];
+}
+
+bool IndexSegment::findUrl(int id, std::string& url) const
+{
+	if (m_docTable != nullptr)
+	{
+		int low = 0;
+		int high = m_docCount - 1;
+		int candidate;
+		while (low <= high)
+		{
+			int mid = low + (high - low) / 2;
+			readImageDoc(mid, candidate, nullptr);
+			if (candidate == id)
+				return readImageDoc(mid, candidate, &url);
+			if (candidate < id)
+				low = mid + 1;
+			else
+				high = mid - 1;
+		}
+		return false;
+	}
+
+	std::vector<std::pair<int, int> >::const_iterator it =
+		std::lower_bound(m_docsById.begin(), m_docsById.end(), std::make_pair(id, 0));
+	if (it == m_docsById.end() || it->first != id)
+		return false;
+	url = m_docUrls[it->second];
+	return true;
+}
+
+int IndexSegment::termCount() const
+{
+	return m_terms.size();
+}
+
+void IndexSegment::getTerm(int i, std::string& term) const
+{
+	unsigned long long offset;
+	m_terms.getTerm(i, term, offset);
+}
+
+void IndexSegment::getPostingsAt(int i, std::vector<HashedUrlCount>& postings) const
+{
+	std::string term;
+	unsigned long long offset;
+	m_terms.getTerm(i, term, offset);
+	decodePostings(offset, postings);
+}
+
+bool IndexSegment::getPostings(const std::string& term, std::vector<HashedUrlCount>& postings) const
+{
+	postings.clear();
+	if (!m_termFilter.mightContain(term))
+		return false;
+
+	unsigned long long offset;
+	if (!m_terms.find(term, offset))
+		return false;
+	decodePostings(offset, postings);
+	return true;
+}
+
+int IndexSegment::getPostingCount(const std::string& term) const
+{
+	unsigned long long offset;
+	if (!m_termFilter.mightContain(term) || !m_terms.find(term, offset) ||
+		offset >= static_cast<unsigned long long>(m_end - m_postings))
+		return 0;
+
+	const char* p = m_postings + offset;
+	int postingCount;
+	if (!getVarint(p, m_end, postingCount) || postingCount < 0 || postingCount > (m_end - p) / 2)
+		return 0;
+	return postingCount;
+}
+
+void IndexSegment::getTermsWithPrefix(const std::string& prefix, std::vector<std::string>& terms) const
+{
+	int first;
+	int last;
+	m_terms.prefixRange(prefix, first, last);
+
+	std::string term;
+	for (int i = first; i < last; i++)
+	{
+		getTerm(i, term);
+		terms.push_back(term);
+	}
+}
+
+void IndexSegment::decodePostings(unsigned long long offset, std::vector<HashedUrlCount>& postings) const
+{
+	// A segment file was validated by open, but of a mapped one only the
+	// dictionary was, so its postings are kept inside the file here (every
+	// posting takes at least two bytes)
+	postings.clear();
+	if (offset >= static_cast<unsigned long long>(m_end - m_postings))
+		return;
+	const char* p = m_postings + offset;
+	const char* end = m_end;
+	int postingCount;
+	if (!getVarint(p, end, postingCount) || postingCount < 0 || postingCount > (end - p) / 2)
+		return;
+
+	postings.resize(postingCount);
+	int id = 0;
+	for (int k = 0; k < postingCount; k++)
+	{
+		int gap = 0;
+		getVarint(p, end, gap);
+		id += gap;
+		postings[k].hashedUrl = id;
+		getVarint(p, end, postings[k].count);
+	}
+}
+
+//******************** SegmentWriter functions *******************************
+
+SegmentWriter::SegmentWriter(const BloomFilterOptions& bloom)
+{
+	m_docCount = 0;
+	m_termCount = 0;
+	m_bloomOptions = bloom;
+	m_scratchFailed = false;
+}
+
+SegmentWriter::SegmentWriter(const std::string& scratchFilename, const BloomFilterOptions& bloom)
+{
+	m_docCount = 0;
+	m_termCount = 0;
+	m_bloomOptions = bloom;
+	m_scratchFilename = scratchFilename;
+	m_scratch.open(scratchFilename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	m_scratchFailed = !m_scratch;
+	if (m_scratchFailed)
+		std::cerr << "Error: Cannot create " << scratchFilename << std::endl;
+}
+
+SegmentWriter::~SegmentWriter()
+{
+	// A writer that never got to write() leaves no scratch file behind
+	if (m_scratch.is_open())
+	{
+		m_scratch.close();
+		std::remove(m_scratchFilename.c_str());
+	}
+}
+
+void SegmentWriter::addDoc(int id, const std::string& url)
+{
+	putVarint(m_docs, id);
+	putString(m_docs, url);
+	m_docCount++;
+}
+
+void SegmentWriter::addTerm(const std::string& term, const std::vector<HashedUrlCount>& postings)
+{
+	putString(m_terms, term);
+	putVarint(m_terms, postings.size());
+
+	int previousId = 0;
+	for (unsigned int i = 0; i < postings.size(); i++)
+	{
+		putVarint(m_terms, postings[i].hashedUrl - previousId);
+		putVarint(m_terms, postings[i].count);
+		previousId = postings[i].hashedUrl;
+	}
+	m_termCount++;
+	m_termFingerprints.push_back(contentFingerprint(term));
+
+	if (!m_scratchFilename.empty() && m_terms.size() >= SEGMENT_IO_BUFFER_BYTES)
+		spillTerms();
+}
+
+bool SegmentWriter::spillTerms()
+{
+	if (!m_scratchFailed)
+	{
+		m_scratch.write(m_terms.data(), m_terms.size());
+		m_scratchFailed = !m_scratch;
+	}
+	m_terms.clear();
+	return !m_scratchFailed;
+}
+
+void SegmentWriter::finish(std::string& buf)
+{
+	buf.assign(SEGMENT_MAGIC, SEGMENT_MAGIC_LENGTH);
+	putVarint(buf, m_docCount);
+	buf += m_docs;
+	putVarint(buf, m_termCount);
+	buf += m_terms;
+	encodeTermFilter(buf);
+}
+
+void SegmentWriter::encodeTermFilter(std::string& buf) const
+{
+	BloomFilter filter;
+	filter.reset(m_termFingerprints.size(), m_bloomOptions);
+	for (unsigned int i = 0; i < m_termFingerprints.size(); i++)
+		filter.addFingerprint(m_termFingerprints[i]);
+	filter.encode(buf);
+}
+
+bool SegmentWriter::write(const std::string& filename)
+{
+	if (m_scratchFilename.empty())
+	{
+		std::string buf;
+		finish(buf);
+		return replaceWholeFile(filename, buf);
+	}
+
+	// The term count is only known now, so the header and pages go first and
+	// the terms collected in the scratch file are copied in after them
+	bool spilled = spillTerms();
+	m_scratch.close();
+	if (!spilled)
+	{
+		std::remove(m_scratchFilename.c_str());
+		return false;
+	}
+
+	std::string header(SEGMENT_MAGIC, SEGMENT_MAGIC_LENGTH);
+	putVarint(header, m_docCount);
+	header += m_docs;
+	putVarint(header, m_termCount);
+
+	std::string tempName = filename + ".tmp";
+	bool ok = writeWholeFile(tempName, header);
+	if (ok)
+	{
+		std::ifstream in(m_scratchFilename.c_str(), std::ios::in | std::ios::binary);
+		std::ofstream out(tempName.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+		std::string chunk(SEGMENT_IO_BUFFER_BYTES, '\0');
+		while (in && out)
+		{
+			in.read(&chunk[0], chunk.size());
+			out.write(chunk.data(), in.gcount());
+		}
+
+		std::string trailer;
+		encodeTermFilter(trailer);
+		out.write(trailer.data(), trailer.size());
+		ok = in.eof() && static_cast<bool>(out);
+	}
+	std::remove(m_scratchFilename.c_str());
+
+	if (!ok)
+	{
+		std::cerr << "Error: Cannot write " << filename << std::endl;
+		std::remove(tempName.c_str());
+		return false;
+	}
+	std::remove(filename.c_str());
+	return std::rename(tempName.c_str(), filename.c_str()) == 0;
+}
+
+//******************** SharedSegmentWriter functions *******************************
+
+SharedSegmentWriter::SharedSegmentWriter()
+{
+	m_size = 0;
+}
+
+void SharedSegmentWriter::addDoc(int id, const std::string& url)
+{
+	m_docs.push_back(std::make_pair(id, url));
+}
+
+void SharedSegmentWriter::addTerm(const std::string& term, const std::vector<HashedUrlCount>& postings)
+{
+	m_terms.add(term, m_postings.size());
+	putVarint(m_postings, postings.size());
+
+	int previousId = 0;
+	for (unsigned int i = 0; i < postings.size(); i++)
+	{
+		putVarint(m_postings, postings[i].hashedUrl - previousId);
+		putVarint(m_postings, postings[i].count);
+		previousId = postings[i].hashedUrl;
+	}
+}
+
+void SharedSegmentWriter::finish()
+{
+	m_blockTable.clear();
+	m_terms.encodeBlockTable(m_blockTable);
+
+	unsigned long long blockTableOffset = SHARED_HEADER_BYTES;
+	unsigned long long entriesOffset = blockTableOffset + m_blockTable.size();
+	unsigned long long postingsOffset = entriesOffset + m_terms.entries().size();
+	unsigned long long docTableOffset = postingsOffset + m_postings.size();
+
+	// The urls come right after the doc table, whose size is known up front
+	std::sort(m_docs.begin(), m_docs.end());
+	m_docTable.clear();
+	m_urls.clear();
+	size_t urlsOffset = static_cast<size_t>(docTableOffset) + m_docs.size() * SHARED_DOC_ENTRY_BYTES;
+	for (unsigned int i = 0; i < m_docs.size(); i++)
+	{
+		putFixed32(m_docTable, m_docs[i].first);
+		putFixed32(m_docTable, static_cast<unsigned int>(urlsOffset + m_urls.size()));
+		putString(m_urls, m_docs[i].second);
+	}
+	m_size = urlsOffset + m_urls.size();
+
+	m_header.assign(SHARED_MAGIC, SHARED_MAGIC_LENGTH);
+	m_header.resize(SHARED_HEADER_BYTES - 8 * SHARED_HEADER_FIELDS, '\0');
+	putFixed64(m_header, m_docs.size());
+	putFixed64(m_header, m_terms.size());
+	putFixed64(m_header, blockTableOffset);
+	putFixed64(m_header, entriesOffset);
+	putFixed64(m_header, m_terms.entries().size());
+	putFixed64(m_header, postingsOffset);
+	putFixed64(m_header, docTableOffset);
+	putFixed64(m_header, m_size);
+}
+
+size_t SharedSegmentWriter::size() const
+{
+	return m_size;
+}
+
+void SharedSegmentWriter::copyTo(char* out) const
+{
+	const std::string* parts[] = { &m_header, &m_blockTable, &m_terms.entries(), &m_postings, &m_docTable, &m_urls };
+	for (unsigned int i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+	{
+		std::copy(parts[i]->begin(), parts[i]->end(), out);
+		out += parts[i]->size();
+	}
+}
+
+bool SharedSegmentWriter::write(const std::string& filename)
+{
+	finish();
+	std::string buf(m_size, '\0');
+	copyTo(&buf[0]);
+
+	// Replaced by renaming, so processes that still have the old file mapped
+	// go on reading it undisturbed
+	return replaceWholeFile(filename, buf);
+}
+
+//******************** SegmentReader functions *******************************
+
+SegmentReader::SegmentReader(int generation)
+{
+	m_generation = generation;
+	m_p = nullptr;
+	m_end = nullptr;
+	m_docsLeft = 0;
+	m_termsLeft = 0;
+	m_failed = false;
+}
+
+bool SegmentReader::open(const std::string& filename)
+{
+	m_file.open(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!m_file)
+	{
+		std::cerr << "Error: Cannot read from " << filename << std::endl;
+		m_failed = true;
+		return false;
+	}
+
+	if (!readHeader())
+	{
+		std::cerr << "Error: corrupt segment " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool SegmentReader::open(const IndexSegment& segment)
+{
+	m_generation = segment.generation();
+	m_p = segment.m_data.data();
+	m_end = m_p + segment.m_data.size();
+	return readHeader();
+}
+
+int SegmentReader::generation() const
+{
+	return m_generation;
+}
+
+bool SegmentReader::readHeader()
+{
+	fill(SEGMENT_MAGIC_LENGTH);
+	if (m_end - m_p < SEGMENT_MAGIC_LENGTH || std::string(m_p, SEGMENT_MAGIC_LENGTH) != SEGMENT_MAGIC)
+	{
+		m_failed = true;
+		return false;
+	}
+	m_p += SEGMENT_MAGIC_LENGTH;
+	return readVarint(m_docsLeft);
+}
+
+bool SegmentReader::nextDoc(int& id, std::string& url)
+{
+	if (m_failed || m_docsLeft == 0)
+		return false;
+	if (!readVarint(id) || !readString(url))
+		return false;
+
+	// The term count follows the last page
+	if (--m_docsLeft == 0)
+		readVarint(m_termsLeft);
+	return !m_failed;
+}
+
+bool SegmentReader::nextTerm(std::string& term, std::vector<HashedUrlCount>& postings)
+{
+	int id;
+	std::string url;
+	while (m_docsLeft > 0)
+	{
+		if (!nextDoc(id, url))
+			return false;
+	}
+
+	if (m_failed || m_termsLeft == 0)
+		return false;
+
+	int postingCount;
+	if (!readString(term) || !readVarint(postingCount))
+		return false;
+
+	postings.resize(postingCount);
+	id = 0;
+	for (int k = 0; k < postingCount; k++)
+	{
+		int gap;
+		if (!readVarint(gap) || !readVarint(postings[k].count))
+			return false;
+		id += gap;
+		postings[k].hashedUrl = id;
+	}
+
+	m_termsLeft--;
+	return true;
+}
+
+bool SegmentReader::failed() const
+{
+	return m_failed;
+}
+
+bool SegmentReader::fill(size_t bytes)
+{
+	if (static_cast<size_t>(m_end - m_p) >= bytes)
+		return true;
+	if (!m_file.is_open())
+		return false;
+
+	// Keep the unread tail and top the buffer up from the file
+	size_t unread = m_end - m_p;
+	std::string rest(m_p, unread);
+	m_buffer.swap(rest);
+	size_t wanted = std::max(bytes, SEGMENT_IO_BUFFER_BYTES);
+	m_buffer.resize(unread + wanted);
+	m_file.read(&m_buffer[unread], wanted);
+	m_buffer.resize(unread + static_cast<size_t>(m_file.gcount()));
+
+	m_p = m_buffer.data();
+	m_end = m_p + m_buffer.size();
+	return m_buffer.size() >= bytes;
+}
+
+bool SegmentReader::readVarint(int& v)
+{
+	// A varint is at most 10 bytes, but the last one in the file may be shorter
+	fill(10);
+	if (!getVarint(m_p, m_end, v))
+		m_failed = true;
+	return !m_failed;
+}
+
+bool SegmentReader::readString(std::string& s)
+{
+	int length;
+	if (!readVarint(length))
+		return false;
+	if (length < 0 || !fill(length))
+	{
+		m_failed = true;
+		return false;
+	}
+	s.assign(m_p, length);
+	m_p += length;
+	return true;
+}
+
+//******************** Segment merging *******************************
+
+bool mergeSegments(const std::vector<const IndexSegment*>& inputs, const std::vector<int>& owner,
+	const std::string& filename, const BloomFilterOptions& bloom)
+{
+	std::vector<std::shared_ptr<SegmentReader> > readers;
+	std::vector<SegmentReader*> readerPointers;
+	for (unsigned int s = 0; s < inputs.size(); s++)
+	{
+		readers.push_back(std::make_shared<SegmentReader>(inputs[s]->generation()));
+		if (!readers.back()->open(*inputs[s]))
+			return false;
+		readerPointers.push_back(readers.back().get());
+	}
+	return mergeSegments(readerPointers, owner, filename, bloom);
+}
+
+// Adds the union of the inputs to writer; false if one of them is corrupt
+static bool mergeInto(SegmentWriter& writer, const std::vector<SegmentReader*>& inputs, const std::vector<int>& owner)
+{
+	// Only the pages still owned by their segment survive the merge
+	int id;
+	std::string url;
+	for (unsigned int s = 0; s < inputs.size(); s++)
+	{
+		while (inputs[s]->nextDoc(id, url))
+		{
+			if (owner[id] == inputs[s]->generation())
+				writer.addDoc(id, url);
+		}
+	}
+
+	// Each input's current term and postings; the cursor's position is unused
+	std::vector<std::vector<HashedUrlCount> > current(inputs.size());
+	std::priority_queue<MergeCursor, std::vector<MergeCursor>, MergeCursorGreater> cursors;
+	for (unsigned int s = 0; s < inputs.size(); s++)
+	{
+		MergeCursor cursor;
+		cursor.input = s;
+		cursor.position = 0;
+		if (inputs[s]->nextTerm(cursor.term, current[s]))
+			cursors.push(cursor);
+	}
+
+	std::vector<HashedUrlCount> merged;
+	while (!cursors.empty())
+	{
+		std::string term = cursors.top().term;
+		merged.clear();
+
+		// Collect this term's postings from every input that has it
+		while (!cursors.empty() && cursors.top().term == term)
+		{
+			MergeCursor cursor = cursors.top();
+			cursors.pop();
+
+			SegmentReader* input = inputs[cursor.input];
+			std::vector<HashedUrlCount>& postings = current[cursor.input];
+			for (unsigned int k = 0; k < postings.size(); k++)
+			{
+				if (owner[postings[k].hashedUrl] == input->generation())
+					merged.push_back(postings[k]);
+			}
+
+			if (input->nextTerm(cursor.term, postings))
+				cursors.push(cursor);
+		}
+
+		if (merged.empty())
+			continue;
+
+		// Each input is sorted by id and a page lives in only one of them
+		std::sort(merged.begin(), merged.end(), hashedUrlCountIdLess);
+		writer.addTerm(term, merged);
+	}
+
+	for (unsigned int s = 0; s < inputs.size(); s++)
+	{
+		if (inputs[s]->failed())
+			return false;
+	}
+	return true;
+}
+
+bool mergeSegments(const std::vector<SegmentReader*>& inputs, const std::vector<int>& owner,
+	const std::string& filename, const BloomFilterOptions& bloom)
+{
+	SegmentWriter writer(filename + ".terms", bloom);
+	if (!mergeInto(writer, inputs, owner))
+	{
+		std::cerr << "Error: a segment merged into " << filename << " is corrupt" << std::endl;
+		return false;
+	}
+	return writer.write(filename);
+}
+
+bool mergeSegmentsToBuffer(const std::vector<const IndexSegment*>& inputs, const std::vector<int>& owner,
+	std::string& buf, const BloomFilterOptions& bloom)
+{
+	std::vector<std::shared_ptr<SegmentReader> > readers;
+	std::vector<SegmentReader*> readerPointers;
+	for (unsigned int s = 0; s < inputs.size(); s++)
+	{
+		readers.push_back(std::make_shared<SegmentReader>(inputs[s]->generation()));
+		if (!readers.back()->open(*inputs[s]))
+			return false;
+		readerPointers.push_back(readers.back().get());
+	}
+
+	SegmentWriter writer(bloom);
+	if (!mergeInto(writer, readerPointers, owner))
+	{
+		std::cerr << "Error: a segment merged in memory is corrupt" << std::endl;
+		return false;
+	}
+	writer.finish(buf);
+	return true;
+}
@@ -0,0 +1,262 @@
+#ifndef SEGMENT_INCLUDED
+#define SEGMENT_INCLUDED
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <fstream>
+#include "TermDictionary.h"
+#include "BloomFilter.h"
+#include "MappedFile.h"
+
+struct HashedUrlCount;  // See Indexer.h
+
+// An index segment is an immutable, sorted slice of the index stored in its
+// own file. New pages are collected in memory (IndexerImpl::m_indexHashed) and
+// written out as a segment once enough of them have been incorporated; segments
+// are never modified afterwards, only merged into bigger segments and deleted.
+//
+// Segment file layout (all integers are varints, see BinaryIO.h):
+//
+//   "P4SEG1"
+//   docCount
+//   docCount * (id, url)						pages whose postings are in this segment
+//   termCount
+//   termCount * (term, postingCount,			terms in increasing std::string order
+//		postingCount * (idGap, count))			postings in increasing id order; each
+//												id is stored as the gap from the previous one
+//   [term Bloom filter]						see BloomFilter.h; missing in segments
+//												written before filters existed
+
+static const char SEGMENT_MAGIC[] = "P4SEG1";
+static const int SEGMENT_MAGIC_LENGTH = 6;
+
+// A shared index file (Indexer::saveShared) holds the same pages and postings,
+// laid out so that IndexSegment::openMapped can search it where it lies in a
+// read-only mapping instead of building tables from it. Everything in it is
+// found through offsets from the start of the file, never pointers, so any
+// number of processes can map it at whatever address and share its pages.
+// A frozen index (IndexerImpl::freeze) is laid out the same way in memory.
+//
+// The parts come in the order a query reads them: the dictionary, the posting
+// lists, then the urls of the pages they matched.
+//
+//   "P4SHM1", 2 bytes of padding
+//   fixed64 docCount, termCount, blockTableOffset, entriesOffset,
+//		entriesBytes, postingsOffset, docTableOffset, fileBytes
+//   blockCount * fixed32 blockOffset			the term dictionary (see TermDictionary.h),
+//   entries									whose values are offsets from postingsOffset
+//   termCount * (postingCount,					as in a segment, but without the terms
+//		postingCount * (idGap, count))
+//   docCount * (fixed32 id, fixed32 urlOffset)	sorted by id; urlOffset is where
+//												the page's (length-prefixed) url is
+//   docCount * url
+//
+// The fixed width numbers are little-endian (see BinaryIO.h).
+
+static const char SHARED_MAGIC[] = "P4SHM1";
+static const int SHARED_MAGIC_LENGTH = 6;
+static const int SHARED_HEADER_FIELDS = 8;
+static const int SHARED_HEADER_BYTES = 8 + 8 * SHARED_HEADER_FIELDS;
+static const int SHARED_DOC_ENTRY_BYTES = 8;
+
+// Segments written or read through a scratch file / SegmentReader go through
+// buffers of about this size instead of being held in memory whole
+static const size_t SEGMENT_IO_BUFFER_BYTES = 64 * 1024;
+
+class IndexSegment
+{
+public:
+	IndexSegment(int generation);
+	bool open(const std::string& filename);
+	bool openBuffer(std::string& data);  // takes over the contents of data
+
+	// Maps a shared index file and reads it in place. Such a segment holds no
+	// copy of the file, but it can't be merged or read by a SegmentReader.
+	bool openMapped(const std::string& filename);
+
+	// Reads the first bytes of arena, laid out as a shared index file, in place;
+	// takes over the arena. The same restrictions apply.
+	bool openArena(MemoryArena& arena, size_t bytes);
+
+	int generation() const;
+	size_t sizeInBytes() const;  // of the encoded segment, as it is on disk
+	size_t memoryBytes() const;  // with the dictionary, filter and doc tables built from it
+
+	// Pages stored in this segment
+	int docCount() const;
+	void getDoc(int i, int& id, std::string& url) const;
+	bool findUrl(int id, std::string& url) const;
+
+	// Terms in sorted order, for merging
+	int termCount() const;
+	void getTerm(int i, std::string& term) const;
+	void getPostingsAt(int i, std::vector<HashedUrlCount>& postings) const;
+
+	// Dictionary lookup of a term; false if the segment doesn't contain it
+	bool getPostings(const std::string& term, std::vector<HashedUrlCount>& postings) const;
+
+	// Length of a term's posting list (0 if it has none) without decoding it
+	int getPostingCount(const std::string& term) const;
+
+	// Every term in the segment that starts with prefix, in sorted order
+	void getTermsWithPrefix(const std::string& prefix, std::vector<std::string>& terms) const;
+
+private:
+	friend class SegmentReader;
+
+	void decodePostings(unsigned long long offset, std::vector<HashedUrlCount>& postings) const;
+	bool openImage(const char* image, size_t bytes);
+	bool readImageDoc(int i, int& id, std::string* url) const;
+
+	int m_generation;
+	std::string m_data;
+	BloomFilter m_termFilter;
+	TermDictionary m_terms;	// each term's postings offset from m_postings
+	std::vector<int> m_docIds;
+	std::vector<std::string> m_docUrls;
+	std::vector<std::pair<int, int> > m_docsById;  // (id, doc number) sorted by id
+
+	// Where the postings are (m_data, or the mapped file from its postings on)
+	// and where the encoded segment ends
+	const char* m_postings;
+	const char* m_end;
+
+	// Only for a shared index file or a frozen arena: where it is laid out, and
+	// its doc table, which stands in for the three vectors above
+	MappedFile m_mapped;
+	MemoryArena m_arena;
+	const char* m_image;
+	size_t m_imageBytes;
+	const char* m_docTable;
+	int m_docCount;
+};
+
+// Builds a segment file. Pages may be added in any order, but terms must be
+// added in increasing order with their postings sorted by id.
+//
+// A writer given a scratch file name keeps only SEGMENT_IO_BUFFER_BYTES of
+// encoded terms in memory and appends the rest to the scratch file, which
+// write() copies into place after the page list; finish() can't be used then.
+class SegmentWriter
+{
+public:
+	SegmentWriter(const BloomFilterOptions& bloom = BloomFilterOptions());
+	SegmentWriter(const std::string& scratchFilename, const BloomFilterOptions& bloom = BloomFilterOptions());
+	~SegmentWriter();
+	void addDoc(int id, const std::string& url);
+	void addTerm(const std::string& term, const std::vector<HashedUrlCount>& postings);
+	void finish(std::string& buf);
+	bool write(const std::string& filename);
+
+private:
+	bool spillTerms();
+	void encodeTermFilter(std::string& buf) const;
+
+	std::string m_docs;
+	int m_docCount;
+	std::string m_terms;
+	int m_termCount;
+	BloomFilterOptions m_bloomOptions;
+	std::vector<unsigned long long> m_termFingerprints;  // for the filter, which is sized at the end
+	std::string m_scratchFilename;
+	std::ofstream m_scratch;
+	bool m_scratchFailed;
+};
+
+// Reads a segment from front to back: all of its pages first, then its terms.
+// Opened on a file it only ever holds SEGMENT_IO_BUFFER_BYTES or so of it, which
+// is what lets merges work on segments much bigger than memory.
+class SegmentReader
+{
+public:
+	SegmentReader(int generation);
+	bool open(const std::string& filename);
+	bool open(const IndexSegment& segment);  // segment must outlive the reader
+
+	int generation() const;
+
+	// Each returns false once there is nothing more to read. nextTerm skips
+	// whatever pages haven't been read yet.
+	bool nextDoc(int& id, std::string& url);
+	bool nextTerm(std::string& term, std::vector<HashedUrlCount>& postings);
+
+	// True if the segment ended early or was corrupt
+	bool failed() const;
+
+private:
+	bool readHeader();
+	bool fill(size_t bytes);
+	bool readVarint(int& v);
+	bool readString(std::string& s);
+
+	int m_generation;
+	std::ifstream m_file;
+	std::string m_buffer;
+	const char* m_p;
+	const char* m_end;
+	int m_docsLeft;
+	int m_termsLeft;
+	bool m_failed;
+};
+
+// Builds a shared index file (see above). Pages may be added in any order, but
+// terms must be added in increasing order with their postings sorted by id.
+// Once everything is added, finish lays the parts out and copyTo puts them
+// wherever they should go.
+class SharedSegmentWriter
+{
+public:
+	SharedSegmentWriter();
+	void addDoc(int id, const std::string& url);
+	void addTerm(const std::string& term, const std::vector<HashedUrlCount>& postings);
+	void finish();
+	size_t size() const;
+	void copyTo(char* out) const;
+	bool write(const std::string& filename);
+
+private:
+	std::vector<std::pair<int, std::string> > m_docs;
+	std::string m_postings;
+	TermDictionary m_terms;
+
+	// Set by finish
+	std::string m_header;
+	std::string m_blockTable;
+	std::string m_docTable;
+	std::string m_urls;
+	size_t m_size;
+};
+
+// Priority queue entry for k-way merges of sorted term lists: the current
+// term of one input. Ties are broken by input number, so equal terms come
+// out in input order.
+struct MergeCursor
+{
+	std::string term;
+	int input;
+	int position;
+};
+
+struct MergeCursorGreater
+{
+	bool operator()(const MergeCursor& a, const MergeCursor& b) const
+	{
+		if (a.term != b.term)
+			return a.term > b.term;
+		return a.input > b.input;
+	}
+};
+
+// Writes the union of the given segments to filename, keeping only the pages
+// for which owner[id] is the generation of the segment they are read from
+bool mergeSegments(const std::vector<const IndexSegment*>& inputs, const std::vector<int>& owner,
+	const std::string& filename, const BloomFilterOptions& bloom = BloomFilterOptions());
+bool mergeSegments(const std::vector<SegmentReader*>& inputs, const std::vector<int>& owner,
+	const std::string& filename, const BloomFilterOptions& bloom = BloomFilterOptions());
+
+// The same, into buf instead of a file (for IndexSegment::openBuffer)
+bool mergeSegmentsToBuffer(const std::vector<const IndexSegment*>& inputs, const std::vector<int>& owner,
+	std::string& buf, const BloomFilterOptions& bloom = BloomFilterOptions());
+
+#endif // SEGMENT_INCLUDED
@@ -0,0 +1,133 @@
+#include "Shards.h"
+#include "Indexer.h"
+
+
+ShardServer::ShardServer(int shard)
+	: m_segment(shard)
+{
+	m_shard = shard;
+	m_stopping = false;
+}
+
+ShardServer::~ShardServer()
+{
+	if (!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_one();
+	m_thread.join();
+}
+
+bool ShardServer::open(const std::string& filenameBase)
+{
+	if (!m_segment.open(shardFileName(filenameBase, m_shard)))
+		return false;
+
+	// Shards written before lengths were saved can still rank by counts
+	m_lengths = std::make_shared<DocumentLengths>(HASH_TABLE_SIZE);
+	m_lengths->load(filenameBase + ".len");
+
+	m_thread = std::thread(&ShardServer::serve, this);
+	return true;
+}
+
+size_t ShardServer::sizeInBytes() const
+{
+	return m_segment.memoryBytes() + (m_lengths ? m_lengths->sizeInBytes() : 0);
+}
+
+std::future<std::vector<ShardMatch> > ShardServer::submit(const std::vector<std::string>& terms, RankingMode ranking)
+{
+	std::shared_ptr<Request> request = std::make_shared<Request>();
+	request->terms = terms;
+	request->prefix = false;
+	request->ranking = ranking;
+	return enqueue(request);
+}
+
+std::future<std::vector<ShardMatch> > ShardServer::submitPrefix(const std::string& prefix, RankingMode ranking)
+{
+	std::shared_ptr<Request> request = std::make_shared<Request>();
+	request->terms.push_back(prefix);
+	request->prefix = true;
+	request->ranking = ranking;
+	return enqueue(request);
+}
+
+std::future<std::vector<ShardMatch> > ShardServer::enqueue(std::shared_ptr<Request> request)
+{
+	std::future<std::vector<ShardMatch> > reply = request->reply.get_future();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_requests.push(request);
+	}
+	m_wake.notify_one();
+	return reply;
+}
+
+void ShardServer::serve()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stopping)
+	{
+		if (m_requests.empty())
+		{
+			m_wake.wait(lock);
+			continue;
+		}
+
+		std::shared_ptr<Request> request = m_requests.front();
+		m_requests.pop();
+		lock.unlock();
+		answer(*request);
+		lock.lock();
+	}
+}
+
+void ShardServer::answer(Request& request)
+{
+	// A prefix stands for all the terms it expands to, which count as one item
+	std::vector<std::string> terms;
+	if (request.prefix)
+		m_segment.getTermsWithPrefix(request.terms[0], terms);
+	else
+		terms = request.terms;
+
+	// Partial totals per page over the query terms this shard owns
+	MyMap<int, ShardMatch> totals;
+	std::vector<HashedUrlCount> postings;
+	std::vector<float> scores;
+	for (unsigned int t = 0; t < terms.size(); t++)
+	{
+		if (!m_segment.getPostings(terms[t], postings))
+			continue;
+		scoreHashedPostings(postings, *m_lengths, request.ranking, scores);
+
+		for (unsigned int i = 0; i < postings.size(); i++)
+		{
+			ShardMatch* match = totals.find(postings[i].hashedUrl);
+			if (match == nullptr)
+			{
+				ShardMatch newMatch;
+				m_segment.findUrl(postings[i].hashedUrl, newMatch.url);
+				newMatch.termsMatched = 0;
+				newMatch.score = 0;
+				totals.associate(postings[i].hashedUrl, newMatch);
+				match = totals.find(postings[i].hashedUrl);
+			}
+			match->termsMatched = request.prefix ? 1 : match->termsMatched + 1;
+			match->score += scores[i];
+		}
+	}
+
+	std::vector<ShardMatch> matches;
+	int id;
+	for (ShardMatch* match = totals.getFirst(id); match != nullptr; match = totals.getNext(id))
+		matches.push_back(*match);
+	request.reply.set_value(matches);
+}
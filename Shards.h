@@ -0,0 +1,95 @@
+#ifndef SHARDS_INCLUDED
+#define SHARDS_INCLUDED
+
+#include "provided.h"
+#include "Segment.h"
+#include "Ranking.h"
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+
+// Term-sharded deployment. Indexer::saveShards splits an index by term hash
+// into shardCount files, each an ordinary segment file (see Segment.h) with the
+// postings of its terms and the urls they refer to, plus a manifest
+// (filenameBase.shards) holding the shard count, and the page lengths of the
+// whole index (filenameBase.len) for ranking. Searcher::loadShards starts
+// one ShardServer thread per shard, so each one only ever holds its share of
+// the index.
+//
+// A query is scattered to the shards that own its terms. Each shard totals up,
+// per page, how many of the query terms it owns the page contains and the sum
+// of their scores (a term's postings are all on one shard, so its document
+// frequency is known there). The Searcher adds up those partial totals and
+// applies the usual T-of-N threshold and ordering by score. A prefix item (word*) can
+// match terms on every shard, so it goes to all of them and each page's totals
+// for it are combined separately, counting the item once per page.
+
+inline int shardOfTerm(const std::string& term, int shardCount)
+{
+	return static_cast<int>(contentFingerprint(term) % static_cast<unsigned long long>(shardCount));
+}
+
+inline std::string shardFileName(const std::string& filenameBase, int shard)
+{
+	return filenameBase + ".shard" + std::to_string(static_cast<long long>(shard));
+}
+
+// One shard's contribution to a page's result
+struct ShardMatch
+{
+	std::string url;
+	int termsMatched;
+	double score;
+};
+
+class ShardServer
+{
+public:
+	ShardServer(int shard);
+	~ShardServer();
+	bool open(const std::string& filenameBase);
+	size_t sizeInBytes() const;  // the memory the shard holds: its segment and its page lengths
+
+	// Queues a lookup of terms this shard owns; the reply arrives through the future
+	std::future<std::vector<ShardMatch> > submit(const std::vector<std::string>& terms, RankingMode ranking);
+
+	// Queues a lookup of all of this shard's terms starting with prefix. Each
+	// page matches at most once, with the scores of all those terms added up.
+	std::future<std::vector<ShardMatch> > submitPrefix(const std::string& prefix, RankingMode ranking);
+
+private:
+	struct Request
+	{
+		std::vector<std::string> terms;
+		bool prefix;  // terms[0] is a prefix
+		RankingMode ranking;
+		std::promise<std::vector<ShardMatch> > reply;
+	};
+
+	std::future<std::vector<ShardMatch> > enqueue(std::shared_ptr<Request> request);
+
+	void serve();
+	void answer(Request& request);
+
+	int m_shard;
+	IndexSegment m_segment;
+	std::shared_ptr<DocumentLengths> m_lengths;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::queue<std::shared_ptr<Request> > m_requests;
+	bool m_stopping;
+
+	// We prevent a ShardServer object from being copied or assigned by
+	// declaring the copy constructor and assignment operator private and
+	// not implementing them.
+	ShardServer(const ShardServer&);
+	ShardServer& operator=(const ShardServer&);
+};
+
+#endif // SHARDS_INCLUDED
@@ -0,0 +1,211 @@
+#include "TermDictionary.h"
+#include "BinaryIO.h"
+#include <algorithm>
+
+
+TermDictionary::TermDictionary()
+{
+	m_count = 0;
+	m_viewEntries = nullptr;
+	m_viewEntryBytes = 0;
+	m_viewBlockTable = nullptr;
+}
+
+void TermDictionary::clear()
+{
+	m_entries.clear();
+	m_blockOffsets.clear();
+	m_count = 0;
+	m_lastTerm.clear();
+	m_viewEntries = nullptr;
+	m_viewEntryBytes = 0;
+	m_viewBlockTable = nullptr;
+}
+
+void TermDictionary::add(const std::string& term, unsigned long long value)
+{
+	// The first term of each block stands on its own
+	size_t shared = 0;
+	if (m_count % TERM_BLOCK_SIZE == 0)
+		m_blockOffsets.push_back(m_entries.size());
+	else
+	{
+		size_t limit = std::min(m_lastTerm.size(), term.size());
+		while (shared < limit && m_lastTerm[shared] == term[shared])
+			shared++;
+	}
+
+	putVarint(m_entries, shared);
+	putVarint(m_entries, term.size() - shared);
+	m_entries.append(term, shared, std::string::npos);
+	putVarint(m_entries, value);
+
+	m_lastTerm = term;
+	m_count++;
+}
+
+const std::string& TermDictionary::entries() const
+{
+	return m_entries;
+}
+
+void TermDictionary::encodeBlockTable(std::string& buf) const
+{
+	for (unsigned int b = 0; b < m_blockOffsets.size(); b++)
+		putFixed32(buf, m_blockOffsets[b]);
+}
+
+bool TermDictionary::view(const char* entries, size_t entriesBytes, const char* blockTable, int count)
+{
+	clear();
+	if (count < 0)
+		return false;
+
+	// Every entry is decoded once here, so lookups can trust them as they do
+	// entries they added themselves
+	const char* p = entries;
+	const char* end = entries + entriesBytes;
+	for (int i = 0; i < count; i++)
+	{
+		if (i % TERM_BLOCK_SIZE == 0 && fixed32At(blockTable + 4 * (i / TERM_BLOCK_SIZE)) != static_cast<size_t>(p - entries))
+			return false;
+
+		int shared;
+		unsigned long long suffixLength;
+		unsigned long long value;
+		if (!getVarint(p, end, shared) || !getVarint(p, end, suffixLength) ||
+			shared < 0 || (i % TERM_BLOCK_SIZE == 0 && shared != 0) ||
+			suffixLength > static_cast<unsigned long long>(end - p))
+			return false;
+		p += suffixLength;
+		if (!getVarint(p, end, value))
+			return false;
+	}
+
+	m_viewEntries = entries;
+	m_viewEntryBytes = entriesBytes;
+	m_viewBlockTable = blockTable;
+	m_count = count;
+	return true;
+}
+
+const char* TermDictionary::entryData() const
+{
+	return m_viewEntries != nullptr ? m_viewEntries : m_entries.data();
+}
+
+size_t TermDictionary::entryBytes() const
+{
+	return m_viewEntries != nullptr ? m_viewEntryBytes : m_entries.size();
+}
+
+int TermDictionary::blockCount() const
+{
+	return (m_count + TERM_BLOCK_SIZE - 1) / TERM_BLOCK_SIZE;
+}
+
+size_t TermDictionary::blockOffset(int block) const
+{
+	return m_viewBlockTable != nullptr ? fixed32At(m_viewBlockTable + 4 * block) : m_blockOffsets[block];
+}
+
+int TermDictionary::size() const
+{
+	return m_count;
+}
+
+size_t TermDictionary::sizeInBytes() const
+{
+	return sizeof(*this) + m_entries.capacity() + m_blockOffsets.capacity() * sizeof(unsigned int) +
+		m_lastTerm.capacity();
+}
+
+void TermDictionary::getTerm(int i, std::string& term, unsigned long long& value) const
+{
+	// Entries were written by add or checked by view, so the reads below can't fail
+	const char* p = entryData() + blockOffset(i / TERM_BLOCK_SIZE);
+	const char* end = entryData() + entryBytes();
+	for (int k = i - i % TERM_BLOCK_SIZE; k <= i; k++)
+	{
+		int shared = 0;
+		int suffixLength = 0;
+		getVarint(p, end, shared);
+		getVarint(p, end, suffixLength);
+		term.resize(shared);
+		term.append(p, suffixLength);
+		p += suffixLength;
+		getVarint(p, end, value);
+	}
+}
+
+bool TermDictionary::find(const std::string& term, unsigned long long& value) const
+{
+	int i = lowerBound(term);
+	if (i == m_count)
+		return false;
+
+	std::string candidate;
+	getTerm(i, candidate, value);
+	return candidate == term;
+}
+
+int TermDictionary::lowerBound(const std::string& term) const
+{
+	// Find the last block whose first term isn't past term...
+	int low = 0;
+	int high = blockCount() - 1;
+	int block = -1;
+	std::string candidate;
+	unsigned long long value;
+	while (low <= high)
+	{
+		int mid = low + (high - low) / 2;
+		getTerm(mid * TERM_BLOCK_SIZE, candidate, value);
+		if (candidate <= term)
+		{
+			block = mid;
+			low = mid + 1;
+		}
+		else
+			high = mid - 1;
+	}
+	if (block == -1)
+		return 0;
+
+	// ...and walk through it
+	const char* p = entryData() + blockOffset(block);
+	const char* end = entryData() + entryBytes();
+	int last = std::min(m_count, (block + 1) * TERM_BLOCK_SIZE);
+	for (int i = block * TERM_BLOCK_SIZE; i < last; i++)
+	{
+		int shared = 0;
+		int suffixLength = 0;
+		getVarint(p, end, shared);
+		getVarint(p, end, suffixLength);
+		candidate.resize(shared);
+		candidate.append(p, suffixLength);
+		p += suffixLength;
+		getVarint(p, end, value);
+		if (candidate >= term)
+			return i;
+	}
+	return last;
+}
+
+void TermDictionary::prefixRange(const std::string& prefix, int& first, int& last) const
+{
+	first = lowerBound(prefix);
+
+	// The range ends at the first term past every term starting with prefix,
+	// which is the prefix with its last byte that can be incremented incremented
+	std::string limit = prefix;
+	while (!limit.empty() && static_cast<unsigned char>(limit[limit.size() - 1]) == 0xFF)
+		limit.erase(limit.size() - 1);
+	if (limit.empty())
+	{
+		last = m_count;
+		return;
+	}
+	limit[limit.size() - 1]++;
+	last = lowerBound(limit);
+}
@@ -0,0 +1,75 @@
+#ifndef TERMDICTIONARY_INCLUDED
+#define TERMDICTIONARY_INCLUDED
+
+#include <string>
+#include <vector>
+
+// Immutable sorted map from term to a 64-bit value (a segment uses it for the
+// offset of each term's postings). Terms are front-coded in blocks of
+// TERM_BLOCK_SIZE: the first term of a block is stored whole, every other one
+// as the length it shares with the term before it plus the rest.
+//
+// Entry layout (all integers are varints, see BinaryIO.h):
+//
+//   sharedLength, suffix (length-prefixed), value
+//
+// Lookups binary search the blocks by their first term and then decode at
+// most one block, so terms cost a few bytes each instead of a string plus a
+// tree node, and all terms with a given prefix form one contiguous range.
+//
+// A dictionary can also read entries and block offsets someone else holds, such
+// as a mapped file (see view), without copying them.
+
+static const int TERM_BLOCK_SIZE = 16;
+
+class TermDictionary
+{
+public:
+	TermDictionary();
+
+	// Building: terms must be added in strictly increasing order
+	void clear();
+	void add(const std::string& term, unsigned long long value);
+
+	// The encoded dictionary: its entries, and its block offsets as one fixed32
+	// each (see BinaryIO.h)
+	const std::string& entries() const;
+	void encodeBlockTable(std::string& buf) const;
+
+	// Reads count terms from entries and a block table laid out as above, in
+	// place; they must outlive the dictionary or the next clear. False if they
+	// don't decode.
+	bool view(const char* entries, size_t entriesBytes, const char* blockTable, int count);
+
+	int size() const;
+	size_t sizeInBytes() const;
+
+	// The i-th term in sorted order
+	void getTerm(int i, std::string& term, unsigned long long& value) const;
+
+	bool find(const std::string& term, unsigned long long& value) const;
+
+	// Number of the first term that isn't less than term (size() if there is none)
+	int lowerBound(const std::string& term) const;
+
+	// Numbers [first, last) of the terms that start with prefix
+	void prefixRange(const std::string& prefix, int& first, int& last) const;
+
+private:
+	const char* entryData() const;
+	size_t entryBytes() const;
+	int blockCount() const;
+	size_t blockOffset(int block) const;
+
+	std::string m_entries;
+	std::vector<unsigned int> m_blockOffsets;  // where each block starts in m_entries
+	int m_count;
+	std::string m_lastTerm;
+
+	// Set by view instead of the two above
+	const char* m_viewEntries;
+	size_t m_viewEntryBytes;
+	const char* m_viewBlockTable;
+};
+
+#endif // TERMDICTIONARY_INCLUDED
@@ -0,0 +1,284 @@
+#include "UrlDictionary.h"
+#include "BinaryIO.h"
+#include <algorithm>
+
+
+UrlDictionary::UrlDictionary(int idLimit)
+{
+	m_idLimit = idLimit;
+	clear();
+}
+
+int UrlDictionary::idFor(const std::string& url) const
+{
+	return urlIdFor(url, m_idLimit);
+}
+
+void UrlDictionary::clear()
+{
+	m_entries.clear();
+	m_entryCount = 0;
+	m_blockOffsets.clear();
+	m_position.assign(m_idLimit, -1);
+	m_erasedCount = 0;
+	m_pending.clear();
+}
+
+int UrlDictionary::size() const
+{
+	return m_entryCount - m_erasedCount + m_pending.size();
+}
+
+void UrlDictionary::insert(int id, const std::string& url)
+{
+	m_pending.push_back(std::make_pair(id, url));
+	if (m_pending.size() >= static_cast<unsigned int>(URL_PENDING_LIMIT))
+		rebuild();
+}
+
+void UrlDictionary::erase(int id)
+{
+	for (unsigned int i = 0; i < m_pending.size(); i++)
+	{
+		if (m_pending[i].first == id)
+		{
+			m_pending.erase(m_pending.begin() + i);
+			return;
+		}
+	}
+
+	// The entry stays in its block until the next rebuild, but no id leads to it
+	if (m_position[id] != -1)
+	{
+		m_position[id] = -1;
+		m_erasedCount++;
+	}
+}
+
+bool UrlDictionary::findUrl(int id, std::string& url) const
+{
+	if (id < 0 || id >= m_idLimit)
+		return false;
+
+	if (m_position[id] != -1)
+	{
+		int storedId;
+		entryAt(m_position[id], url, storedId);
+		return true;
+	}
+
+	for (unsigned int i = 0; i < m_pending.size(); i++)
+	{
+		if (m_pending[i].first == id)
+		{
+			url = m_pending[i].second;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool UrlDictionary::findId(const std::string& url, int& id) const
+{
+	for (unsigned int i = 0; i < m_pending.size(); i++)
+	{
+		if (m_pending[i].second == url)
+		{
+			id = m_pending[i].first;
+			return true;
+		}
+	}
+
+	// Find the last block whose first url isn't past url...
+	int low = 0;
+	int high = static_cast<int>(m_blockOffsets.size()) - 1;
+	int block = -1;
+	std::string candidate;
+	int candidateId;
+	while (low <= high)
+	{
+		int mid = low + (high - low) / 2;
+		entryAt(mid * URL_BLOCK_SIZE, candidate, candidateId);
+		if (candidate <= url)
+		{
+			block = mid;
+			low = mid + 1;
+		}
+		else
+			high = mid - 1;
+	}
+	if (block == -1)
+		return false;
+
+	// ...and look through it
+	const char* p = m_entries.data() + m_blockOffsets[block];
+	const char* end = m_entries.data() + m_entries.size();
+	int last = std::min(m_entryCount, (block + 1) * URL_BLOCK_SIZE);
+	std::string suffix;
+	for (int position = block * URL_BLOCK_SIZE; position < last; position++)
+	{
+		int shared = 0;
+		getVarint(p, end, shared);
+		getString(p, end, suffix);
+		getVarint(p, end, candidateId);
+		candidate.resize(shared);
+		candidate += suffix;
+
+		if (candidate == url)
+		{
+			if (!live(position, candidateId))
+				return false;
+			id = candidateId;
+			return true;
+		}
+		if (candidate > url)
+			return false;
+	}
+	return false;
+}
+
+void UrlDictionary::getIds(std::vector<int>& ids) const
+{
+	ids.clear();
+	for (int id = 0; id < m_idLimit; id++)
+	{
+		if (m_position[id] != -1)
+			ids.push_back(id);
+	}
+	for (unsigned int i = 0; i < m_pending.size(); i++)
+		ids.push_back(m_pending[i].first);
+	std::sort(ids.begin(), ids.end());
+}
+
+size_t UrlDictionary::sizeInBytes() const
+{
+	size_t bytes = sizeof(*this) + m_entries.capacity() +
+		m_blockOffsets.capacity() * sizeof(unsigned int) + m_position.capacity() * sizeof(int);
+	for (unsigned int i = 0; i < m_pending.size(); i++)
+		bytes += sizeof(m_pending[i]) + m_pending[i].second.capacity();
+	return bytes;
+}
+
+bool UrlDictionary::save(const std::string& filename)
+{
+	rebuild();
+
+	std::string buf;
+	putVarint(buf, m_entryCount);
+	buf += m_entries;
+	return replaceWholeFile(filename, buf);
+}
+
+bool UrlDictionary::load(const std::string& filename)
+{
+	clear();
+
+	std::string buf;
+	if (!readWholeFile(filename, buf))
+	{
+		std::cerr << "Error: Cannot read from " << filename << std::endl;
+		return false;
+	}
+
+	const char* p = buf.data();
+	if (!getVarint(p, buf.data() + buf.size(), m_entryCount))
+		m_entryCount = -1;
+	m_entries.assign(p, static_cast<const char*>(buf.data() + buf.size()));
+
+	if (m_entryCount < 0 || !index())
+	{
+		std::cerr << "Error: corrupt url file " << filename << std::endl;
+		clear();
+		return false;
+	}
+	return true;
+}
+
+void UrlDictionary::rebuild()
+{
+	if (m_pending.empty() && m_erasedCount == 0)
+		return;
+
+	// Everything still live, sorted by url
+	std::vector<std::pair<std::string, int> > urls;
+	std::string url;
+	int id;
+	for (int position = 0; position < m_entryCount; position++)
+	{
+		entryAt(position, url, id);
+		if (live(position, id))
+			urls.push_back(std::make_pair(url, id));
+	}
+	for (unsigned int i = 0; i < m_pending.size(); i++)
+		urls.push_back(std::make_pair(m_pending[i].second, m_pending[i].first));
+	std::sort(urls.begin(), urls.end());
+
+	m_entries.clear();
+	std::string previous;
+	for (unsigned int i = 0; i < urls.size(); i++)
+	{
+		// The first entry of each block stands on its own
+		size_t shared = 0;
+		if (i % URL_BLOCK_SIZE != 0)
+		{
+			size_t limit = std::min(previous.size(), urls[i].first.size());
+			while (shared < limit && previous[shared] == urls[i].first[shared])
+				shared++;
+		}
+
+		putVarint(m_entries, shared);
+		putString(m_entries, urls[i].first.substr(shared));
+		putVarint(m_entries, urls[i].second);
+		previous = urls[i].first;
+	}
+	m_entryCount = urls.size();
+	m_pending.clear();
+	index();
+}
+
+bool UrlDictionary::index()
+{
+	// Finds the blocks and the entry number of every id, checking the entries on the way
+	m_blockOffsets.clear();
+	m_position.assign(m_idLimit, -1);
+	m_erasedCount = 0;
+
+	const char* p = m_entries.data();
+	const char* end = p + m_entries.size();
+	std::string suffix;
+	for (int position = 0; position < m_entryCount; position++)
+	{
+		if (position % URL_BLOCK_SIZE == 0)
+			m_blockOffsets.push_back(p - m_entries.data());
+
+		int shared;
+		int id;
+		if (!getVarint(p, end, shared) || !getString(p, end, suffix) || !getVarint(p, end, id) ||
+			id < 0 || id >= m_idLimit || (position % URL_BLOCK_SIZE == 0 && shared != 0))
+			return false;
+		m_position[id] = position;
+	}
+	return p == end;
+}
+
+void UrlDictionary::entryAt(int position, std::string& url, int& id) const
+{
+	// The entries were checked by index, so the reads below can't fail
+	const char* p = m_entries.data() + m_blockOffsets[position / URL_BLOCK_SIZE];
+	const char* end = m_entries.data() + m_entries.size();
+	std::string suffix;
+	for (int i = position - position % URL_BLOCK_SIZE; i <= position; i++)
+	{
+		int shared = 0;
+		getVarint(p, end, shared);
+		getString(p, end, suffix);
+		getVarint(p, end, id);
+		url.resize(shared);
+		url += suffix;
+	}
+}
+
+bool UrlDictionary::live(int position, int id) const
+{
+	return m_position[id] == position;
+}
@@ -0,0 +1,74 @@
+#ifndef URLDICTIONARY_INCLUDED
+#define URLDICTIONARY_INCLUDED
+
+#include <string>
+#include <vector>
+#include <utility>
+
+// The one copy of every incorporated url, kept front-coded. Urls are sorted
+// and stored in blocks of URL_BLOCK_SIZE entries; the first entry of a block
+// holds its whole url and every other entry only the part that differs from
+// the url before it (within a site that is usually just the end of the path).
+//
+// Entry layout (all integers are varints, see BinaryIO.h):
+//
+//   sharedLength, suffix (length-prefixed), id
+//
+// id -> url finds the entry's block directly and decodes at most a block;
+// url -> id binary searches the blocks by their first url. Urls inserted since
+// the last rebuild wait in a short list and are folded into the blocks once
+// there are URL_PENDING_LIMIT of them.
+
+static const int URL_BLOCK_SIZE = 16;
+static const int URL_PENDING_LIMIT = 64;
+
+// The id a url is filed under in a dictionary with ids in [0, idLimit)
+inline int urlIdFor(const std::string& url, int idLimit)
+{
+	int total = 0;
+
+	for (unsigned int i = 0; i < url.length(); i++)
+		total = total + (i + 1) * url[i];
+
+	total = total % idLimit;
+
+	return total;
+}
+
+class UrlDictionary
+{
+public:
+	UrlDictionary(int idLimit);
+
+	// The id a url is filed under (ids are in [0, idLimit))
+	int idFor(const std::string& url) const;
+
+	void clear();
+	int size() const;
+	void insert(int id, const std::string& url);  // id must not be in use
+	void erase(int id);
+	bool findUrl(int id, std::string& url) const;
+	bool findId(const std::string& url, int& id) const;
+	void getIds(std::vector<int>& ids) const;  // in increasing order
+	size_t sizeInBytes() const;
+
+	// File: entry count, then the entries in url order
+	bool save(const std::string& filename);
+	bool load(const std::string& filename);
+
+private:
+	void rebuild();
+	bool index();
+	void entryAt(int position, std::string& url, int& id) const;
+	bool live(int position, int id) const;
+
+	int m_idLimit;
+	std::string m_entries;
+	int m_entryCount;
+	std::vector<unsigned int> m_blockOffsets;  // where each block starts in m_entries
+	std::vector<int> m_position;  // entry number of each id, -1 if not in the blocks (or erased)
+	int m_erasedCount;  // entries in the blocks whose id has been erased
+	std::vector<std::pair<int, std::string> > m_pending;  // (id, url) inserted since the last rebuild
+};
+
+#endif // URLDICTIONARY_INCLUDED
@@ -1,7 +1,28 @@
 #include "provided.h"
+#include "Indexer.h"
+#include "DocumentStore.h"
+#include "MyMap.h"
+#include "BinaryIO.h"
+#include "Metrics.h"
 #include <string>
 #include <list>
 
+// Record tags used in the crawl frontier journal (filenameBase + ".frt").
+// The journal is a sequence of records, each one a tag byte followed by its
+// payload. A full snapshot is just the records needed to rebuild the current
+// state; later saves append only the records generated since the last save.
+const char FRONTIER_ADD = 'A';		// url			addUrl(url)
+const char FRONTIER_VISIT = 'V';	// url, success	url popped off the frontier and fetched
+const char FRONTIER_SEEN = 'S';		// url, success	url already visited in the current pass (snapshot only)
+const char FRONTIER_DONE = 'C';		//				crawl pass finished, seen set cleared
+const char FRONTIER_COUNT = 'N';	// count		m_numberOfUrls (snapshot only)
+
+// Once the journal is this many times the size a fresh snapshot would be (and
+// at least FRONTIER_COMPACT_MIN_BYTES), a save rewrites it as a snapshot, so
+// loading doesn't take longer and longer as the crawl goes on
+const size_t FRONTIER_COMPACT_RATIO = 4;
+const size_t FRONTIER_COMPACT_MIN_BYTES = 64 * 1024;
+
 
 class WebCrawlerImpl
 {
@@ -10,19 +31,51 @@ public:
 	void addUrl(std::string url);
 	int getNumberOfUrls() const;
 	void crawl(void(*callback)(std::string url, bool success));
+	void setNearDuplicatePolicy(NearDuplicatePolicy policy);
+	DedupStats getDedupStats() const;
+	void enablePositions();
+	void enableSnapshots();
+	void enableDocumentStore();
+	IndexSnapshot snapshot() const;
 	bool save(std::string filenameBase);
 	bool load(std::string filenameBase);
 
 private:
+	// Private methods
+	void markVisited(const std::string& url, bool success);
+	std::string frontierSnapshot();
+	bool replayFrontier(const std::string& journal, size_t& goodBytes);
+
+	// Private data members
 	Indexer m_webCrawlerIndex;
 	int m_numberOfUrls;
 	std::list<std::string> m_storedUrls;
 
+	// URLs already fetched during the current crawl pass, with the outcome of the
+	// fetch. A url added twice in one pass (or re-added before an interrupted
+	// crawl is resumed) is reported from here instead of being fetched again.
+	MyMap<std::string, bool> m_seenUrls;
+
+	// Frontier records generated since the last save/load, and the filenameBase
+	// whose .frt file they can be appended to (empty if none is in sync with us)
+	std::string m_journal;
+	std::string m_journalBase;
+	size_t m_journalFileBytes;  // size of m_journalBase's .frt file
+	size_t m_snapshotBytes;  // size of the last snapshot made, 0 if none has been since the load
+
+	// Visible text of the incorporated pages, for snippets; only kept (and saved
+	// as filenameBase.docs) once enabled
+	DocumentStore m_documents;
+	bool m_documentsEnabled;
 };
 
 WebCrawlerImpl::WebCrawlerImpl()
+	: m_documents(HASH_TABLE_SIZE)
 {
 	m_numberOfUrls = 0;
+	m_documentsEnabled = false;
+	m_journalFileBytes = 0;
+	m_snapshotBytes = 0;
 }
 
 void WebCrawlerImpl::addUrl(std::string url)
@@ -30,6 +83,9 @@ void WebCrawlerImpl::addUrl(std::string url)
 	// Stores URL but does not crawl. See crawl function
 	m_storedUrls.push_front(url);  // Push front so same order when crawled
 	m_numberOfUrls++;
+
+	m_journal += FRONTIER_ADD;
+	putString(m_journal, url);
 }
 
 int WebCrawlerImpl::getNumberOfUrls() const
@@ -53,12 +109,33 @@ void WebCrawlerImpl::crawl(void(*callback)(std::string url, bool success))
 		url = m_storedUrls.back();
 		m_storedUrls.pop_back();
 
+		// Already fetched earlier in this pass, possibly before a save/load
+		const bool* seenSuccess = m_seenUrls.find(url);
+		if (seenSuccess != nullptr)
+		{
+			success = *seenSuccess;
+			markVisited(url, success);
+			callback(url, success);
+			continue;
+		}
+
 		// Step 1
-		if (HTTP().get(url, page))
+		METRIC_CLOCK(fetchStart);
+		bool fetched = HTTP().get(url, page);
+		METRIC_LAP(HISTOGRAM_FETCH, fetchStart);
+		METRIC_ADD(fetched ? COUNTER_PAGES_FETCHED : COUNTER_FETCH_FAILURES, 1);
+		METRIC_ADD(COUNTER_BYTES_FETCHED, fetched ? page.size() : 0);
+		if (fetched)
 		{
-			// Step 2
-			WordBag wb(page);
-			m_webCrawlerIndex.incorporate(url, wb);
+			// Step 2. A page that hasn't changed since it was last incorporated
+			// is not tokenized again.
+			unsigned long long fingerprint = contentFingerprint(page);
+			if (!m_webCrawlerIndex.isUnchanged(url, fingerprint))
+			{
+				WordBag wb(page, m_webCrawlerIndex.positionsEnabled());
+				if (m_webCrawlerIndex.incorporate(url, wb, fingerprint) && m_documentsEnabled)
+					m_documents.add(urlIdFor(url, HASH_TABLE_SIZE), visibleText(page));
+			}
 
 			// TODO: REMOVE AFTER TESTING
 			/*std::string word;
@@ -77,19 +154,207 @@ void WebCrawlerImpl::crawl(void(*callback)(std::string url, bool success))
 		else
 			success = false;
 
+		markVisited(url, success);
+
 		// Step 3
 		callback(url, success);
 	}
+
+	// The frontier has been drained, so the next crawl pass starts with an
+	// empty seen set and is free to fetch pages again.
+	m_seenUrls.clear();
+	m_journal += FRONTIER_DONE;
+}
+
+void WebCrawlerImpl::setNearDuplicatePolicy(NearDuplicatePolicy policy)
+{
+	m_webCrawlerIndex.setNearDuplicatePolicy(policy);
+}
+
+DedupStats WebCrawlerImpl::getDedupStats() const
+{
+	return m_webCrawlerIndex.getDedupStats();
+}
+
+void WebCrawlerImpl::enablePositions()
+{
+	m_webCrawlerIndex.enablePositions();
+}
+
+void WebCrawlerImpl::enableSnapshots()
+{
+	m_webCrawlerIndex.enableSnapshots();
+}
+
+void WebCrawlerImpl::enableDocumentStore()
+{
+	m_documentsEnabled = true;
+}
+
+IndexSnapshot WebCrawlerImpl::snapshot() const
+{
+	return m_webCrawlerIndex.snapshot();
 }
 
 bool WebCrawlerImpl::save(std::string filenameBase)
 {
-	return m_webCrawlerIndex.save(filenameBase);
+	if (!m_webCrawlerIndex.save(filenameBase))
+		return false;
+	if (m_documentsEnabled && !m_documents.save(filenameBase + ".docs"))
+		return false;
+
+	// If the .frt file already holds everything up to the last save we only have
+	// to append what happened since then. Otherwise (first save, or saving under
+	// a different name) write a fresh snapshot of the frontier and seen set.
+	// A journal that has grown well past the snapshot it could be replaced by
+	// is rewritten as that snapshot instead.
+	std::string frontierFile = filenameBase + ".frt";
+	std::string snapshot;
+	bool append = filenameBase == m_journalBase;
+	size_t journalBytes = m_journalFileBytes + m_journal.size();
+	if (append && journalBytes > FRONTIER_COMPACT_MIN_BYTES && journalBytes > FRONTIER_COMPACT_RATIO * m_snapshotBytes)
+	{
+		snapshot = frontierSnapshot();
+		m_snapshotBytes = snapshot.size();
+		append = journalBytes <= FRONTIER_COMPACT_RATIO * m_snapshotBytes;
+	}
+
+	bool saved;
+	if (append)
+		saved = appendToFile(frontierFile, m_journal);
+	else
+	{
+		if (snapshot.empty())
+			snapshot = frontierSnapshot();
+		m_snapshotBytes = snapshot.size();
+		saved = replaceWholeFile(frontierFile, snapshot);
+		journalBytes = snapshot.size();
+	}
+
+	if (!saved)
+	{
+		m_journalBase.clear();
+		return false;
+	}
+
+	m_journal.clear();
+	m_journalBase = filenameBase;
+	m_journalFileBytes = journalBytes;
+	return true;
 }
 
 bool WebCrawlerImpl::load(std::string filenameBase)
 {
-	return m_webCrawlerIndex.load(filenameBase);
+	if (!m_webCrawlerIndex.load(filenameBase))
+		return false;
+
+	// A crawl saved before the store was enabled simply starts with an empty one
+	if (m_documentsEnabled)
+		m_documents.load(filenameBase + ".docs");
+
+	// Indexes saved before the frontier was persisted have no .frt file; they
+	// load with an empty frontier, just like they used to.
+	m_storedUrls.clear();
+	m_seenUrls.clear();
+	m_numberOfUrls = 0;
+	m_journal.clear();
+	m_journalBase.clear();
+	m_journalFileBytes = 0;
+	m_snapshotBytes = 0;
+
+	// New records can only be appended after complete ones. If the last record
+	// was torn, the next save writes a fresh snapshot over the file instead.
+	std::string journal;
+	if (readWholeFile(filenameBase + ".frt", journal))
+	{
+		size_t goodBytes;
+		if (!replayFrontier(journal, goodBytes))
+			return false;
+		if (goodBytes == journal.size())
+		{
+			m_journalBase = filenameBase;
+			m_journalFileBytes = goodBytes;
+		}
+	}
+
+	return true;
+}
+
+void WebCrawlerImpl::markVisited(const std::string& url, bool success)
+{
+	m_seenUrls.associate(url, success);
+
+	m_journal += FRONTIER_VISIT;
+	putString(m_journal, url);
+	m_journal += static_cast<char>(success ? 1 : 0);
+}
+
+std::string WebCrawlerImpl::frontierSnapshot()
+{
+	std::string snapshot;
+
+	std::string url;
+	for (bool* success = m_seenUrls.getFirst(url); success != nullptr; success = m_seenUrls.getNext(url))
+	{
+		snapshot += FRONTIER_SEEN;
+		putString(snapshot, url);
+		snapshot += static_cast<char>(*success ? 1 : 0);
+	}
+
+	// Replaying FRONTIER_ADD pushes to the front, so write the oldest url first
+	for (std::list<std::string>::reverse_iterator it = m_storedUrls.rbegin(); it != m_storedUrls.rend(); ++it)
+	{
+		snapshot += FRONTIER_ADD;
+		putString(snapshot, *it);
+	}
+
+	snapshot += FRONTIER_COUNT;
+	putVarint(snapshot, m_numberOfUrls);
+
+	return snapshot;
+}
+
+bool WebCrawlerImpl::replayFrontier(const std::string& journal, size_t& goodBytes)
+{
+	const char* p = journal.data();
+	const char* end = p + journal.size();
+	std::string url;
+
+	// A record cut short by a crash during an append is simply dropped; all the
+	// records before it are complete, and goodBytes is where they end.
+	for (goodBytes = 0; p != end; goodBytes = p - journal.data())
+	{
+		char tag = *p++;
+		switch (tag)
+		{
+		case FRONTIER_ADD:
+			if (!getString(p, end, url))
+				return true;
+			m_storedUrls.push_front(url);
+			m_numberOfUrls++;
+			break;
+		case FRONTIER_VISIT:
+		case FRONTIER_SEEN:
+			if (!getString(p, end, url) || p == end)
+				return true;
+			m_seenUrls.associate(url, *p++ != 0);
+			if (tag == FRONTIER_VISIT && !m_storedUrls.empty())
+				m_storedUrls.pop_back();
+			break;
+		case FRONTIER_DONE:
+			m_seenUrls.clear();
+			break;
+		case FRONTIER_COUNT:
+			if (!getVarint(p, end, m_numberOfUrls))
+				return true;
+			break;
+		default:
+			std::cerr << "Error: corrupt crawl frontier record" << std::endl;
+			return false;
+		}
+	}
+
+	return true;
 }
 
 //******************** WebCrawler functions *******************************
@@ -122,6 +387,36 @@ void WebCrawler::crawl(void(*callback)(std::string url, bool success))
 	m_impl->crawl(callback);
 }
 
+void WebCrawler::setNearDuplicatePolicy(NearDuplicatePolicy policy)
+{
+	m_impl->setNearDuplicatePolicy(policy);
+}
+
+DedupStats WebCrawler::getDedupStats() const
+{
+	return m_impl->getDedupStats();
+}
+
+void WebCrawler::enablePositions()
+{
+	m_impl->enablePositions();
+}
+
+void WebCrawler::enableSnapshots()
+{
+	m_impl->enableSnapshots();
+}
+
+void WebCrawler::enableDocumentStore()
+{
+	m_impl->enableDocumentStore();
+}
+
+IndexSnapshot WebCrawler::snapshot() const
+{
+	return m_impl->snapshot();
+}
+
 bool WebCrawler::save(std::string filenameBase)
 {
 	return m_impl->save(filenameBase);
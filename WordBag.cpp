@@ -1,21 +1,37 @@
 #include "provided.h"
 #include "MyMap.h"
+#include "Metrics.h"
 #include <string>
+#include <vector>
 using namespace std;
 
 class WordBagImpl
 {
 public:
-	WordBagImpl(const string& text);
+	WordBagImpl(const string& text, bool keepPositions);
 	bool getFirstWord(string& word, int& count);
 	bool getNextWord(string& word, int& count);
+	bool getFirstWord(string& word, vector<int>& positions);
+	bool getNextWord(string& word, vector<int>& positions);
+	bool hasPositions() const;
 
 private:
+	void makeUpPositions(int count, vector<int>& positions);
+
+	// Each word's count, or, if positions are kept, its positions in the text
+	// (0 for the first token, and so on), the count being the number of them
 	MyMap<std::string, int> m_map;
+	MyMap<std::string, vector<int> > m_positions;
+	bool m_keepPositions;
+	int m_nextMadeUpPosition;
 };
 
-WordBagImpl::WordBagImpl(const string& text)
+WordBagImpl::WordBagImpl(const string& text, bool keepPositions)
 {
+	METRIC_TIMER(HISTOGRAM_TOKENIZE);
+	m_keepPositions = keepPositions;
+	m_nextMadeUpPosition = 0;
+
 	// Must make a copy of text since it's passed as a const parameter
 	std::string temp = text;
 
@@ -25,25 +41,41 @@ WordBagImpl::WordBagImpl(const string& text)
 	Tokenizer t(temp);
 	std::string w;
 
-	while (t.getNextToken(w))
+	int position = 0;
+	for (; t.getNextToken(w); position++)
 	{
+		if (m_keepPositions)
+		{
+			vector<int> *findPositions = m_positions.find(w);
+
+			if (findPositions == nullptr)
+				m_positions.associate(w, vector<int>(1, position));
+			else
+				findPositions->push_back(position);
+			continue;
+		}
+
 		int *findInt = m_map.find(w);
 
 		if (findInt == nullptr)
-		{
 			m_map.associate(w, 1);
-			//std::cerr << w << " 1" << std::endl;
-		}
 		else
-		{
-			m_map.associate(w, ++*findInt);
-			//std::cerr << w << " " << *findInt << std::endl;
-		}
+			++*findInt;
 	}
+	METRIC_ADD(COUNTER_TOKENS, position);
 }
 
 bool WordBagImpl::getFirstWord(string& word, int& count)
 {
+	if (m_keepPositions)
+	{
+		vector<int> *getFirstPositions = m_positions.getFirst(word);
+		if (getFirstPositions == nullptr)
+			return false;
+		count = getFirstPositions->size();
+		return true;
+	}
+
 	int *getFirstVal = m_map.getFirst(word);
 
 	if (getFirstVal == nullptr)
@@ -59,6 +91,15 @@ bool WordBagImpl::getFirstWord(string& word, int& count)
 
 bool WordBagImpl::getNextWord(string& word, int& count)
 {
+	if (m_keepPositions)
+	{
+		vector<int> *getNextPositions = m_positions.getNext(word);
+		if (getNextPositions == nullptr)
+			return false;
+		count = getNextPositions->size();
+		return true;
+	}
+
 	int *getNextVal = m_map.getNext(word);
 
 	if (getNextVal == nullptr)
@@ -71,14 +112,65 @@ bool WordBagImpl::getNextWord(string& word, int& count)
 	}
 }
 
+bool WordBagImpl::getFirstWord(string& word, vector<int>& positions)
+{
+	if (!m_keepPositions)
+	{
+		int count;
+		m_nextMadeUpPosition = 0;
+		if (!getFirstWord(word, count))
+			return false;
+		makeUpPositions(count, positions);
+		return true;
+	}
+
+	vector<int> *getFirstVal = m_positions.getFirst(word);
+	if (getFirstVal == nullptr)
+		return false;
+
+	positions = *getFirstVal;
+	return true;
+}
+
+bool WordBagImpl::getNextWord(string& word, vector<int>& positions)
+{
+	if (!m_keepPositions)
+	{
+		int count;
+		if (!getNextWord(word, count))
+			return false;
+		makeUpPositions(count, positions);
+		return true;
+	}
+
+	vector<int> *getNextVal = m_positions.getNext(word);
+	if (getNextVal == nullptr)
+		return false;
+
+	positions = *getNextVal;
+	return true;
+}
+
+bool WordBagImpl::hasPositions() const
+{
+	return m_keepPositions;
+}
+
+void WordBagImpl::makeUpPositions(int count, vector<int>& positions)
+{
+	positions.resize(count);
+	for (int i = 0; i < count; i++)
+		positions[i] = m_nextMadeUpPosition++;
+}
+
 //******************** WordBag functions *******************************
 
 // These functions simply delegate to WordBagImpl's functions.
 // You probably don't want to change any of this code.
 
-WordBag::WordBag(const std::string& text)
+WordBag::WordBag(const std::string& text, bool keepPositions)
 {
-	m_impl = new WordBagImpl(text);
+	m_impl = new WordBagImpl(text, keepPositions);
 }
 
 WordBag::~WordBag()
@@ -95,3 +187,18 @@ bool WordBag::getNextWord(string& word, int& count)
 {
 	return m_impl->getNextWord(word, count);
 }
+
+bool WordBag::getFirstWord(string& word, vector<int>& positions)
+{
+	return m_impl->getFirstWord(word, positions);
+}
+
+bool WordBag::getNextWord(string& word, vector<int>& positions)
+{
+	return m_impl->getNextWord(word, positions);
+}
+
+bool WordBag::hasPositions() const
+{
+	return m_impl->hasPositions();
+}
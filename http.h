@@ -25,6 +25,12 @@
 //    get sets the string pageContents to the content of the page and returns
 //    true; otherwise, it returns false.
 //
+//  HTTP().setMapped(url, file, offset, length);
+//    Like set, but the page contents are the length bytes at offset in a
+//    memory-mapped file (see MappedFile.h and CorpusLoader.h).  Nothing is
+//    copied until the page is first fetched with get; from then on it is in
+//    the pseudo-Web like a page given to set.
+//
 //  HTTP().normalizeLink(curURL, link)
 //    Return a string that represents a normalized form of the link string
 //    given the current URL string.  For example,
@@ -59,6 +65,8 @@
 #include <cctype>
 
 #include <unordered_map>
+#include <memory>
+#include "MappedFile.h"
 
 using std::unordered_map;
 
@@ -70,6 +78,14 @@ class HTTPController
 	typedef std::string string;
 	typedef unordered_map<string, string> Webmap;
 
+	struct MappedPage
+	{
+		std::shared_ptr<const MappedFile> file;
+		size_t offset;
+		size_t length;
+	};
+	typedef unordered_map<string, MappedPage> MappedWebmap;
+
 	struct Segment
 	{
 		Segment(size_t s, size_t ln) : start(s), len(ln) {}
@@ -96,6 +112,18 @@ public:
 		m_webmap[url] = pageContents;
 	}
 
+	void setMapped(string url, std::shared_ptr<const MappedFile> file, size_t offset, size_t length)
+	{
+		if (url.empty() || offset + length > file->size())
+			return;
+
+		url.erase(url.find_last_not_of('\r') + 1);
+		MappedPage& page = m_mappedWebmap[url];
+		page.file = file;
+		page.offset = offset;
+		page.length = length;
+	}
+
 	bool get(string url, string& pageContents) const
 	{
 		if (url.empty())
@@ -104,12 +132,24 @@ public:
 		// Strip off trailing '\r' characters
 		url.erase(url.find_last_not_of('\r') + 1);
 
-		if (!m_webmap.empty())  // using pseudo-Web
+		if (!m_webmap.empty() || !m_mappedWebmap.empty())  // using pseudo-Web
 		{
 			Webmap::const_iterator p = m_webmap.find(url);
-			if (p == m_webmap.end())
+			if (p != m_webmap.end())
+			{
+				pageContents = p->second;
+				return true;
+			}
+
+			// A mapped page is copied into m_webmap the first time it is fetched
+			MappedWebmap::const_iterator m = m_mappedWebmap.find(url);
+			if (m == m_mappedWebmap.end())
 				return false;
-			pageContents = p->second;
+			if (m->second.length == 0)
+				pageContents.clear();
+			else
+				pageContents.assign(m->second.file->data() + m->second.offset, m->second.length);
+			m_webmap[url] = pageContents;
 			return true;
 		}
 
@@ -245,7 +285,8 @@ private:
 	HINTERNET m_hINet;
 #endif
 
-	Webmap m_webmap;
+	mutable Webmap m_webmap;  // get copies mapped pages in
+	MappedWebmap m_mappedWebmap;
 
 	HTTPController();
 	~HTTPController();
@@ -1,9 +1,13 @@
 #include <string>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
 #include <cassert>
 #include "MyMap.h"
 #include "provided.h"
 #include "Indexer.h"
+#include "Benchmark.h"
 
 
 // KNOWN BUGS
@@ -28,6 +32,8 @@ void writeWordInfo(Indexer& indexer, std::string word);
 void reportStatus(std::string url, bool success);
 bool webCrawlerTest();
 bool searcherTest();
+bool positionalBenchmark();
+bool endToEndBenchmark();
 
 int main()
 {
@@ -36,6 +42,8 @@ int main()
 	//IndexerTest();
 	//webCrawlerTest();
 	searcherTest();
+	//positionalBenchmark();
+	//endToEndBenchmark();
 
 	std::cerr << "Passed all tests!" << std::endl;
 }
@@ -232,4 +240,126 @@ bool searcherTest()
 		std::cerr << "Please enter a search query: ";
 	}
 	return true;
-}
\ No newline at end of file
+}
+
+// Size of a file in bytes, 0 if it doesn't exist
+long long fileSize(std::string filename)
+{
+	std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+	if (!stream)
+		return 0;
+	return static_cast<long long>(stream.tellg());
+}
+
+// Average milliseconds per search over the queries, with anything written to
+// std::cerr thrown away so it isn't what gets timed
+double timeQueries(Searcher& s, const std::vector<std::string>& queries, int& matches)
+{
+	std::ostringstream discard;
+	std::streambuf* saved = std::cerr.rdbuf(discard.rdbuf());
+
+	matches = 0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < queries.size(); i++)
+		matches += s.search(queries[i]).size();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::cerr.rdbuf(saved);
+	return ms / queries.size();
+}
+
+bool positionalBenchmark()
+{
+	const std::string COUNTS_PREFIX = "C:/Temp/benchCounts";
+	const std::string POSITIONS_PREFIX = "C:/Temp/benchPositions";
+	const int PAGES = 2000;
+	const int WORDS_PER_PAGE = 300;
+	const int VOCABULARY = 5000;
+	const int QUERIES = 50;
+
+	// Synthetic pages: words drawn from a fixed vocabulary, skewed towards the
+	// low numbers the way real text is skewed towards common words
+	Indexer counts;
+	Indexer positions;
+	positions.enablePositions();
+	unsigned long long seed = 12345;
+	for (int page = 0; page < PAGES; page++)
+	{
+		std::string text;
+		for (int w = 0; w < WORDS_PER_PAGE; w++)
+		{
+			seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+			int r = static_cast<int>((seed >> 33) % VOCABULARY);
+			int word = r * r / VOCABULARY;
+			text += "w" + std::to_string(word) + " ";
+		}
+		WordBag countsBag(text);
+		WordBag positionsBag(text, true);
+		std::string url = "http://www.bench" + std::to_string(page) + ".com/page";
+		counts.incorporate(url, countsBag);
+		positions.incorporate(url, positionsBag);
+	}
+
+	if (!counts.save(COUNTS_PREFIX) || !positions.save(POSITIONS_PREFIX))
+	{
+		std::cerr << "Error saving benchmark indexes" << std::endl;
+		return false;
+	}
+
+	long long countBytes = fileSize(COUNTS_PREFIX + ".wtic");
+	long long positionBytes = fileSize(POSITIONS_PREFIX + ".pos");
+	std::cerr << "Count postings: " << countBytes << " bytes" << std::endl;
+	std::cerr << "Positions: " << positionBytes << " bytes ("
+		<< (countBytes > 0 ? 100.0 * positionBytes / countBytes : 0) << "% of the count postings)" << std::endl;
+
+	// The same word pairs as phrases, as proximity queries and as plain words
+	std::vector<std::string> phrases;
+	std::vector<std::string> near;
+	std::vector<std::string> plain;
+	for (int q = 0; q < QUERIES; q++)
+	{
+		std::string pair = "w" + std::to_string(q) + " w" + std::to_string(q + 1);
+		phrases.push_back("\"" + pair + "\"");
+		near.push_back("\"" + pair + "\"~5");
+		plain.push_back(pair);
+	}
+
+	Searcher s;
+	if (!s.load(POSITIONS_PREFIX))
+	{
+		std::cerr << "Error loading benchmark index" << std::endl;
+		return false;
+	}
+
+	int matches;
+	double ms = timeQueries(s, plain, matches);
+	std::cerr << "Word queries: " << ms << " ms each, " << matches << " matches" << std::endl;
+	ms = timeQueries(s, phrases, matches);
+	std::cerr << "Phrase queries: " << ms << " ms each, " << matches << " matches" << std::endl;
+	ms = timeQueries(s, near, matches);
+	std::cerr << "Proximity (~5) queries: " << ms << " ms each, " << matches << " matches" << std::endl;
+	return true;
+}
+
+// Runs the end-to-end benchmark (see Benchmark.h) with its default synthetic
+// corpus, writing the JSON report to the console and to a file
+bool endToEndBenchmark()
+{
+	const std::string REPORT_FILE = "C:/Temp/benchmark.json";
+	BenchmarkOptions options;
+	options.indexPrefix = "C:/Temp/benchIndex";
+
+	std::ostringstream report;
+	if (!runBenchmark(options, report))
+		return false;
+
+	std::cout << report.str();
+	std::ofstream stream(REPORT_FILE);
+	if (!stream)
+	{
+		std::cerr << "Error: Cannot create " << REPORT_FILE << std::endl;
+		return false;
+	}
+	stream << report.str();
+	return true;
+}
@@ -5,6 +5,8 @@
 #include <vector>
 #include <algorithm>  
 #include <cctype> 
+#include <cstring>
+#include <memory>
 #include "http.h"
 
 class WordBagImpl;
@@ -12,10 +14,19 @@ class WordBagImpl;
 class WordBag
 {
 public:
-	WordBag(const std::string& text);
+	// Where each word occurs is only recorded if keepPositions is set, as an
+	// index that keeps positions needs (see Indexer::enablePositions)
+	WordBag(const std::string& text, bool keepPositions = false);
 	~WordBag();
 	bool getFirstWord(std::string& word, int& count);
 	bool getNextWord(std::string& word, int& count);
+
+	// The same words, with the position of each occurrence instead of the
+	// count. A bag that didn't keep positions makes them up: each word's
+	// occurrences get the next ones in turn, so only the counts are right.
+	bool getFirstWord(std::string& word, std::vector<int>& positions);
+	bool getNextWord(std::string& word, std::vector<int>& positions);
+	bool hasPositions() const;
 private:
 	WordBagImpl* m_impl;
 	// We prevent a WordBag object from being copied or assigned by
@@ -31,6 +42,125 @@ struct UrlCount
 	int count;
 };
 
+// How Searcher orders its results (see Ranking.h)
+enum RankingMode
+{
+	RANK_BY_COUNTS,		// sum of the counts of the query words in the page (the default)
+	RANK_BY_TF_IDF,		// counts weighted by how rare each word is
+	RANK_BY_BM25		// like TF-IDF, but repeated words add less and long pages are scaled down
+};
+
+struct UrlScore
+{
+	std::string url;
+	double score;
+};
+
+// Counters kept by a Searcher over all its searches (see Searcher::setBudget)
+struct SearchStats
+{
+	int searches;
+	int partialSearches;	// searches that ran out of budget and returned partial results
+	int timeBudgetHits;		// ... because of the time budget
+	int postingBudgetHits;	// ... because of the posting budget
+	int itemsSkipped;		// query items never evaluated because the budget ran out
+	int itemsFiltered;		// query items for frequent words, checked only on the pages the others found
+};
+
+// Where a word occurs in a page, for indexes that keep positions
+// (see Indexer::enablePositions)
+struct UrlPositions
+{
+	std::string url;
+	std::vector<int> positions;  // token numbers, in increasing order
+};
+
+// A page that has already been downloaded, for Indexer::incorporateAll
+struct FetchedPage
+{
+	std::string url;
+	std::string contents;
+};
+
+// What Indexer::incorporate does with a new page whose content is nearly the
+// same as that of a page already in the index
+enum NearDuplicatePolicy
+{
+	INDEX_NEAR_DUPLICATES,		// index it like any other page (the default)
+	SKIP_NEAR_DUPLICATES,		// don't index it
+	CLUSTER_NEAR_DUPLICATES		// don't index it, but remember it as a copy of the indexed page
+};
+
+// How an index that will only be searched from now on is packed (see Indexer::freeze)
+enum FreezeMode
+{
+	FREEZE_NONE,		// left as it is
+	FREEZE_ARENA,		// packed into one contiguous block of memory (the default)
+	FREEZE_HUGE_PAGES	// the same, backed by huge pages where the system has them
+};
+
+struct DedupStats
+{
+	int pagesChecked;
+	int nearDuplicatesFound;
+	int pagesSkipped;
+	int pagesClustered;
+};
+
+// Where the time went in Indexer::buildExternal
+struct ExternalBuildStats
+{
+	int pagesIndexed;
+	int runsSpilled;		// sorted runs written while indexing
+	int mergePasses;		// passes over the runs needed to merge them into one
+	double spillSeconds;
+	double mergeSeconds;
+};
+
+// Memory taken by one of an Indexer's data structures (see Indexer::memoryStats).
+// The tree fields are only filled in for structures that are MyMap trees; the
+// others put all their bytes in valueBytes.
+struct StructureMemoryStats
+{
+	std::string name;
+	long long entries;			// nodes of a tree, items of anything else
+	long long nodeBytes;		// the tree nodes themselves
+	long long keyBytes;			// heap memory owned by the keys
+	long long valueBytes;		// heap memory owned by the values (the postings, for the index)
+	long long overheadBytes;	// estimated allocator bookkeeping
+	long long totalBytes;
+	int treeHeight;
+	int balancedHeight;			// height the tree would have if it were perfectly balanced
+	double averageDepth;
+};
+
+struct IndexMemoryStats
+{
+	std::vector<StructureMemoryStats> structures;
+	long long totalBytes;
+};
+
+class IndexSnapshotImpl;
+
+// A consistent, read-only view of an Indexer as of the last time it published
+// one (see Indexer::enableSnapshots). Copies share the same view, and it may be
+// used from any thread while the Indexer goes on incorporating pages.
+class IndexSnapshot
+{
+public:
+	IndexSnapshot();
+	IndexSnapshot(std::shared_ptr<const IndexSnapshotImpl> impl);
+	std::vector<UrlCount> getUrlCounts(std::string word) const;
+	std::vector<UrlScore> getUrlScores(std::string word, RankingMode ranking) const;
+	std::vector<UrlScore> scoreUrlCounts(const std::vector<UrlCount>& urlCounts, RankingMode ranking) const;
+	std::vector<UrlPositions> getUrlPositions(std::string word) const;
+	std::vector<std::string> getTermsWithPrefix(std::string prefix) const;
+	int estimatePostings(std::string word) const;
+	bool hasPositions() const;
+private:
+	std::shared_ptr<const IndexSnapshotImpl> m_impl;
+};
+
 class IndexerImpl;
 
 class Indexer
@@ -39,8 +169,40 @@ public:
 	Indexer();
 	~Indexer();
 	bool incorporate(std::string url, WordBag& wb);
+	bool incorporate(std::string url, WordBag& wb, unsigned long long fingerprint);
+	bool isUnchanged(std::string url, unsigned long long fingerprint);
+	void setNearDuplicatePolicy(NearDuplicatePolicy policy);
+	DedupStats getDedupStats() const;
+	std::vector<std::string> getNearDuplicates(std::string url);
+	bool remove(std::string url);
+	bool replace(std::string url, WordBag& wb);
+	void compact();
+	bool useSegments(std::string filenameBase, int flushThreshold);
+	int incorporateAll(const std::vector<FetchedPage>& pages, int threadCount);
+	bool buildExternal(bool(*nextPage)(std::string& url, std::string& contents), std::string filenameBase,
+		size_t memoryBudget, ExternalBuildStats& stats);
+	void setBloomFilter(double falsePositiveRate, size_t maxBytes);
+	void enablePositions();
+	bool positionsEnabled() const;
+	void freeze();
+	void freeze(FreezeMode mode);
+	void setFrequentTerms(double minPageFraction, std::vector<std::string> stopwords);
+	bool isFrequentTerm(std::string word);
+	std::vector<UrlScore> getUrlScoresAmong(std::string word, const std::vector<std::string>& urls, RankingMode ranking);
+	void enableSnapshots();
+	IndexSnapshot snapshot() const;
 	std::vector<UrlCount> getUrlCounts(std::string word);
+	std::vector<UrlScore> getUrlScores(std::string word, RankingMode ranking);
+	std::vector<UrlScore> scoreUrlCounts(const std::vector<UrlCount>& urlCounts, RankingMode ranking);
+	std::vector<UrlPositions> getUrlPositions(std::string word);
+	std::vector<std::string> getTermsWithPrefix(std::string prefix);
+	int estimatePostings(std::string word);
+	IndexMemoryStats memoryStats();
+	bool checkpoint();
+	void waitForCheckpoint();
 	bool save(std::string filenameBase);
+	bool saveShards(std::string filenameBase, int shardCount);
+	bool saveShared(std::string filenameBase);
 	bool load(std::string filenameBase);
 private:
 	IndexerImpl* m_impl;
@@ -61,6 +223,12 @@ public:
 	void addUrl(std::string url);
 	int getNumberOfUrls() const;
 	void crawl(void(*callback)(std::string url, bool success));
+	void setNearDuplicatePolicy(NearDuplicatePolicy policy);
+	DedupStats getDedupStats() const;
+	void enablePositions();
+	void enableSnapshots();
+	void enableDocumentStore();
+	IndexSnapshot snapshot() const;
 	bool save(std::string filenameBase);
 	bool load(std::string filenameBase);
 private:
@@ -80,7 +248,19 @@ public:
 	Searcher();
 	~Searcher();
 	std::vector<std::string> search(std::string terms);
+	void setRanking(RankingMode ranking);
+	void setBudget(double maxMilliseconds, int maxPostings);
+	void setFreezeMode(FreezeMode mode);
+	void setFrequentTerms(double minPageFraction, std::vector<std::string> stopwords);
+	bool lastSearchWasPartial() const;
+	SearchStats getSearchStats() const;
 	bool load(std::string filenameBase);
+	bool loadShards(std::string filenameBase);
+	std::vector<size_t> getShardBytes() const;
+	bool loadShared(std::string filenameBase);
+	std::string getSnippet(std::string url) const;
+	void attach(const Indexer& indexer);
+	void attach(const WebCrawler& crawler);
 private:
 	SearcherImpl* m_impl;
 	// We prevent a Searcher object from being copied or assigned by
@@ -114,6 +294,40 @@ inline void strToLower(std::string& s)
 	std::transform(s.begin(), s.end(), s.begin(), toLower);
 }
 
+// contentFingerprint - 64-bit non-cryptographic hash of a fetched page, used
+// to tell whether a page changed since it was last incorporated. Consumes the
+// text 8 bytes at a time and finishes with the MurmurHash3 avalanche step.
+
+inline unsigned long long contentFingerprint(const std::string& text)
+{
+	const unsigned long long MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+	unsigned long long h = text.size() * MULTIPLIER;
+	const char* p = text.data();
+	size_t remaining = text.size();
+
+	while (remaining >= 8)
+	{
+		unsigned long long word;
+		std::memcpy(&word, p, 8);
+		h = (h ^ word) * MULTIPLIER;
+		h ^= h >> 29;
+		p += 8;
+		remaining -= 8;
+	}
+
+	unsigned long long tail = 0;
+	for (size_t i = 0; i < remaining; i++)
+		tail |= static_cast<unsigned long long>(static_cast<unsigned char>(p[i])) << (8 * i);
+	h = (h ^ tail) * MULTIPLIER;
+
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
 // Tokenizer
 
 class Tokenizer
@@ -142,6 +356,12 @@ public:
 		return true;
 	}
 
+	// Whether the token just returned is immediately followed by c
+	bool tokenFollowedBy(char c) const
+	{
+		return m_nextChar != m_text.end() && *m_nextChar == c;
+	}
+
 private:
 	const std::string           m_text;
 	std::string::const_iterator m_nextChar;